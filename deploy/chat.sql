@@ -0,0 +1,45 @@
+-- 单体ChatServer使用的chat库（src/server/model），微服务使用的chatdb见init.sql
+CREATE DATABASE IF NOT EXISTS chat;
+USE chat;
+
+-- 用户表，state已不在登录/注销路径上维护，在线状态以redis中的在线位置为准
+CREATE TABLE IF NOT EXISTS user (
+    id INT PRIMARY KEY AUTO_INCREMENT,
+    name VARCHAR(50) NOT NULL UNIQUE,
+    password VARCHAR(50) NOT NULL,
+    state ENUM('online', 'offline') DEFAULT 'offline'
+) ENGINE=InnoDB;
+
+-- 好友表
+CREATE TABLE IF NOT EXISTS friend (
+    userid INT NOT NULL,
+    friendid INT NOT NULL,
+    PRIMARY KEY (userid, friendid)
+) ENGINE=InnoDB;
+
+-- 群组表
+CREATE TABLE IF NOT EXISTS allgroup (
+    id INT PRIMARY KEY AUTO_INCREMENT,
+    groupname VARCHAR(50) NOT NULL UNIQUE,
+    groupdesc VARCHAR(200) DEFAULT ''
+) ENGINE=InnoDB;
+
+-- 群组成员表
+CREATE TABLE IF NOT EXISTS groupuser (
+    groupid INT NOT NULL,
+    userid INT NOT NULL,
+    grouprole ENUM('creator', 'normal') DEFAULT 'normal',
+    PRIMARY KEY (groupid, userid),
+    INDEX idx_userid (userid)
+) ENGINE=InnoDB;
+
+-- 离线消息表，按自增id分页读取、按id范围删除
+CREATE TABLE IF NOT EXISTS offlinemessage (
+    id BIGINT NOT NULL AUTO_INCREMENT PRIMARY KEY,
+    userid INT NOT NULL,
+    message VARCHAR(500) NOT NULL,
+    INDEX idx_user_id (userid, id)
+) ENGINE=InnoDB;
+
+-- 已有的offlinemessage表没有id列时，升级执行：
+-- ALTER TABLE offlinemessage ADD id BIGINT NOT NULL AUTO_INCREMENT PRIMARY KEY FIRST, ADD INDEX idx_user_id(userid, id);
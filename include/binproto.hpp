@@ -0,0 +1,153 @@
+#ifndef BINPROTO_H
+#define BINPROTO_H
+
+#include "public.hpp"
+#include "json.hpp"
+#include <arpa/inet.h>
+#include <cstdint>
+#include <cstring>
+#include <string>
+using namespace std;
+using json = nlohmann::json;
+
+/*
+server和client的公共文件：聊天热路径使用的二进制消息格式
+json帧总是以'{'开头，二进制帧以BIN_MAGIC开头，二者可以在同一条连接上共存
+
+帧体布局（多字节字段均为网络字节序）：
+ 0  magic    1B   BIN_MAGIC
+ 1  version  1B   BIN_VERSION
+ 2  msgid    2B   ONE_CHAT_MSG / GROUP_CHAT_MSG
+ 4  id       4B   发送者id
+ 8  toid     4B   一对一聊天为接收者id，群聊为groupid
+12  namelen  2B
+14  timelen  2B
+16  msglen   4B
+20  name | time | msg
+*/
+const uint8_t BIN_MAGIC = 0xCB;
+const uint8_t BIN_VERSION = 1;
+const int BIN_HEADER_LEN = 20;
+
+// 二进制聊天消息的解码视图，name/time/msg直接指向帧内数据，不做拷贝
+struct BinChatMsg
+{
+    int msgid = 0;
+    int id = 0;
+    int toid = 0;
+    const char *name = nullptr;
+    uint16_t namelen = 0;
+    const char *time = nullptr;
+    uint16_t timelen = 0;
+    const char *msg = nullptr;
+    uint32_t msglen = 0;
+
+    // 整个帧体，转发给二进制连接时原样发送
+    const char *frame = nullptr;
+    size_t framelen = 0;
+};
+
+// 判断帧体是否为二进制格式
+inline bool isBinaryFrame(const char *data, size_t len)
+{
+    return len > 0 && static_cast<uint8_t>(data[0]) == BIN_MAGIC;
+}
+
+// 解码二进制聊天消息，长度不匹配或版本不支持时返回false
+inline bool decodeBinChatMsg(const char *data, size_t len, BinChatMsg &out)
+{
+    if (len < BIN_HEADER_LEN || static_cast<uint8_t>(data[0]) != BIN_MAGIC
+        || static_cast<uint8_t>(data[1]) != BIN_VERSION)
+    {
+        return false;
+    }
+
+    uint16_t msgid16, namelen, timelen;
+    uint32_t id32, toid32, msglen;
+    memcpy(&msgid16, data + 2, 2);
+    memcpy(&id32, data + 4, 4);
+    memcpy(&toid32, data + 8, 4);
+    memcpy(&namelen, data + 12, 2);
+    memcpy(&timelen, data + 14, 2);
+    memcpy(&msglen, data + 16, 4);
+
+    out.msgid = ntohs(msgid16);
+    out.id = static_cast<int32_t>(ntohl(id32));
+    out.toid = static_cast<int32_t>(ntohl(toid32));
+    out.namelen = ntohs(namelen);
+    out.timelen = ntohs(timelen);
+    out.msglen = ntohl(msglen);
+    if (static_cast<size_t>(BIN_HEADER_LEN) + out.namelen + out.timelen + out.msglen != len)
+    {
+        return false;
+    }
+
+    out.name = data + BIN_HEADER_LEN;
+    out.time = out.name + out.namelen;
+    out.msg = out.time + out.timelen;
+    out.frame = data;
+    out.framelen = len;
+    return true;
+}
+
+// 编码二进制聊天消息
+inline string encodeBinChatMsg(int msgid, int id, int toid,
+                               const string &name, const string &time, const string &msg)
+{
+    string out(BIN_HEADER_LEN, '\0');
+    out.reserve(BIN_HEADER_LEN + name.size() + time.size() + msg.size());
+
+    uint16_t msgid16 = htons(static_cast<uint16_t>(msgid));
+    uint32_t id32 = htonl(static_cast<uint32_t>(id));
+    uint32_t toid32 = htonl(static_cast<uint32_t>(toid));
+    uint16_t namelen = htons(static_cast<uint16_t>(name.size()));
+    uint16_t timelen = htons(static_cast<uint16_t>(time.size()));
+    uint32_t msglen = htonl(static_cast<uint32_t>(msg.size()));
+
+    out[0] = static_cast<char>(BIN_MAGIC);
+    out[1] = static_cast<char>(BIN_VERSION);
+    memcpy(&out[2], &msgid16, 2);
+    memcpy(&out[4], &id32, 4);
+    memcpy(&out[8], &toid32, 4);
+    memcpy(&out[12], &namelen, 2);
+    memcpy(&out[14], &timelen, 2);
+    memcpy(&out[16], &msglen, 4);
+    out.append(name).append(time).append(msg);
+    return out;
+}
+
+// 二进制聊天消息转换成json，供redis转发、离线存储以及json客户端使用
+inline json binChatMsgToJson(const BinChatMsg &m)
+{
+    json js;
+    js["msgid"] = m.msgid;
+    js["id"] = m.id;
+    js["name"] = string(m.name, m.namelen);
+    if (m.msgid == GROUP_CHAT_MSG)
+    {
+        js["groupid"] = m.toid;
+    }
+    else
+    {
+        js["toid"] = m.toid;
+    }
+    js["msg"] = string(m.msg, m.msglen);
+    js["time"] = string(m.time, m.timelen);
+    return js;
+}
+
+// json聊天消息转换成二进制格式，不是聊天消息时返回false
+inline bool jsonToBinChatMsg(const json &js, string &out)
+{
+    int msgid = js.value("msgid", 0);
+    if (msgid != ONE_CHAT_MSG && msgid != GROUP_CHAT_MSG)
+    {
+        return false;
+    }
+    int toid = (msgid == GROUP_CHAT_MSG) ? js.value("groupid", 0) : js.value("toid", 0);
+    out = encodeBinChatMsg(msgid, js.value("id", 0), toid,
+                           js.value("name", string()), js.value("time", string()), js.value("msg", string()));
+    return true;
+}
+
+#endif
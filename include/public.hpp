@@ -17,6 +17,19 @@ enum EnMsgType
     CREATE_GROUP_MSG, // 创建群组
     ADD_GROUP_MSG, // 加入群组
     GROUP_CHAT_MSG, // 群聊天
+
+    OFFLINE_MSG_PAGE, // 离线消息分页下发
+    OFFLINE_MSG_ACK, // 离线消息分页确认
+
+    GROUP_MEMBERS_MSG, // 查询群组成员
+    GROUP_MEMBERS_MSG_ACK, // 查询群组成员响应
 };
 
+/*
+TCP消息帧格式：[4字节网络字节序的消息体长度][消息体]
+server和client都按帧收发，解决TCP粘包/半包问题
+*/
+const int FRAME_HEADER_LEN = 4;               // 帧头长度
+const int FRAME_MAX_LEN = 4 * 1024 * 1024;    // 单帧消息体最大长度，超过则认为对端非法
+
 #endif
\ No newline at end of file
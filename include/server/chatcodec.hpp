@@ -0,0 +1,65 @@
+#ifndef CHATCODEC_H
+#define CHATCODEC_H
+
+#include <muduo/net/TcpConnection.h>
+#include <muduo/net/Buffer.h>
+#include "public.hpp"
+#include <functional>
+#include <memory>
+#include <string>
+using namespace std;
+using namespace muduo;
+using namespace muduo::net;
+
+// 一帧完整消息的回调，data指向输入Buffer内部，只在回调期间有效
+using FrameCallback = std::function<void(const TcpConnectionPtr &conn, const char *data, size_t len, Timestamp)>;
+
+// 编码好的一帧消息（长度头+消息体），构造后不可变，群发时所有接收者共享同一份
+class ChatFrame
+{
+public:
+    ChatFrame(const char *payload, size_t len);
+
+    // 整帧数据，直接写入socket
+    const char *data() const { return _buf.data(); }
+    size_t size() const { return _buf.size(); }
+    // 不含长度头的消息体，用于redis转发和离线存储
+    const char *payload() const { return _buf.data() + FRAME_HEADER_LEN; }
+    size_t payloadSize() const { return _buf.size() - FRAME_HEADER_LEN; }
+
+private:
+    string _buf;
+};
+using ChatFramePtr = std::shared_ptr<const ChatFrame>;
+
+/*
+长度头编解码器
+收：从muduo的输入Buffer中切出零个或多个完整帧，不完整的帧留在Buffer中等待下次回调
+发：给消息体加上长度头后发送
+*/
+class ChatCodec
+{
+public:
+    explicit ChatCodec(const FrameCallback &cb, int maxFrameLen = FRAME_MAX_LEN);
+
+    // 作为TcpServer的MessageCallback使用
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp time);
+
+    // 按帧格式发送一条消息
+    static void send(const TcpConnectionPtr &conn, const string &msg);
+    static void send(const TcpConnectionPtr &conn, const char *data, size_t len);
+    // 发送已经写入Buffer的消息体，长度头直接写入Buffer的预留空间，不再拷贝消息体
+    static void send(const TcpConnectionPtr &conn, Buffer *body);
+
+    // 把消息编码成可共享的帧，只做一次序列化
+    static ChatFramePtr encode(const string &msg);
+    static ChatFramePtr encode(const char *data, size_t len);
+    // 发送共享帧，跨线程时只传递引用计数，不拷贝消息内容
+    static void send(const TcpConnectionPtr &conn, const ChatFramePtr &frame);
+
+private:
+    FrameCallback _frameCallback;
+    int _maxFrameLen;
+};
+
+#endif
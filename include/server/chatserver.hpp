@@ -3,6 +3,8 @@
 
 #include <muduo/net/TcpServer.h>
 #include <muduo/net/EventLoop.h>
+#include "chatcodec.hpp"
+#include "workerpool.hpp"
 using namespace muduo;
 using namespace muduo::net;
 
@@ -18,17 +20,26 @@ public:
     // 启动服务
     void start();
 
+    // 业务线程池，用于查询队列积压和等待时间
+    WorkerPool &getWorkerPool() { return _workerPool; }
+
 private:
     // 上报链接相关信息的回调函数
     void onConnection(const TcpConnectionPtr &);
 
-    // 上报读写事件相关信息的回调函数
+    // 把会阻塞的处理交给业务线程池；该连接积压过多或队列已满时暂停读取这个连接
+    void dispatch(const TcpConnectionPtr &conn, WorkerPool::Task task);
+
+    // 上报一帧完整消息的回调函数，由_codec切帧后调用
     void onMessage(const TcpConnectionPtr &,
-                   Buffer *,
+                   const char *data,
+                   size_t len,
                    Timestamp);
 
     TcpServer _server; // 组合的muduo库，实现服务器功能的类对象
+    ChatCodec _codec;  // 长度头编解码器，负责切帧
     EventLoop *_loop;  // 指向事件循环对象的指针
+    WorkerPool _workerPool; // 业务线程池，执行会阻塞的消息处理器
 };
 
 #endif
\ No newline at end of file
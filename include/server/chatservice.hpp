@@ -3,8 +3,11 @@
 
 #include <muduo/net/TcpConnection.h>
 #include <unordered_map>
+#include <unordered_set>
 #include <functional>
 #include <mutex>
+#include <atomic>
+#include <vector>
 using namespace std;
 using namespace muduo;
 using namespace muduo::net;
@@ -14,11 +17,21 @@ using namespace muduo::net;
 #include "friendmodel.hpp"
 #include "usermodel.hpp"
 #include "offlinemessagemodel.hpp"
+#include "offlinemsgwriter.hpp"
+#include "usercache.hpp"
 #include "json.hpp"
+#include "binproto.hpp"
+#include "chatcodec.hpp"
+#include "onlineregistry.hpp"
+#include "presenceservice.hpp"
 using json = nlohmann::json;
 
+class WorkerPool;
+
 // 表示处理消息的事件回调方法类型
 using MsgHandler = std::function<void(const TcpConnectionPtr &conn, json &js, Timestamp)>;
+// 表示处理二进制消息的事件回调方法类型
+using BinMsgHandler = std::function<void(const TcpConnectionPtr &conn, const BinChatMsg &msg, Timestamp)>;
 
 // 聊天服务器业务类
 class ChatService
@@ -38,32 +51,121 @@ public:
     void createGroup(const TcpConnectionPtr &conn, json &js, Timestamp time);
     // 加入群组业务
     void addGroup(const TcpConnectionPtr &conn, json &js, Timestamp time);
+    // 查询群组成员业务，配合登录时的lazy模式按需加载
+    void groupMembers(const TcpConnectionPtr &conn, json &js, Timestamp time);
     // 群组聊天业务
     void groupChat(const TcpConnectionPtr &conn, json &js, Timestamp time);
+    // 一对一聊天业务（二进制格式）
+    void oneChatBin(const TcpConnectionPtr &conn, const BinChatMsg &msg, Timestamp time);
+    // 群组聊天业务（二进制格式）
+    void groupChatBin(const TcpConnectionPtr &conn, const BinChatMsg &msg, Timestamp time);
+    // 离线消息分页确认，删除已确认的部分并下发下一页
+    void offlineMsgAck(const TcpConnectionPtr &conn, json &js, Timestamp time);
     // 处理注销业务
     void loginout(const TcpConnectionPtr &conn, json &js, Timestamp time);
     // 处理客户端异常退出
     void clientCloseException(const TcpConnectionPtr &conn);
+    // 停止后台线程（在线状态心跳），服务器退出时在reset之前调用
+    void stop();
     // 服务器异常，业务重置方法
     void reset();
     // 获取消息对应的处理器
     MsgHandler getHandler(int msgid);
-    // 从redis消息队列中获取订阅的消息
-    void handleRedisSubscribeMessage(int, string);
+    // 获取二进制消息对应的处理器，返回引用，避免每条消息拷贝一次std::function
+    const BinMsgHandler &getBinHandler(int msgid);
+    // 消息的处理器是否会阻塞在MySQL/redis上，阻塞的处理器交给业务线程池执行
+    bool isBlockingMsg(int msgid) const { return _blockingMsgIds.count(msgid) > 0; }
+    // 从redis消息队列中批量获取订阅的消息，消息内容为发往本节点的接收者列表和聊天消息
+    void handleRedisSubscribeMessage(const RedisMessageBatch &batch);
+    // 从本节点的redis stream批量获取消息，消息都交给连接发送后返回true
+    bool handleRedisStreamMessage(const RedisMessageBatch &batch);
+    // redis订阅连接重连成功，redis可能已经重启，重新登记本节点的在线用户
+    void handleRedisReconnect();
+    // 设置本节点id，并订阅本节点的通道，启动服务前调用
+    // useStream为true时节点间消息改走本节点的redis stream（至少一次投递），集群内所有节点必须使用同一种方式
+    void setNodeId(const string &nodeId, bool useStream = false);
+    const string &getNodeId() const { return _nodeId; }
+    // 批量查询用户是否在线，本机注册表优先，其余查在线状态服务
+    unordered_set<int> queryOnline(const vector<int> &useridVec);
     // 公開獲取模型對象
     UserModel& getUserModel() { return _userModel; }
     FriendModel& getFriendModel() { return _friendModel; }
     GroupModel& getGroupModel() { return _groupModel; }
+    // 本机在线用户数
+    size_t getOnlineCount() const { return _onlineRegistry.size(); }
+    // 群聊扇出统计：接收者总数和实际编码的字节数，编码字节数不随群成员数增长
+    long getFanoutRecipients() const { return _fanoutRecipients; }
+    long getFanoutEncodedBytes() const { return _fanoutEncodedBytes; }
+    // 跨节点转发的publish次数，群消息每个目标节点只计一次
+    long getNodePublishCount() const { return _nodePublishCnt; }
+    // 跨节点消息的投递统计：收到的批次数，以及向EventLoop投递任务的次数（每批每个loop一次）
+    long getSubscribeBatchCount() const { return _subscribeBatchCnt; }
+    long getSubscribeLoopPosts() const { return _subscribeLoopPosts; }
+    // 在线状态服务，统计近端缓存命中率
+    const PresenceService &getPresence() const { return _presence; }
+    // 用户信息缓存，统计命中、淘汰和内存占用
+    const UserCache &getUserCache() const { return *UserCache::instance(); }
+    // 业务线程池由ChatServer持有，构造时登记，用于查询队列积压和等待时间；未登记时为nullptr
+    void setWorkerPool(WorkerPool *pool) { _workerPool = pool; }
+    WorkerPool *getWorkerPool() const { return _workerPool; }
 
 private:
     ChatService();
 
+    // 订阅缓存的失效通道，并设置该缓存的失效回调
+    template <typename Cache>
+    void subscribeInvalidate(const string &channel, Cache *cache);
+
+    // 判断连接是否协商使用二进制格式
+    static bool isBinaryConn(const TcpConnectionPtr &conn);
+    // 按接收方连接协商的格式下发json聊天消息
+    void sendChatMsg(const TcpConnectionPtr &conn, const json &js);
+    // 按接收方连接协商的格式下发二进制聊天消息
+    void sendChatMsg(const TcpConnectionPtr &conn, const BinChatMsg &msg);
+    // 下发id大于afterId的下一页离线消息，没有离线消息则不发送
+    void sendOfflineMsgPage(const TcpConnectionPtr &conn, int userid, long long afterId);
+    // 按需生成的json帧和二进制帧，同一条消息每种格式最多编码一次
+    struct LazyFrames
+    {
+        function<ChatFramePtr()> makeJson;
+        function<ChatFramePtr()> makeBin;
+        ChatFramePtr json;
+        ChatFramePtr bin;
+
+        const ChatFramePtr &jsonFrame()
+        {
+            if (!json)
+                json = makeJson();
+            return json;
+        }
+        const ChatFramePtr &binFrame()
+        {
+            if (!bin)
+                bin = makeBin();
+            return bin;
+        }
+    };
+    // 发给本机在线的用户（跳过exceptId），返回不在本机的用户
+    vector<int> deliverLocal(const vector<int> &useridVec, int exceptId, LazyFrames &frames);
+    // 发给不在本机的用户：按在线位置表合并到目标节点，每个节点publish一次，不在线的存储离线消息
+    void routeRemote(const vector<int> &useridVec, const shared_ptr<const string> &payload);
+    // 跨节点消息的投递进度
+    struct DeliveryLatch;
+    // 把redis上收到的一批消息按EventLoop分组投递，latch不为空时记录投递进度
+    void dispatchRedisBatch(const RedisMessageBatch &batch, const shared_ptr<DeliveryLatch> &latch);
+    // 群聊扇出，跳过发送者exceptId，json帧和二进制帧都按需生成且只生成一次
+    void fanoutGroupMsg(const vector<int> &useridVec, int exceptId,
+                        const function<ChatFramePtr()> &makeJsonFrame,
+                        const function<ChatFramePtr()> &makeBinFrame);
+
     // 存储消息id和其对应的业务处理方法
     unordered_map<int, MsgHandler> _msgHandlerMap;
-    // 存储在线用户的通信连接
-    unordered_map<int, TcpConnectionPtr> _userConnMap;
-    // 定义互斥锁，保证_userConnMap的线程安全
-    mutex _connMutex;
+    // 存储二进制消息id和其对应的业务处理方法
+    unordered_map<int, BinMsgHandler> _binMsgHandlerMap;
+    // 处理器会访问MySQL/redis的消息id，json和二进制格式共用
+    unordered_set<int> _blockingMsgIds;
+    // 存储在线用户的通信连接，内部分片加锁，保证线程安全
+    OnlineRegistry _onlineRegistry;
 
     // 数据操作类对象
     UserModel _userModel;
@@ -73,6 +175,25 @@ private:
 
     // redis操作对象
     Redis _redis;
+    // redis是否连接成功，连接成功时setNodeId订阅完所有通道后才启动订阅线程
+    bool _redisConnected = false;
+    // 在线状态服务，依赖_redis，必须声明在其后
+    PresenceService _presence{_redis};
+    // 本节点id，对应redis上的节点通道
+    string _nodeId;
+    // 节点间消息是否走redis stream
+    bool _useStream = false;
+    // 缓存失效通道 => 收到其它节点的失效通知时删除本地缓存
+    unordered_map<string, function<void(int)>> _invalidateHandlers;
+    // ChatServer的业务线程池，只用于统计
+    WorkerPool *_workerPool = nullptr;
+
+    // 群聊扇出统计
+    atomic<long> _fanoutRecipients{0};
+    atomic<long> _fanoutEncodedBytes{0};
+    atomic<long> _nodePublishCnt{0};
+    atomic<long> _subscribeBatchCnt{0};
+    atomic<long> _subscribeLoopPosts{0};
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,76 @@
+#ifndef CONNECTIONPOOL_H
+#define CONNECTIONPOOL_H
+
+#include "db.h"
+#include <memory>
+#include <queue>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+using namespace std;
+
+/*
+MySQL连接池
+1. 连接复用，避免每次数据库操作都重新建立TCP连接、认证、设置字符集
+2. 线程亲和：每个muduo I/O线程和业务线程固定缓存一个连接，热路径上不需要竞争公共队列
+3. 有界等待：连接数达到上限后最多等待_connectionTimeout，超时返回nullptr
+4. 健康检查：后台线程定期ping空闲连接，回收超过_maxIdleTime的多余连接；stop或析构时停止并等待其退出
+5. 连接数上限的检查和计数在_queueMutex内一起完成，并发创建连接不会超过_maxSize
+*/
+class ConnectionPool
+{
+public:
+    // 获取连接池单例对象
+    static ConnectionPool *instance();
+
+    // 从连接池获取一个可用连接，智能指针析构时自动归还；超时返回nullptr
+    shared_ptr<MySQL> getConnection();
+
+    // 允许当前线程缓存一个连接，长期运行的业务线程启动时调用
+    static void enableThreadCache();
+
+    // 停止健康检查线程并等待其退出，之后仍可获取连接
+    void stop();
+
+    // 连接池统计信息
+    int getTotalCount() const { return _connectionCnt; }
+    int getIdleCount();
+    long getTimeoutCount() const { return _timeoutCnt; }
+
+private:
+    ConnectionPool();
+    ~ConnectionPool();
+    ConnectionPool(const ConnectionPool &) = delete;
+    ConnectionPool &operator=(const ConnectionPool &) = delete;
+
+    // 创建一个新连接，失败返回nullptr；调用方负责_connectionCnt的计数
+    MySQL *createConnection();
+    // 检查连接是否可用，空闲时间较长的连接才真正ping一次
+    bool checkConnection(MySQL *conn);
+    // 归还连接，优先放回当前线程的缓存
+    void releaseConnection(MySQL *conn);
+    // 关闭连接
+    void destroyConnection(MySQL *conn);
+    // 后台健康检查线程
+    void scannerConnectionTask();
+
+    int _initSize;                         // 初始连接数
+    int _maxSize;                          // 最大连接数
+    chrono::seconds _maxIdleTime;          // 多余连接的最大空闲时间
+    chrono::seconds _pingIdleTime;         // 空闲超过该时长，使用前先ping
+    chrono::milliseconds _connectionTimeout; // 获取连接的最大等待时间
+
+    queue<MySQL *> _connectionQue;  // 公共空闲连接队列
+    mutex _queueMutex;              // 保证_connectionQue的线程安全
+    condition_variable _cv;         // 等待空闲连接
+    atomic_int _connectionCnt{0};   // 已创建和正在创建的连接总数，只在持有_queueMutex时修改
+    atomic_long _timeoutCnt{0};     // 获取连接超时次数
+
+    thread _scanner;              // 健康检查线程
+    mutex _stopMutex;
+    condition_variable _stopCond; // 健康检查线程在上面等待下一个周期，stop时立即唤醒
+    bool _stopping = false;
+};
+
+#endif
@@ -3,6 +3,10 @@
 
 #include <mysql/mysql.h>
 #include <string>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include "preparedstatement.h"
 using namespace std;
 
 // 数据库操作类
@@ -21,8 +25,24 @@ public:
     MYSQL_RES *query(string sql);
     // 获取连接
     MYSQL* getConnection();
+    // 检查连接是否可用
+    bool ping();
+    // 获取预处理语句，同一条SQL在该连接上只解析一次，之后直接复用
+    PreparedStatement *prepare(const string &sql);
+
+    // 刷新连接的空闲起始时间点，归还到连接池时调用
+    void refreshAliveTime() { _alivetime = chrono::steady_clock::now(); }
+    // 连接已经空闲的时长
+    chrono::milliseconds getIdleTime() const
+    {
+        return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - _alivetime);
+    }
+
 private:
     MYSQL *_conn;
+    chrono::steady_clock::time_point _alivetime; // 进入空闲状态的时间点
+    // 预处理语句缓存 key:SQL文本 value:该连接上解析好的语句，随连接一起在连接池中复用
+    unordered_map<string, unique_ptr<PreparedStatement>> _stmtCache;
 };
 
-#endif
\ No newline at end of file
+#endif
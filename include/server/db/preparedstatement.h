@@ -0,0 +1,73 @@
+#ifndef PREPAREDSTATEMENT_H
+#define PREPAREDSTATEMENT_H
+
+#include <mysql/mysql.h>
+#include <string>
+#include <vector>
+#include <type_traits>
+#include <memory>
+using namespace std;
+
+/*
+预处理语句
+SQL只在第一次使用时由MySQL解析，之后每次执行只传输参数；
+参数按类型二进制绑定，不再拼接SQL字符串，消息长度不受固定缓冲区限制；
+结果集按列类型绑定，整数列直接读出整数，不需要atoi
+*/
+class PreparedStatement
+{
+public:
+    explicit PreparedStatement(MYSQL *conn);
+    ~PreparedStatement();
+
+    // 解析SQL，参数使用?占位
+    bool prepare(const string &sql);
+    // 释放上一次执行的结果集，复用语句前调用
+    void reset();
+
+    // 参数绑定，idx从0开始；字符串和blob不做拷贝，execute之前必须保持有效
+    void bindInt(int idx, long long value);
+    void bindString(int idx, const string &value);
+    void bindBlob(int idx, const char *data, size_t len);
+
+    // 执行语句，查询语句的结果集会缓存到客户端
+    bool execute();
+    // 取下一行结果，没有更多行返回false
+    bool fetch();
+
+    // 读取当前行的列值，idx从0开始
+    long long getInt(int idx) const;
+    string getString(int idx) const;
+    bool isNull(int idx) const;
+
+    // insert语句生成的主键id
+    unsigned long long insertId();
+    // update/delete语句影响的行数
+    unsigned long long affectedRows();
+
+private:
+    // 不同版本客户端库中is_null的类型不同（bool/my_bool），这里按实际类型定义
+    using NullFlag = remove_pointer<decltype(MYSQL_BIND::is_null)>::type;
+
+    // 根据结果集的列类型分配缓冲区并绑定
+    bool bindResult();
+
+    MYSQL_STMT *_stmt;
+    string _sql;
+
+    // 参数绑定
+    vector<MYSQL_BIND> _params;
+    vector<long long> _paramInts;
+    vector<unsigned long> _paramLens;
+
+    // 结果绑定
+    vector<MYSQL_BIND> _results;
+    vector<bool> _resultIsInt;
+    vector<long long> _resultInts;
+    vector<vector<char>> _resultBufs;
+    vector<unsigned long> _resultLens;
+    // is_null可能是bool，不能用vector<bool>取元素地址
+    unique_ptr<NullFlag[]> _resultNulls;
+};
+
+#endif
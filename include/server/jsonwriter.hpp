@@ -0,0 +1,58 @@
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <muduo/net/Buffer.h>
+#include <string>
+#include <vector>
+using namespace std;
+using namespace muduo::net;
+
+/*
+流式json写入器，直接把json文本追加到muduo的Buffer中
+不构造json DOM，也没有中间字符串；逗号由写入器根据嵌套层次自动添加
+字符串按json规则转义，合法的UTF-8序列原样输出；非法的UTF-8序列(按最长合法前缀)替换为U+FFFD，
+和nlohmann::json::dump(-1, ' ', false, json::error_handler_t::replace)的输出一致。
+默认参数的dump()遇到非法UTF-8会抛异常，这里不抛异常，保证写出的总是合法的json
+调用方负责成对调用start/end，key只能出现在对象中
+*/
+class JsonWriter
+{
+public:
+    explicit JsonWriter(Buffer *buf);
+
+    JsonWriter &startObject();
+    JsonWriter &endObject();
+    JsonWriter &startArray();
+    JsonWriter &endArray();
+
+    // 对象中的键
+    JsonWriter &key(const char *name);
+
+    JsonWriter &value(long long v);
+    JsonWriter &value(int v) { return value(static_cast<long long>(v)); }
+    JsonWriter &value(bool v);
+    JsonWriter &value(const char *s, size_t len);
+    JsonWriter &value(const char *s);
+    JsonWriter &value(const string &s) { return value(s.data(), s.size()); }
+
+    // 键值对的简写
+    template <typename T>
+    JsonWriter &field(const char *name, const T &v)
+    {
+        key(name);
+        return value(v);
+    }
+
+private:
+    // 数组元素或对象的键之前按需写入逗号
+    void beforeValue();
+    void appendEscaped(const char *s, size_t len);
+
+    Buffer *_buf;
+    // 每层容器是否还没有写入过元素
+    vector<bool> _first;
+    // 刚写完键，下一个值不需要逗号
+    bool _afterKey;
+};
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef FRIENDCACHE_H
+#define FRIENDCACHE_H
+
+#include "shardedcache.hpp"
+#include <vector>
+#include <string>
+#include <memory>
+using namespace std;
+
+// 好友邻接表中的一项，只保存不变的信息，在线状态由在线状态服务实时查询
+struct FriendInfo
+{
+    int id;
+    string name;
+};
+using FriendListPtr = shared_ptr<const vector<FriendInfo>>;
+
+/*
+好友关系缓存，每个用户一份好友邻接表，分片LRU、修改序号和失效通知见ShardedCache
+1. 以shared_ptr<const>快照发布，登录时持有快照遍历，不需要加锁
+2. 添加好友时删除本节点的缓存，并通过失效回调通知其它节点，下次登录时重新加载
+*/
+class FriendCache : public ShardedCache<FriendListPtr>
+{
+public:
+    static FriendCache *instance();
+
+private:
+    FriendCache();
+};
+
+#endif
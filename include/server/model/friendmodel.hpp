@@ -2,6 +2,7 @@
 #define FRIENDMODEL_H
 
 #include "user.hpp"
+#include "friendcache.hpp"
 #include <vector>
 using namespace std;
 
@@ -14,6 +15,9 @@ public:
 
     // 返回用户好友列表
     vector<User> query(int userid);
+
+    // 返回用户好友邻接表的快照，先查好友缓存，不包含在线状态
+    FriendListPtr queryFriends(int userid);
 };
 
 #endif
\ No newline at end of file
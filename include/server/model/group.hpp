@@ -15,21 +15,25 @@ public:
         this->id = id;
         this->name = name;
         this->desc = desc;
+        this->membercount = 0;
     }
 
     void setId(int id) { this->id = id; }
     void setName(string name) { this->name = name; }
     void setDesc(string desc) { this->desc = desc; }
+    void setMemberCount(int count) { this->membercount = count; }
 
     int getId() { return this->id; }
     string getName() { return this->name; }
     string getDesc() { return this->desc; }
+    int getMemberCount() { return this->membercount; }
     vector<GroupUser> &getUsers() { return this->users; }
 
 private:
     int id;
     string name;
     string desc;
+    int membercount; // 只查询群组概要信息时有效，此时users为空
     vector<GroupUser> users;
 };
 
@@ -0,0 +1,48 @@
+#ifndef GROUPMEMBERCACHE_H
+#define GROUPMEMBERCACHE_H
+
+#include "shardedcache.hpp"
+#include <vector>
+#include <memory>
+#include <atomic>
+using namespace std;
+
+// 一个群组成员列表的不可变快照，成员id升序排列
+struct GroupMembers
+{
+    vector<int> ids;
+
+    bool contains(int userid) const;
+};
+using GroupMembersPtr = shared_ptr<const GroupMembers>;
+
+/*
+群组成员缓存，群聊扇出不再查询数据库，分片LRU、修改序号和失效通知见ShardedCache
+1. 每个群组缓存一份紧凑的有序成员数组，以shared_ptr<const>快照的形式发布，
+   扇出线程持有快照遍历，不需要加锁，也不受并发修改影响
+2. 加入群组时在本节点增量更新：复制数组、有序插入，再替换快照
+3. 其它节点通过失效回调删除各自的缓存，下次扇出时从数据库重新加载
+4. 快照从数据库加载超过60秒后视为未命中重新加载，丢失失效通知造成的不一致最多持续60秒
+*/
+class GroupMemberCache : public ShardedCache<GroupMembersPtr>
+{
+public:
+    static GroupMemberCache *instance();
+
+    using ShardedCache::put;
+    // 从数据库加载后排序去重放入缓存；加载期间该分片有过修改时只返回快照不缓存
+    GroupMembersPtr put(int groupid, vector<int> ids, unsigned long loadSeq);
+    // 新建群组，缓存一个空的成员列表
+    void create(int groupid);
+    // 群组增加成员，只更新已缓存的群组
+    void addMember(int groupid, int userid);
+
+    long getIncrementalUpdates() const { return _incrementalUpdates; }
+
+private:
+    GroupMemberCache();
+
+    atomic_long _incrementalUpdates{0};
+};
+
+#endif
@@ -2,6 +2,7 @@
 #define GROUPMODEL_H
 
 #include "group.hpp"
+#include "groupmembercache.hpp"
 #include <string>
 #include <vector>
 using namespace std;
@@ -14,10 +15,14 @@ public:
     bool createGroup(Group &group);
     // 加入群组
     void addGroup(int userid, int groupid, string role);
-    // 查询用户所在群组信息
+    // 查询用户所在群组信息，包含每个群组的成员
     vector<Group> queryGroups(int userid);
+    // 查询用户所在群组的概要信息，只包含成员数，不加载成员
+    vector<Group> queryGroupHeaders(int userid);
     // 根据指定的groupid查询群组用户id列表，除userid自己，主要用户群聊业务给群组其它成员群发消息
     vector<int> queryGroupUsers(int userid, int groupid);
+    // 查询群组成员id的快照（含所有成员），先查成员缓存，群聊扇出直接遍历快照
+    GroupMembersPtr queryGroupMembers(int groupid);
     // 根据 groupid 查詢群組所有成員（不含自己）
     std::vector<GroupUser> queryGroupUsers(int groupid);
 };
@@ -3,20 +3,35 @@
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <utility>
 using namespace std;
 
-// 提供离线消息表的操作接口方法
+// 一条待写入的离线消息，群消息的多个接收者共享同一份消息内容
+struct OfflineMsg
+{
+    int userid;
+    shared_ptr<const string> msg;
+};
+
+/*
+提供离线消息表的操作接口方法
+离线消息按自增主键id分页读取、按id范围删除，表结构见deploy/chat.sql，已有的表需要按其中的ALTER语句加上id列
+*/
 class OfflineMsgModel
 {
 public:
     // 存储用户的离线消息
-    void insert(int userid, string msg);
+    void insert(int userid, const string &msg);
+
+    // 批量存储离线消息，多行insert在同一个事务中提交，整批成功或整批失败
+    bool insert(const vector<OfflineMsg> &msgs);
 
-    // 删除用户的离线消息
-    void remove(int userid);
+    // 删除用户id不超过maxId的离线消息，只删除客户端已确认收到的部分
+    void remove(int userid, long long maxId);
 
-    // 查询用户的离线消息
-    vector<string> query(int userid);
+    // 按id顺序查询用户id大于afterId的离线消息，最多limit条，返回<id, 消息>
+    vector<pair<long long, string>> query(int userid, long long afterId, int limit);
 };
 
-#endif
\ No newline at end of file
+#endif
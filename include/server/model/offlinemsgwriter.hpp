@@ -0,0 +1,94 @@
+#ifndef OFFLINEMSGWRITER_H
+#define OFFLINEMSGWRITER_H
+
+#include "offlinemessagemodel.hpp"
+#include <deque>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+using namespace std;
+
+/*
+离线消息异步写入器
+1. append只把消息放入内存队列，I/O线程不再为每个接收者做一次数据库往返
+2. 后台线程按批量大小(_maxBatch)或时间窗口(_flushInterval)触发刷盘，
+   一批消息拆成多行insert，在同一个事务中提交(group commit)
+3. 只有一个刷盘线程，队列先进先出，同一用户的离线消息按append顺序写入
+4. 队列积压超过_maxPending时append阻塞等待，避免内存无限增长
+
+崩溃语义：
+- append返回时消息只在内存中，进程崩溃会丢失尚未提交的消息，
+  最多为队列中积压的消息加上正在提交的一批(at-most-once)
+- 每批消息在一个事务中提交，崩溃后要么整批可见，要么整批不可见
+- 提交失败会重试_maxRetry次，仍失败则丢弃该批并计入getDroppedCount()
+- 正常退出(ChatService::reset)时调用flush()，把队列中的消息全部写入
+*/
+class OfflineMsgWriter
+{
+public:
+    // 获取单例对象
+    static OfflineMsgWriter *instance();
+
+    // 异步存储一条离线消息
+    void append(int userid, const string &msg);
+    // 异步存储一条群离线消息，所有接收者共享同一份消息内容
+    void append(const vector<int> &useridVec, const string &msg);
+
+    // 等待调用前append的消息全部提交，超时返回false
+    bool flush(chrono::milliseconds timeout = chrono::milliseconds(1000));
+    // 只等待调用前append给userid的消息提交，该用户没有未提交的消息时立即返回，用于登录时读取离线消息之前
+    bool flushUser(int userid, chrono::milliseconds timeout = chrono::milliseconds(1000));
+
+    // 统计信息
+    size_t getPendingCount();
+    long getBatchCount() const { return _batchCnt; }       // 已提交的批次数
+    long getRowCount() const { return _rowCnt; }           // 已提交的消息数
+    long getMaxBatchSize() const { return _maxBatchSize; } // 最大批次消息数
+    long getLastFlushUs() const { return _lastFlushUs; }   // 最近一批的提交耗时(微秒)
+    long getMaxFlushUs() const { return _maxFlushUs; }     // 最大提交耗时(微秒)
+    long getTotalFlushUs() const { return _totalFlushUs; } // 提交总耗时(微秒)，除以批次数即平均耗时
+    long getDroppedCount() const { return _droppedCnt; }   // 重试后仍失败而丢弃的消息数
+
+private:
+    OfflineMsgWriter();
+    OfflineMsgWriter(const OfflineMsgWriter &) = delete;
+    OfflineMsgWriter &operator=(const OfflineMsgWriter &) = delete;
+
+    // 入队，调用时持有_mutex
+    void enqueue(unique_lock<mutex> &lock, size_t count);
+    // 等待序号target之前的消息全部处理，调用时持有_mutex
+    bool waitDone(unique_lock<mutex> &lock, unsigned long target, chrono::milliseconds timeout);
+    // 后台刷盘线程
+    void flushTask();
+    // 提交一批消息并记录统计信息
+    void commitBatch(const vector<OfflineMsg> &batch);
+
+    size_t _maxBatch;                   // 一批最多的消息数
+    size_t _maxPending;                 // 队列允许积压的最大消息数
+    chrono::milliseconds _flushInterval; // 第一条消息入队后最多等待的时间窗口
+    int _maxRetry;                      // 提交失败的重试次数
+
+    OfflineMsgModel _offlineMsgModel;
+
+    deque<OfflineMsg> _queue;     // 待写入的消息
+    mutex _mutex;                 // 保证_queue和序号的线程安全
+    condition_variable _cv;       // 唤醒刷盘线程
+    condition_variable _notFull;  // 队列积压时阻塞append
+    condition_variable _flushed;  // 批次提交后唤醒flush
+    unsigned long _appendSeq = 0; // 已入队的消息总数
+    unsigned long _doneSeq = 0;   // 已处理(提交或丢弃)的消息总数
+    unsigned long _urgentSeq = 0; // flush等待的序号，刷盘线程不再等待时间窗口
+    unordered_map<int, unsigned long> _userSeq; // 有未提交消息的用户 => 该用户最后一条消息的序号
+
+    atomic_long _batchCnt{0};
+    atomic_long _rowCnt{0};
+    atomic_long _maxBatchSize{0};
+    atomic_long _lastFlushUs{0};
+    atomic_long _maxFlushUs{0};
+    atomic_long _totalFlushUs{0};
+    atomic_long _droppedCnt{0};
+};
+
+#endif
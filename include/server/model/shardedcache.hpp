@@ -0,0 +1,259 @@
+#ifndef SHARDEDCACHE_H
+#define SHARDEDCACHE_H
+
+#include <unordered_map>
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+using namespace std;
+
+// 值在堆上额外占用的内存，默认不计
+template <typename V>
+struct CacheValueBytes
+{
+    size_t operator()(const V &) const { return 0; }
+};
+
+/*
+按int key分片的进程内缓存，带修改序号和跨节点失效通知，UserCache/FriendCache/GroupMemberCache共用
+1. 每个分片一把锁和一条LRU链表，分片容量用满后淘汰最久未访问的项
+2. 每个分片有修改序号，写穿和删除时加1；未命中时get返回查库前的序号，
+   put回填时序号变了说明加载期间有修改或失效，加载的结果只用于本次查询，不缓存
+3. ttl不为0时，项写入超过ttl后视为未命中；失效通知走pub/sub可能丢失，ttl限制了丢失通知造成的不一致时长
+4. 本节点修改数据后调用notifyInvalidate，由业务层设置的失效回调广播给其它节点，
+   其它节点收到后调用erase，key为ALL时清空整个缓存
+*/
+template <typename V, typename Bytes = CacheValueBytes<V>>
+class ShardedCache
+{
+public:
+    // 失效通知中表示全部缓存项的key
+    static const int ALL = -1;
+
+    explicit ShardedCache(size_t capacity, chrono::seconds ttl = chrono::seconds(0))
+        : _shardCapacity(capacity / SHARD_NUM + 1), _ttl(ttl)
+    {
+    }
+
+    // 查询缓存，命中返回true；未命中时通过loadSeq返回加载数据库前的修改序号
+    bool get(int key, V &value, unsigned long *loadSeq = nullptr)
+    {
+        Shard &shard = shardOf(key);
+        {
+            lock_guard<mutex> lock(shard.mtx);
+            auto it = shard.index.find(key);
+            if (it != shard.index.end())
+            {
+                if (!expired(*it->second))
+                {
+                    // 移动到链表头部
+                    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+                    value = it->second->value;
+                    ++_hits;
+                    return true;
+                }
+                removeLocked(shard, it);
+                ++_expired;
+            }
+            if (loadSeq != nullptr)
+            {
+                *loadSeq = shard.modifySeq;
+            }
+        }
+        ++_misses;
+        return false;
+    }
+
+    // 从数据库加载后回填，返回本次查询应使用的值：
+    // 其它线程已经回填或写穿过时以缓存中的为准；加载期间该分片有过修改时不缓存
+    V put(int key, V value, unsigned long loadSeq)
+    {
+        Shard &shard = shardOf(key);
+        lock_guard<mutex> lock(shard.mtx);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end())
+        {
+            return it->second->value;
+        }
+        if (loadSeq == shard.modifySeq)
+        {
+            storeLocked(shard, key, value);
+        }
+        return value;
+    }
+
+    // 写穿：本节点修改数据后直接放入或替换缓存
+    void put(int key, V value)
+    {
+        Shard &shard = shardOf(key);
+        lock_guard<mutex> lock(shard.mtx);
+        ++shard.modifySeq;
+        storeLocked(shard, key, std::move(value));
+    }
+
+    // 只修改已缓存的项，fn(V &)返回false表示没有修改；不重置写入时间，ttl仍从加载时算起
+    template <typename Fn>
+    bool update(int key, Fn fn)
+    {
+        Shard &shard = shardOf(key);
+        lock_guard<mutex> lock(shard.mtx);
+        ++shard.modifySeq;
+        auto it = shard.index.find(key);
+        if (it == shard.index.end())
+        {
+            return false;
+        }
+        shard.bytes -= _bytes(it->second->value);
+        bool changed = fn(it->second->value);
+        shard.bytes += _bytes(it->second->value);
+        return changed;
+    }
+
+    // 删除缓存，收到其它节点的失效通知时调用，key为ALL时清空
+    void erase(int key)
+    {
+        if (key == ALL)
+        {
+            clear();
+            return;
+        }
+        Shard &shard = shardOf(key);
+        lock_guard<mutex> lock(shard.mtx);
+        ++shard.modifySeq;
+        auto it = shard.index.find(key);
+        if (it != shard.index.end())
+        {
+            removeLocked(shard, it);
+        }
+    }
+
+    // 清空缓存
+    void clear()
+    {
+        for (Shard &shard : _shards)
+        {
+            lock_guard<mutex> lock(shard.mtx);
+            ++shard.modifySeq;
+            shard.lru.clear();
+            shard.index.clear();
+            shard.bytes = 0;
+        }
+    }
+
+    // 设置失效回调，本节点修改数据后调用，由业务层广播给其它节点
+    void setInvalidateNotifier(function<void(int)> notifier) { _notifier = notifier; }
+    // 通知其它节点删除缓存
+    void notifyInvalidate(int key)
+    {
+        if (_notifier)
+        {
+            _notifier(key);
+        }
+    }
+
+    // 统计信息
+    long getHits() const { return _hits; }
+    long getMisses() const { return _misses; }
+    long getEvictions() const { return _evictions; }
+    long getExpired() const { return _expired; }
+    size_t size() const
+    {
+        size_t total = 0;
+        for (const Shard &shard : _shards)
+        {
+            lock_guard<mutex> lock(shard.mtx);
+            total += shard.lru.size();
+        }
+        return total;
+    }
+    // 缓存占用的内存估算，包括容器节点和Bytes计算的值在堆上的内存
+    size_t memoryBytes() const
+    {
+        size_t total = 0;
+        for (const Shard &shard : _shards)
+        {
+            lock_guard<mutex> lock(shard.mtx);
+            total += shard.lru.size() * NODE_BYTES + shard.bytes;
+        }
+        return total;
+    }
+
+private:
+    static const int SHARD_NUM = 16;
+
+    struct Entry
+    {
+        int key;
+        V value;
+        chrono::steady_clock::time_point storedAt; // 写入时间，update时不变
+    };
+    using EntryIter = typename list<Entry>::iterator;
+
+    // 每项的链表节点和哈希节点
+    static const size_t NODE_BYTES = sizeof(Entry) + sizeof(pair<const int, EntryIter>) + 4 * sizeof(void *);
+
+    struct alignas(64) Shard
+    {
+        mutable mutex mtx;
+        // 链表头部是最近访问的项
+        list<Entry> lru;
+        unordered_map<int, EntryIter> index;
+        size_t bytes = 0;            // 值在堆上额外占用的内存
+        unsigned long modifySeq = 0; // 每次写穿、修改或删除加1
+    };
+
+    Shard &shardOf(int key) { return _shards[static_cast<unsigned>(key) % SHARD_NUM]; }
+
+    bool expired(const Entry &entry) const
+    {
+        return _ttl.count() > 0 && chrono::steady_clock::now() - entry.storedAt >= _ttl;
+    }
+
+    // 在持有分片锁时放入或替换缓存，分片满时淘汰最久未访问的项
+    void storeLocked(Shard &shard, int key, V value)
+    {
+        auto it = shard.index.find(key);
+        if (it != shard.index.end())
+        {
+            shard.bytes -= _bytes(it->second->value);
+            it->second->value = std::move(value);
+            it->second->storedAt = chrono::steady_clock::now();
+            shard.bytes += _bytes(it->second->value);
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            return;
+        }
+
+        shard.lru.push_front(Entry{key, std::move(value), chrono::steady_clock::now()});
+        shard.index[key] = shard.lru.begin();
+        shard.bytes += _bytes(shard.lru.front().value);
+
+        if (shard.lru.size() > _shardCapacity)
+        {
+            removeLocked(shard, shard.index.find(shard.lru.back().key));
+            ++_evictions;
+        }
+    }
+
+    // 在持有分片锁时删除一项
+    void removeLocked(Shard &shard, typename unordered_map<int, EntryIter>::iterator it)
+    {
+        shard.bytes -= _bytes(it->second->value);
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+    }
+
+    size_t _shardCapacity;
+    chrono::seconds _ttl; // 0表示不过期
+    Shard _shards[SHARD_NUM];
+    Bytes _bytes;
+    function<void(int)> _notifier;
+
+    atomic_long _hits{0};
+    atomic_long _misses{0};
+    atomic_long _evictions{0};
+    atomic_long _expired{0};
+};
+
+#endif
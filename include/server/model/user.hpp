@@ -30,7 +30,7 @@ protected:
     int id;
     string name;
     string password;
-    string state;
+    string state; // 已废弃：在线状态以PresenceService为准，MySQL的state字段不再作为在线依据
 };
 
 #endif
\ No newline at end of file
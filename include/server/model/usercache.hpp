@@ -0,0 +1,32 @@
+#ifndef USERCACHE_H
+#define USERCACHE_H
+
+#include "user.hpp"
+#include "shardedcache.hpp"
+using namespace std;
+
+// 用户信息在堆上占用的内存：字符串内容
+struct UserBytes
+{
+    size_t operator()(const User &user) const
+    {
+        return user.getName().capacity() + user.getPwd().capacity() + user.getState().capacity();
+    }
+};
+
+/*
+进程内的用户信息缓存，位于UserModel::query前面，分片LRU、修改序号和失效通知见ShardedCache
+1. UserModel::insert写穿缓存；UserModel::clearAll清空本节点缓存，并通过失效回调(key为ALL)通知其它节点清空
+   用户信息注册后不再修改(在线状态不在user表中维护)，没有其它需要跨节点失效的写入
+2. 只缓存查到的用户，不存在的id不缓存
+*/
+class UserCache : public ShardedCache<User, UserBytes>
+{
+public:
+    static UserCache *instance();
+
+private:
+    UserCache();
+};
+
+#endif
@@ -2,6 +2,7 @@
 #define USERMODEL_H
 
 #include "user.hpp"
+#include <vector>
 
 // User表的数据操作类
 class UserModel {
@@ -12,9 +13,6 @@ public:
     // 根据用户号码查询用户信息
     User query(int id);
 
-    // 更新用户的状态信息
-    bool updateState(User user);
-
     // 重置用户的状态信息
     void resetState();
 
@@ -0,0 +1,73 @@
+#ifndef ONLINEREGISTRY_H
+#define ONLINEREGISTRY_H
+
+#include <muduo/net/TcpConnection.h>
+#include <unordered_map>
+#include <shared_mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+using namespace std;
+using namespace muduo;
+using namespace muduo::net;
+
+// 连接在业务线程池中的积压情况，I/O线程和业务线程共用
+struct ConnFlow
+{
+    atomic<int> pending{0};      // 已提交尚未执行完的任务数
+    atomic<int> resumeAt{0};     // 暂停读取后，积压降到这个值时恢复读取
+    atomic<bool> paused{false};  // 是否已经停止读取该连接
+};
+
+// 连接上下文，保存在TcpConnection的context中
+struct ConnContext
+{
+    int userid = -1;     // 登录成功后记录，连接断开时用于O(1)反查用户
+    bool binary = false; // 登录时协商，聊天消息是否使用二进制格式下发
+    size_t dispatchKey = 0; // 连接建立时分配，决定该连接的消息由业务线程池中的哪个线程串行处理
+    shared_ptr<ConnFlow> flow; // 连接建立时创建，用于对单个连接施加背压
+};
+
+/*
+本机在线用户的连接表
+按userid分片，每个分片一把读写锁，聊天转发等查询操作只加读锁，
+多个I/O线程之间互不阻塞；登录、注销只锁住userid所在的分片
+*/
+class OnlineRegistry
+{
+public:
+    // 登记用户连接，并把userid记录到连接上下文中
+    void add(int userid, const TcpConnectionPtr &conn);
+
+    // 按userid注销，返回是否存在
+    bool remove(int userid);
+
+    // 按连接注销，返回连接对应的userid；连接没有登录或已经注销返回-1
+    int remove(const TcpConnectionPtr &conn);
+
+    // 查找用户连接，不在本机返回nullptr
+    TcpConnectionPtr find(int userid) const;
+
+    // 本机在线用户数
+    size_t size() const;
+
+    // 本机所有在线用户的id
+    vector<int> userids() const;
+
+private:
+    static const int SHARD_NUM = 64;
+
+    // 每个分片独占缓存行，避免不同分片的锁之间伪共享
+    struct alignas(64) Shard
+    {
+        mutable shared_mutex mutex;
+        unordered_map<int, TcpConnectionPtr> conns;
+    };
+
+    Shard &shardOf(int userid) { return _shards[static_cast<unsigned>(userid) % SHARD_NUM]; }
+    const Shard &shardOf(int userid) const { return _shards[static_cast<unsigned>(userid) % SHARD_NUM]; }
+
+    Shard _shards[SHARD_NUM];
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef PRESENCESERVICE_H
+#define PRESENCESERVICE_H
+
+#include "redis.hpp"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+using namespace std;
+
+/*
+在线状态服务，回答"用户在哪个节点在线"，替代查询MySQL的state字段
+1. redis中的在线位置表chat:presence记录userid=>节点id
+2. 每个节点定期刷新带TTL的心跳key，节点崩溃后心跳过期，指向它的在线记录视为不在线
+3. 本地近端缓存：热路径先查内存，未命中的用户一次HMGET批量查询；
+   用户上下线时在失效通道上广播userid，各节点收到后删除本地缓存，缓存本身也有TTL兜底
+*/
+class PresenceService
+{
+public:
+    explicit PresenceService(Redis &redis);
+    ~PresenceService();
+
+    // 设置本节点id并启动心跳线程
+    void start(const string &nodeId);
+    // 停止心跳线程并等待其退出，之后本节点的心跳key在TTL后过期
+    void stop();
+
+    // 用户在本节点上线/下线
+    void online(int userid);
+    void offline(int userid);
+
+    // 批量查询用户所在的节点，不在线返回空串
+    vector<string> locate(const vector<int> &userids);
+    string locate(int userid);
+
+    // 收到失效通道上的消息，删除本地缓存
+    void invalidate(int userid);
+
+    // redis重连后重新登记本节点的心跳和在线用户，并清空本地缓存（断开期间的失效通知已经丢失）
+    void replay(const vector<int> &localUserids);
+
+    // 失效通知的通道名
+    static const string &invalidateChannel();
+
+    // 统计信息
+    long getCacheHits() const { return _cacheHits; }
+    long getCacheMisses() const { return _cacheMisses; }
+
+private:
+    struct CacheEntry
+    {
+        string node;
+        chrono::steady_clock::time_point expire;
+    };
+
+    // 心跳线程
+    void heartbeatTask();
+    // 清理过期的缓存项，由心跳线程每个周期调用一次
+    void pruneCache();
+    // 过滤掉心跳已过期的节点
+    void filterDeadNodes(vector<string> &nodes);
+
+    Redis &_redis;
+    string _nodeId;
+    chrono::seconds _cacheTtl;     // 近端缓存的有效期
+    chrono::seconds _heartbeat;    // 心跳间隔
+    int _nodeTtl;                  // 节点心跳key的过期时间(秒)
+
+    thread _heartbeatThread;
+    mutex _stopMutex;
+    condition_variable _stopCond; // 心跳线程在上面等待下一个周期，stop时立即唤醒
+    bool _stopping = false;
+
+    mutex _mutex;
+    unordered_map<int, CacheEntry> _cache;  // userid => 所在节点，空串表示不在线
+    unordered_map<string, chrono::steady_clock::time_point> _aliveNodes; // 节点存活的本地缓存
+    unsigned long _invalidateSeq = 0; // 每次失效加1，批量查询期间发生失效则不回填缓存
+
+    atomic_long _cacheHits{0};
+    atomic_long _cacheMisses{0};
+};
+
+#endif
@@ -3,46 +3,134 @@
 
 #include <hiredis/hiredis.h>
 #include <thread>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <unordered_set>
 #include <functional>
+#include "redispublisher.hpp"
+#include "redisstreamconsumer.hpp"
 using namespace std;
 
 /*
 redis作为集群服务器通信的基于发布-订阅消息队列时，会遇到两个难搞的bug问题，参考我的博客详细描述：
 https://blog.csdn.net/QIANGWEIYUAN/article/details/97895611
+
+集群路由：每个ChatServer节点只订阅一个节点通道，用户所在的节点记录在redis的在线位置表中，
+发送方按目标节点合并接收者，每个节点只publish一次
+
+订阅线程每次把已经读入缓冲区的所有消息作为一批上报，可以通过stopSubscriber/startSubscriber停止和重启
+
+断线重连：订阅连接断开后订阅线程退避重连，重新订阅所有通道并回调业务层重新登记本节点的在线用户；
+在线位置表的连接在下次使用时重连；发布器断开期间消息留在有界队列中，重连后补发
+
+节点间消息也可以改走stream（见RedisStreamConsumer），至少一次投递，两种方式上报给业务层的批次格式相同
 */
+
 class Redis
 {
 public:
     Redis();
     ~Redis();
 
-    // 连接redis服务器 
-    bool connect();
+    // 连接redis服务器
+    bool connect(const char *ip = "127.0.0.1", int port = 6379);
+
+    // 启动订阅线程，重新订阅之前订阅过的所有通道
+    bool startSubscriber();
+    // 停止订阅线程并等待其退出
+    void stopSubscriber();
 
-    // 向redis指定的通道channel发布消息
-    bool publish(int channel, string message);
+    // 向redis指定的通道channel发布消息，异步流水线发送
+    bool publish(const string &channel, const string &message);
+    bool publish(const string &channel, const shared_ptr<const string> &message);
+
+    // 追加消息到stream，异步流水线发送
+    bool appendStream(const string &stream, const shared_ptr<const string> &message);
+    // 启动stream消费线程，收到的消息通过stream回调（没有设置时用notify回调）上报
+    bool startStreamConsumer(const string &stream, const string &group, const string &consumer);
+    // 停止stream消费线程
+    void stopStreamConsumer();
+    // stream消费者，用于查询消费统计，没有启动时为nullptr
+    const RedisStreamConsumer *getStreamConsumer() const { return _streamConsumer.get(); }
 
     // 向redis指定的通道subscribe订阅消息
-    bool subscribe(int channel);
+    bool subscribe(const string &channel);
 
     // 向redis指定的通道unsubscribe取消订阅消息
-    bool unsubscribe(int channel);
+    bool unsubscribe(const string &channel);
+
+    // 在线位置表：记录用户登录在哪个节点
+    bool setPresence(int userid, const string &node);
+    // 删除用户的在线位置，只有记录仍指向node时才删除，避免误删用户在其它节点的新登录
+    bool clearPresence(int userid, const string &node);
+    // 批量查询用户所在的节点，一次往返，不在线的用户返回空串
+    vector<string> getPresence(const vector<int> &userids);
+    // 刷新节点心跳，ttl秒内没有再次刷新则认为节点已经下线
+    bool setNodeAlive(const string &node, int ttl);
+    // 批量查询节点心跳是否有效
+    vector<bool> nodesAlive(const vector<string> &nodes);
 
     // 在独立线程中接收订阅通道中的消息
-    void observer_channel_message();
+    void observer_channel_message(redisContext *context);
 
-    // 初始化向业务层上报通道消息的回调对象
-    void init_notify_handler(function<void(int, string)> fn);
+    // 初始化向业务层上报通道消息的回调对象，每次上报一批消息
+    void init_notify_handler(function<void(const RedisMessageBatch &)> fn);
+    // 初始化上报stream消息的回调对象，返回true后整批XACK；不设置时使用notify回调，返回即确认
+    void init_stream_handler(RedisStreamConsumer::Handler fn);
+    // 初始化订阅连接重连成功后的回调对象，在订阅线程上调用
+    void init_reconnect_handler(function<void()> fn);
+
+    // 订阅连接的重连次数，以及最近一次从断开到重新订阅完成的毫秒数
+    long getReconnectCount() const { return _reconnectCnt; }
+    long getLastRecoveryMs() const { return _lastRecoveryMs; }
+
+    // 发布器，用于查询发布统计
+    const RedisPublisher &getPublisher() const { return _publisher; }
 
 private:
-    // hiredis同步上下文对象，负责publish消息
-    redisContext *_publish_context;
+    // 发送订阅相关命令，不等待响应
+    bool sendSubscribeCommand(const char *cmd, const string &channel);
+    // 订阅线程：接收通道消息，连接断开后重连
+    void subscribeTask();
+    // 退避重连订阅连接并重新订阅所有通道，stopSubscriber时返回nullptr
+    redisContext *reconnectSubscriber();
+    // 在线位置表的连接断开时重连，调用时持有_presenceMutex
+    bool ensurePresenceContext();
+
+    // redis服务器地址
+    string _ip;
+    int _port;
+
+    // 异步流水线发布器，负责publish消息
+    RedisPublisher _publisher;
 
     // hiredis同步上下文对象，负责subscribe消息
     redisContext *_subcribe_context;
+    // 已订阅的通道，重启订阅线程时重新订阅
+    unordered_set<string> _channels;
+    // 保护_subcribe_context和_channels
+    mutex _subscribeMutex;
+    // 订阅线程
+    thread _subscribeThread;
+    atomic_bool _subscribeRunning{false};
+
+    // stream消费者
+    unique_ptr<RedisStreamConsumer> _streamConsumer;
+
+    // hiredis同步上下文对象，负责在线位置表的读写，多个业务线程共用，需要加锁
+    redisContext *_presence_context;
+    mutex _presenceMutex;
 
     // 回调操作，收到订阅的消息，给service层上报
-    function<void(int, string)> _notify_message_handler;
+    function<void(const RedisMessageBatch &)> _notify_message_handler;
+    // 回调操作，收到stream消息，投递完成后返回true
+    RedisStreamConsumer::Handler _stream_handler;
+    // 回调操作，订阅连接重连成功
+    function<void()> _reconnect_handler;
+
+    atomic_long _reconnectCnt{0};
+    atomic_long _lastRecoveryMs{0};
 };
 
 #endif
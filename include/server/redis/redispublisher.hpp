@@ -0,0 +1,97 @@
+#ifndef REDISPUBLISHER_H
+#define REDISPUBLISHER_H
+
+#include <hiredis/hiredis.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+using namespace std;
+
+/*
+异步流水线的redis发布器
+1. publish只把消息放入发送队列，业务线程不再同步等待redis的响应
+2. 维护一个小的hiredis连接池，每个连接由一个发送线程独占，hiredis上下文不再被多个线程并发使用
+3. 发送线程每轮取出队列中所有积压的PUBLISH，先全部redisAppendCommand写入输出缓冲区，
+   再依次读取响应，一批命令只有一次网络往返
+4. 按channel哈希选择连接，同一channel的消息按publish顺序发送
+5. 使用%b格式，消息内容二进制安全
+6. 连接断开时，未发送成功的消息放回队列头部等待重连后重发；断开期间发布不阻塞业务线程，
+   队列超过上限时丢弃最早的消息
+7. append以XADD写入stream，和PUBLISH共用连接和批次，stream按MAXLEN ~近似裁剪保留最近的消息
+8. 析构时通知发送线程退出并等待：已入队的消息尽量发送一次，连接断开时直接丢弃，不再重连
+*/
+class RedisPublisher
+{
+public:
+    RedisPublisher(int connNum = 2, size_t maxPending = 100000);
+    ~RedisPublisher();
+
+    // 建立连接池并启动发送线程
+    bool connect(const char *ip = "127.0.0.1", int port = 6379);
+
+    // 异步发布消息，返回false表示发布器未连接或正在停止
+    bool publish(const string &channel, const char *data, size_t len);
+    // 异步发布共享的消息内容，不重复拷贝
+    bool publish(const string &channel, const shared_ptr<const string> &message);
+    // 异步追加消息到stream，消息保存在字段m中
+    bool append(const string &stream, const shared_ptr<const string> &message);
+
+    // 统计信息
+    long getPublishCount() const { return _publishCnt; } // 已发送成功的消息数
+    long getBatchCount() const { return _batchCnt; }     // 已发送的批次数
+    long getMaxBatchSize() const { return _maxBatchSize; } // 最大批次消息数
+    long getFailedCount() const { return _failedCnt; }   // 断开期间队列溢出丢弃的消息数
+    long getReconnectCount() const { return _reconnectCnt; } // 重连次数
+    long getLastRecoveryMs() const { return _lastRecoveryMs; } // 最近一次从断开到重连成功的毫秒数
+
+private:
+    struct PendingMsg
+    {
+        string channel;
+        shared_ptr<const string> message;
+        bool stream; // true表示XADD到名为channel的stream
+    };
+
+    // 放入channel对应连接的发送队列
+    bool enqueue(const string &channel, const shared_ptr<const string> &message, bool stream);
+
+    // 一个redis连接和它的发送队列
+    struct Sender
+    {
+        redisContext *context = nullptr;
+        deque<PendingMsg> queue; // 断开期间队满时从头部丢弃，deque头部删除是O(1)
+        mutex mtx;
+        condition_variable notEmpty;
+        condition_variable notFull;
+        bool down = false; // 连接断开，等待重连
+        thread worker;     // 独占该连接的发送线程
+    };
+
+    // 发送线程
+    void sendTask(Sender *sender);
+    // 流水线发送一批消息，返回已经确认发送成功的条数
+    size_t sendBatch(Sender *sender, const deque<PendingMsg> &batch);
+    // 连接断开后重连，停止时返回false
+    bool reconnect(Sender *sender);
+
+    int _connNum;
+    size_t _maxPending;
+    string _ip;
+    int _port;
+    vector<unique_ptr<Sender>> _senders;
+    atomic_bool _stopping{false};
+
+    atomic_long _publishCnt{0};
+    atomic_long _batchCnt{0};
+    atomic_long _maxBatchSize{0};
+    atomic_long _failedCnt{0};
+    atomic_long _reconnectCnt{0};
+    atomic_long _lastRecoveryMs{0};
+};
+
+#endif
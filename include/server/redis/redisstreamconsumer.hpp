@@ -0,0 +1,76 @@
+#ifndef REDISSTREAMCONSUMER_H
+#define REDISSTREAMCONSUMER_H
+
+#include <hiredis/hiredis.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <functional>
+using namespace std;
+
+// 一批订阅消息，<通道名, 消息内容>
+using RedisMessageBatch = vector<pair<string, string>>;
+
+/*
+redis stream消费者，节点间消息的至少一次投递
+1. 每个节点一个stream，发送方XADD，本节点以固定的消费者名加入消费组XREADGROUP批量读取
+2. 一批消息交给业务层回调，回调在消息已经交给连接发送（或放入离线写入器）后返回true，之后再一次XACK整批确认；
+   返回false时整批不确认，稍后从pending列表重新投递
+3. 启动和重连后先读取本消费者尚未确认的消息（pending列表，id为0），再读取新消息，
+   进程崩溃或redis断开期间读到但没有确认的消息会被重新投递，业务层需要容忍重复
+4. 消费组从stream的开头（id 0）创建：redis无持久化重启后，发布器补发的XADD可能先于消费者重连重建stream，
+   从$创建会跳过这些消息；XREADGROUP返回NOGROUP（stream被删除或redis重启）时同样从0重建消费组
+5. stream由发送方按MAXLEN ~近似裁剪，节点长时间不在线超出保留长度的消息会丢失
+*/
+class RedisStreamConsumer
+{
+public:
+    // 返回true表示整批已经投递，可以确认
+    using Handler = function<bool(const RedisMessageBatch &)>;
+
+    RedisStreamConsumer(const string &stream, const string &group, const string &consumer);
+    ~RedisStreamConsumer();
+
+    // 启动消费线程
+    bool start(const char *ip, int port, Handler handler);
+    // 停止消费线程并等待其退出，最多等待一次阻塞读的超时时间
+    void stop();
+
+    // 统计信息
+    long getReadCount() const { return _readCnt; }         // 读取的消息数
+    long getBatchCount() const { return _batchCnt; }       // 读取的批次数
+    long getAckCount() const { return _ackCnt; }           // 确认的消息数
+    long getRedeliverCount() const { return _redeliverCnt; } // 从pending列表重新投递的消息数
+
+private:
+    // 消费线程
+    void consumeTask();
+    // 建立连接并创建消费组
+    bool connectAndCreateGroup();
+    // 从stream开头创建消费组，已经存在时忽略
+    bool createGroup();
+    // 读取一批消息，pending为true时读取本消费者未确认的消息，返回读到的条数，-1表示连接出错
+    // 消费组不存在时重建消费组，返回0
+    int readBatch(bool pending, RedisMessageBatch &batch, vector<string> &ids);
+    // 确认一批消息
+    bool ack(const vector<string> &ids);
+
+    string _stream;
+    string _group;
+    string _consumer;
+    string _ip;
+    int _port;
+    Handler _handler;
+
+    redisContext *_context;
+    thread _thread;
+    atomic_bool _running{false};
+
+    atomic_long _readCnt{0};
+    atomic_long _batchCnt{0};
+    atomic_long _ackCnt{0};
+    atomic_long _redeliverCnt{0};
+};
+
+#endif
@@ -4,6 +4,8 @@
 #include <crow.h>
 #include <crow/websocket.h>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include <mutex>
 #include <memory>
 #include "chatservice.hpp"
@@ -27,6 +29,8 @@ public:
     void handleGetFriends(const crow::request& req, crow::response& res);
     void handleAddFriend(const crow::request& req, crow::response& res);
     void handleDebugUsers(const crow::request& req, crow::response& res);
+    // 緩存、在線狀態、群聊扇出和業務線程池的統計
+    void handleDebugStats(const crow::request& req, crow::response& res);
     void handleDebugClear(const crow::request& req, crow::response& res);
     
     // WebSocket處理函數
@@ -53,6 +57,9 @@ private:
     // JWT密鑰
     const std::string JWT_SECRET = "your-secret-key-cpp";
     
+    // 查詢用户的在線狀態，返回在線的userid；MySQL的state字段已廢棄，不再讀寫
+    std::unordered_set<int> queryStatus(const std::vector<User>& users);
+    
     // 路由設置
     void setupRoutes();
     
@@ -0,0 +1,68 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <functional>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+using namespace std;
+
+/*
+业务线程池，承接会阻塞在MySQL/redis上的消息处理，I/O线程只负责收发和切帧
+1. 每个工作线程有自己的任务队列，任务按key(连接)取模分配到固定的线程，
+   同一连接上的消息按到达顺序串行执行，不同连接之间并行
+2. submit从不阻塞调用方（通常是I/O线程），队列积压达到_maxQueueSize时返回false，
+   由调用方对产生任务的那个连接停止读取（见ChatServer::dispatch），其它连接不受影响
+3. 处理结果通过TcpConnection所属EventLoop的runInLoop/queueInLoop发送，见ChatCodec::send
+*/
+class WorkerPool
+{
+public:
+    using Task = function<void()>;
+
+    WorkerPool(int threadNum = 8, size_t maxQueueSize = 10000);
+
+    // 启动工作线程
+    void start();
+    // 提交任务，key相同的任务按提交顺序串行执行
+    // 任务总会入队；返回false表示该队列已达到上限，调用方应当对任务来源施加背压
+    bool submit(size_t key, Task task);
+
+    // 统计信息
+    size_t getQueueSize();                             // 当前所有队列中等待执行的任务数
+    long getTaskCount() const { return _taskCnt; }      // 已执行的任务数
+    long getTotalWaitUs() const { return _totalWaitUs; } // 任务从提交到开始执行的等待总时长(微秒)
+    long getMaxWaitUs() const { return _maxWaitUs; }     // 最大等待时长(微秒)
+
+private:
+    struct PendingTask
+    {
+        Task task;
+        chrono::steady_clock::time_point enqueueTime;
+    };
+
+    // 单个工作线程的任务队列
+    struct Worker
+    {
+        deque<PendingTask> queue;
+        mutex mtx;
+        condition_variable notEmpty;
+    };
+
+    // 工作线程
+    void runInThread(Worker *worker);
+
+    int _threadNum;
+    size_t _maxQueueSize;
+    vector<unique_ptr<Worker>> _workers;
+
+    atomic_long _taskCnt{0};
+    atomic_long _totalWaitUs{0};
+    atomic_long _maxWaitUs{0};
+};
+
+#endif
@@ -11,7 +11,17 @@ CircuitBreaker::CircuitBreaker(int failureThreshold,
     , failureCount_(0)
     , successCount_(0)
     , lastFailureTime_(std::chrono::steady_clock::now())
-    , lastRetryTime_(std::chrono::steady_clock::now()) {
+    , lastRetryTime_(std::chrono::steady_clock::now())
+    , lastFailureWallTime_(std::chrono::system_clock::now())
+    , lastSuccessWallTime_(std::chrono::system_clock::now()) {
+}
+
+CircuitBreaker::CircuitBreaker(int failureThreshold, 
+                               int successThreshold,
+                               std::chrono::milliseconds timeout,
+                               std::chrono::milliseconds retryTimeout)
+    : CircuitBreaker(failureThreshold, timeout, retryTimeout) {
+    (void)successThreshold;
 }
 
 bool CircuitBreaker::canExecute() {
@@ -53,6 +63,7 @@ void CircuitBreaker::recordSuccess() {
     }
     
     successCount_++;
+    lastSuccessWallTime_ = std::chrono::system_clock::now();
 }
 
 void CircuitBreaker::recordFailure() {
@@ -60,6 +71,7 @@ void CircuitBreaker::recordFailure() {
     
     failureCount_++;
     lastFailureTime_ = std::chrono::steady_clock::now();
+    lastFailureWallTime_ = std::chrono::system_clock::now();
     
     if (failureCount_ >= failureThreshold_) {
         state_ = CircuitState::OPEN;
@@ -78,6 +90,16 @@ int CircuitBreaker::getSuccessCount() const {
     return successCount_.load();
 }
 
+std::chrono::system_clock::time_point CircuitBreaker::getLastFailureTime() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lastFailureWallTime_;
+}
+
+std::chrono::system_clock::time_point CircuitBreaker::getLastSuccessTime() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lastSuccessWallTime_;
+}
+
 void CircuitBreaker::reset() {
     std::lock_guard<std::mutex> lock(mutex_);
     state_ = CircuitState::CLOSED;
@@ -12,9 +12,16 @@ enum class CircuitState {
 
 class CircuitBreaker {
 public:
+    using State = CircuitState;
+
     CircuitBreaker(int failureThreshold = 5, 
                    std::chrono::milliseconds timeout = std::chrono::milliseconds(60000),
                    std::chrono::milliseconds retryTimeout = std::chrono::milliseconds(30000));
+    // CircuitBreakerManager 使用的构造：successThreshold 目前未使用，半开狀態下一次成功即关闭
+    CircuitBreaker(int failureThreshold, 
+                   int successThreshold,
+                   std::chrono::milliseconds timeout,
+                   std::chrono::milliseconds retryTimeout);
     
     // 执行操作，返回是否允許执行
     bool canExecute();
@@ -31,6 +38,8 @@ public:
     // 获取统計信息
     int getFailureCount() const;
     int getSuccessCount() const;
+    std::chrono::system_clock::time_point getLastFailureTime() const;
+    std::chrono::system_clock::time_point getLastSuccessTime() const;
     
     // 重置熔斷器
     void reset();
@@ -45,6 +54,8 @@ private:
     std::atomic<int> successCount_;
     std::chrono::steady_clock::time_point lastFailureTime_;
     std::chrono::steady_clock::time_point lastRetryTime_;
+    std::chrono::system_clock::time_point lastFailureWallTime_;
+    std::chrono::system_clock::time_point lastSuccessWallTime_;
     
     mutable std::mutex mutex_;
     
@@ -3,6 +3,8 @@
 #include <sstream>
 #include <thread>
 #include <chrono>
+#include <cstdlib>
+#include <strings.h>
 
 #ifdef HAVE_CURL
 #include <curl/curl.h>
@@ -65,12 +67,39 @@ bool ConsulClient::deregisterService(const std::string& serviceId) {
 }
 
 std::vector<ServiceInstance> ConsulClient::getHealthyServiceInstances(const std::string& serviceName) {
+    std::string path = "/v1/health/service/" + serviceName + "?passing=true";
+    return parseHealthyInstances(makeRequest("GET", path));
+}
+
+bool ConsulClient::watchHealthyServiceInstances(const std::string& serviceName,
+                                                uint64_t& index,
+                                                int waitSeconds,
+                                                std::vector<ServiceInstance>& instances,
+                                                const std::atomic<bool>* running) {
+    std::string url = consulUrl_ + "/v1/health/service/" + serviceName + "?passing=true&index=" +
+                      std::to_string(index) + "&wait=" + std::to_string(waitSeconds) + "s";
+    std::string body;
+    uint64_t newIndex = 0;
+    // Consul 會在 wait 之外再加最多 wait/16 的隨機抖动，超時留出余量
+    if (!httpGetIndexed(url, waitSeconds + waitSeconds / 16 + 5, body, newIndex, running)) {
+        return false;
+    }
+    // index 回退（Consul 重建、快照恢复）時從 0 重新开始，下一次查询立即返回当前 index；
+    // 其他情况下 index 至少为 1，否則每次都會變成非阻塞查询
+    if (newIndex < index) {
+        newIndex = 0;
+    } else if (newIndex == 0) {
+        newIndex = 1;
+    }
+    index = newIndex;
+    instances = parseHealthyInstances(body);
+    return true;
+}
+
+std::vector<ServiceInstance> ConsulClient::parseHealthyInstances(const std::string& response) {
     std::vector<ServiceInstance> instances;
     
 #ifdef HAVE_JSON
-    std::string path = "/v1/health/service/" + serviceName + "?passing=true";
-    std::string response = makeRequest("GET", path);
-    
     if (!response.empty()) {
         try {
             auto services = json::parse(response);
@@ -142,6 +171,55 @@ std::string ConsulClient::httpGet(const std::string& url) {
 #endif
 }
 
+bool ConsulClient::httpGetIndexed(const std::string& url, long timeoutSeconds, std::string& body, uint64_t& index,
+                                  const std::atomic<bool>* running) {
+#ifdef HAVE_CURL
+    CURL* curl = curl_easy_init();
+    if (!curl) return false;
+    
+    body.clear();
+    index = 0;
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, +[](void* contents, size_t size, size_t nmemb, std::string* s) {
+        size_t newLength = size * nmemb;
+        s->append((char*)contents, newLength);
+        return newLength;
+    });
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &body);
+    // 從响应头取 X-Consul-Index
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, +[](char* buffer, size_t size, size_t nitems, uint64_t* idx) {
+        size_t len = size * nitems;
+        static const char kName[] = "x-consul-index:";
+        const size_t nameLen = sizeof(kName) - 1;
+        if (len > nameLen && strncasecmp(buffer, kName, nameLen) == 0) {
+            *idx = std::strtoull(buffer + nameLen, nullptr, 10);
+        }
+        return len;
+    });
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &index);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeoutSeconds);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    if (running) {
+        // 长轮询期间定期检查停止标志，返回非 0 中断传输
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, +[](void* p, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+            return static_cast<const std::atomic<bool>*>(p)->load() ? 0 : 1;
+        });
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, const_cast<std::atomic<bool>*>(running));
+    }
+    
+    CURLcode res = curl_easy_perform(curl);
+    long code = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+    curl_easy_cleanup(curl);
+    
+    return res == CURLE_OK && code == 200;
+#else
+    (void)url; (void)timeoutSeconds; (void)body; (void)index; (void)running;
+    return false;
+#endif
+}
+
 std::string ConsulClient::httpPut(const std::string& url, const std::string& body) {
 #ifdef HAVE_CURL
     CURL* curl = curl_easy_init();
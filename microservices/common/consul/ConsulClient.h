@@ -2,6 +2,8 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include <cstdint>
+#include <atomic>
 
 struct ServiceInstance {
     std::string id;
@@ -30,6 +32,15 @@ public:
     // 服务发现
     std::vector<ServiceInstance> getHealthyServiceInstances(const std::string& serviceName);
 
+    // 阻塞查询（long-poll）：帶上次的 X-Consul-Index，服务列表变化或等待 waitSeconds 超時才返回
+    // 请求失敗返回 false；成功時 index 更新为最新值，instances 为当前健康实例
+    // running 不为空時，*running 变为 false 會中断正在等待的请求
+    bool watchHealthyServiceInstances(const std::string& serviceName,
+                                      uint64_t& index,
+                                      int waitSeconds,
+                                      std::vector<ServiceInstance>& instances,
+                                      const std::atomic<bool>* running = nullptr);
+
     // 健康检查
     bool checkServiceHealth(const std::string& serviceId);
 
@@ -37,6 +48,9 @@ private:
     std::string consulUrl_;
     std::string makeRequest(const std::string& method, const std::string& path, const std::string& body = "");
     std::string httpGet(const std::string& url);
+    bool httpGetIndexed(const std::string& url, long timeoutSeconds, std::string& body, uint64_t& index,
+                        const std::atomic<bool>* running);
+    static std::vector<ServiceInstance> parseHealthyInstances(const std::string& response);
     std::string httpPut(const std::string& url, const std::string& body);
     std::string httpDelete(const std::string& url);
 };
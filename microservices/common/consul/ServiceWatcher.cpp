@@ -0,0 +1,107 @@
+#include "ServiceWatcher.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+ServiceWatcher::ServiceWatcher(ConsulClient& client, int waitSeconds)
+    : client_(client), waitSeconds_(waitSeconds < 1 ? 1 : waitSeconds) {}
+
+ServiceWatcher::~ServiceWatcher() {
+    stop();
+}
+
+void ServiceWatcher::watch(const std::string& serviceName, std::vector<std::string> fallback, Listener listener) {
+    auto w = std::make_unique<Watch>();
+    w->name = serviceName;
+    std::sort(fallback.begin(), fallback.end());
+    w->fallback = std::move(fallback);
+    w->listener = std::move(listener);
+    w->snapshot = std::make_shared<const Endpoints>();
+    watches_.push_back(std::move(w));
+}
+
+void ServiceWatcher::start() {
+    if (running_.exchange(true)) {
+        return;
+    }
+    for (auto& w : watches_) {
+        publish(w.get(), w->fallback);
+        Watch* raw = w.get();
+        w->thread = std::thread([this, raw]() { run(raw); });
+    }
+}
+
+void ServiceWatcher::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    for (auto& w : watches_) {
+        if (w->thread.joinable()) {
+            w->thread.join();
+        }
+    }
+}
+
+ServiceWatcher::EndpointsPtr ServiceWatcher::endpoints(const std::string& serviceName) const {
+    for (const auto& w : watches_) {
+        if (w->name == serviceName) {
+            return std::atomic_load(&w->snapshot);
+        }
+    }
+    return std::make_shared<const Endpoints>();
+}
+
+void ServiceWatcher::run(Watch* w) {
+    uint64_t index = 0;
+    int backoffMs = 1000;
+    while (running_.load()) {
+        std::vector<ServiceInstance> instances;
+        if (!client_.watchHealthyServiceInstances(w->name, index, waitSeconds_, instances, &running_)) {
+            if (!running_.load()) {
+                break;
+            }
+            // Consul 不可用：保留现有快照，退避后重试，并从头开始阻塞查询
+            ++errors_;
+            index = 0;
+            if (!sleepFor(backoffMs)) {
+                break;
+            }
+            backoffMs = std::min(backoffMs * 2, 30000);
+            continue;
+        }
+        backoffMs = 1000;
+
+        Endpoints eps;
+        eps.reserve(instances.size());
+        for (const auto& inst : instances) {
+            eps.push_back(inst.address + ":" + std::to_string(inst.port));
+        }
+        if (eps.empty()) {
+            eps = w->fallback;
+        }
+        std::sort(eps.begin(), eps.end());
+        publish(w, std::move(eps));
+    }
+}
+
+void ServiceWatcher::publish(Watch* w, Endpoints endpoints) {
+    EndpointsPtr cur = std::atomic_load(&w->snapshot);
+    if (*cur == endpoints) {
+        return;
+    }
+    auto next = std::make_shared<const Endpoints>(std::move(endpoints));
+    std::atomic_store(&w->snapshot, next);
+    ++updates_;
+    std::cout << "[ServiceWatcher] " << w->name << " endpoints: " << next->size() << "\n";
+    if (w->listener) {
+        w->listener(w->name, next);
+    }
+}
+
+bool ServiceWatcher::sleepFor(int millis) const {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(millis);
+    while (running_.load() && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    return running_.load();
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <functional>
+
+#include "ConsulClient.h"
+
+/*
+服务發现后台监视器
+1. 每個监视的服务一個线程，用 Consul 阻塞查询（index + wait 长轮询）等待健康实例变化，变化後立即生效，不再定时轮询
+2. 端点列表排序后以不可变快照發布，只有列表真的变化时才替换快照并通知 listener；
+   Consul 不可用时保留最後一次成功的结果，从未成功时使用后备端点
+3. 请求路径不查询 Consul，也不需要经过这里；listener 负责把新列表同步到 stub 池等使用方
+*/
+class ServiceWatcher {
+public:
+    using Endpoints = std::vector<std::string>;
+    using EndpointsPtr = std::shared_ptr<const Endpoints>;
+    using Listener = std::function<void(const std::string& serviceName, const EndpointsPtr& endpoints)>;
+
+    explicit ServiceWatcher(ConsulClient& client, int waitSeconds = 30);
+    ~ServiceWatcher();
+
+    ServiceWatcher(const ServiceWatcher&) = delete;
+    ServiceWatcher& operator=(const ServiceWatcher&) = delete;
+
+    // 在 start() 之前登记；fallback 为 Consul 尚无结果或沒有健康实例时使用的端点
+    void watch(const std::string& serviceName, std::vector<std::string> fallback, Listener listener);
+
+    // 先以后备端点通知一次 listener，再为每個服务启动监视线程
+    void start();
+    void stop();
+
+    // 当前端点快照，未登记的服务返回空列表
+    EndpointsPtr endpoints(const std::string& serviceName) const;
+
+    // 快照替换次数、Consul 查询失败次数
+    long updates() const { return updates_.load(); }
+    long errors() const { return errors_.load(); }
+
+private:
+    struct Watch {
+        std::string name;
+        Endpoints fallback;
+        Listener listener;
+        EndpointsPtr snapshot;  // 通过 std::atomic_load/atomic_store 访问
+        std::thread thread;
+    };
+
+    void run(Watch* w);
+    void publish(Watch* w, Endpoints endpoints);
+    bool sleepFor(int millis) const;
+
+    ConsulClient& client_;
+    int waitSeconds_;
+    std::vector<std::unique_ptr<Watch>> watches_;
+    std::atomic<bool> running_{false};
+    std::atomic<long> updates_{0};
+    std::atomic<long> errors_{0};
+};
@@ -1,16 +1,39 @@
 #include "db/Db.h"
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <type_traits>
 
 #ifdef HAVE_MARIADB
 #include <mysql/mysql.h>
+#include <mysql/errmsg.h>
 #endif
 
+long long DbRow::getInt(size_t i) const {
+    const Column& c = cols_[i];
+    if (c.is_null) return 0;
+    if (c.is_int) return c.i;
+    return std::strtoll(std::string(c.data, c.len).c_str(), nullptr, 10);
+}
+
+std::string DbRow::getString(size_t i) const {
+    const Column& c = cols_[i];
+    if (c.is_null) return std::string();
+    if (c.is_int) return std::to_string(c.i);
+    return std::string(c.data, c.len);
+}
+
 DbConnection::DbConnection() {
 }
 
 DbConnection::~DbConnection() {
 #ifdef HAVE_MARIADB
+    // 语句依赖连接，先于连接关闭
+    for (auto& kv : stmt_cache_) {
+        mysql_stmt_close(static_cast<MYSQL_STMT*>(kv.second));
+    }
+    stmt_cache_.clear();
     if (conn_) {
         MYSQL* c = static_cast<MYSQL*>(conn_);
         mysql_close(c);
@@ -19,6 +42,29 @@ DbConnection::~DbConnection() {
 #endif
 }
 
+DbConnection* DbConnection::threadLocal(const DbConfig& cfg) {
+    thread_local std::unique_ptr<DbConnection> conn;
+    if (conn && !conn->isLost()) {
+        return conn.get();
+    }
+    conn.reset(new DbConnection());
+    if (!conn->connect(cfg)) {
+        conn.reset();
+        return nullptr;
+    }
+    return conn.get();
+}
+
+void DbConnection::checkLost(unsigned int err) {
+#ifdef HAVE_MARIADB
+    if (err == CR_SERVER_GONE_ERROR || err == CR_SERVER_LOST) {
+        lost_ = true;
+    }
+#else
+    (void)err;
+#endif
+}
+
 bool DbConnection::connect(const DbConfig& cfg) {
 #ifdef HAVE_MARIADB
     MYSQL* c = mysql_init(nullptr);
@@ -44,6 +90,7 @@ bool DbConnection::execute(const std::string& sql) {
     MYSQL* c = static_cast<MYSQL*>(conn_);
     if (mysql_query(c, sql.c_str()) != 0) {
         std::cerr << "DB exec error: " << mysql_error(c) << "\n";
+        checkLost(mysql_errno(c));
         return false;
     }
     return true;
@@ -59,6 +106,7 @@ bool DbConnection::querySingleString(const std::string& sql, std::string& out) {
     MYSQL* c = static_cast<MYSQL*>(conn_);
     if (mysql_query(c, sql.c_str()) != 0) {
         std::cerr << "DB query error: " << mysql_error(c) << "\n";
+        checkLost(mysql_errno(c));
         return false;
     }
     MYSQL_RES* res = mysql_store_result(c);
@@ -84,6 +132,7 @@ bool DbConnection::queryEach(const std::string& sql,
     MYSQL* c = static_cast<MYSQL*>(conn_);
     if (mysql_query(c, sql.c_str()) != 0) {
         std::cerr << "DB query error: " << mysql_error(c) << "\n";
+        checkLost(mysql_errno(c));
         return false;
     }
     MYSQL_RES* res = mysql_store_result(c);
@@ -104,4 +153,152 @@ bool DbConnection::queryEach(const std::string& sql,
 #endif
 }
 
+void* DbConnection::prepareCached(const std::string& sql) {
+#ifdef HAVE_MARIADB
+    if (!conn_) return nullptr;
+    auto it = stmt_cache_.find(sql);
+    if (it != stmt_cache_.end()) {
+        MYSQL_STMT* stmt = static_cast<MYSQL_STMT*>(it->second);
+        mysql_stmt_free_result(stmt);
+        return stmt;
+    }
+    MYSQL_STMT* stmt = mysql_stmt_init(static_cast<MYSQL*>(conn_));
+    if (!stmt) return nullptr;
+    if (mysql_stmt_prepare(stmt, sql.c_str(), sql.size()) != 0) {
+        std::cerr << "DB prepare error: " << mysql_stmt_error(stmt) << "\n";
+        checkLost(mysql_stmt_errno(stmt));
+        mysql_stmt_close(stmt);
+        return nullptr;
+    }
+    // 结果集按最大列长分配缓冲区
+    bool update_max_length = true;
+    mysql_stmt_attr_set(stmt, STMT_ATTR_UPDATE_MAX_LENGTH, &update_max_length);
+    stmt_cache_.emplace(sql, stmt);
+    return stmt;
+#else
+    (void)sql;
+    return nullptr;
+#endif
+}
+
+bool DbConnection::bindAndExecute(void* s, const std::string& sql, const std::vector<DbParam>& params) {
+#ifdef HAVE_MARIADB
+    MYSQL_STMT* stmt = static_cast<MYSQL_STMT*>(s);
+    if (mysql_stmt_param_count(stmt) != params.size()) {
+        std::cerr << "DB param count mismatch: " << sql << "\n";
+        return false;
+    }
+    std::vector<MYSQL_BIND> binds(params.size());
+    std::vector<unsigned long> lens(params.size());
+    for (size_t i = 0; i < params.size(); ++i) {
+        const DbParam& p = params[i];
+        MYSQL_BIND& b = binds[i];
+        std::memset(&b, 0, sizeof(b));
+        if (p.type == DbParam::Int) {
+            b.buffer_type = MYSQL_TYPE_LONGLONG;
+            b.buffer = const_cast<long long*>(&p.i);
+        } else {
+            lens[i] = p.len;
+            b.buffer_type = p.type == DbParam::Blob ? MYSQL_TYPE_BLOB : MYSQL_TYPE_STRING;
+            b.buffer = const_cast<char*>(p.data);
+            b.buffer_length = p.len;
+            b.length = &lens[i];
+        }
+    }
+    if ((!binds.empty() && mysql_stmt_bind_param(stmt, binds.data())) || mysql_stmt_execute(stmt) != 0) {
+        std::cerr << "DB stmt exec error: " << mysql_stmt_error(stmt) << "\n";
+        checkLost(mysql_stmt_errno(stmt));
+        return false;
+    }
+    return true;
+#else
+    (void)s; (void)sql; (void)params;
+    return false;
+#endif
+}
+
+bool DbConnection::executePrepared(const std::string& sql, const std::vector<DbParam>& params,
+                                   unsigned long long* insert_id) {
+#ifdef HAVE_MARIADB
+    void* stmt = prepareCached(sql);
+    if (!stmt || !bindAndExecute(stmt, sql, params)) return false;
+    if (insert_id) *insert_id = mysql_stmt_insert_id(static_cast<MYSQL_STMT*>(stmt));
+    return true;
+#else
+    (void)sql; (void)params; (void)insert_id;
+    return false;
+#endif
+}
+
+bool DbConnection::queryPrepared(const std::string& sql, const std::vector<DbParam>& params,
+                                 const std::function<void(const DbRow&)>& on_row) {
+#ifdef HAVE_MARIADB
+    void* s = prepareCached(sql);
+    if (!s || !bindAndExecute(s, sql, params)) return false;
+    MYSQL_STMT* stmt = static_cast<MYSQL_STMT*>(s);
+    MYSQL_RES* meta = mysql_stmt_result_metadata(stmt);
+    if (!meta) return true;
+    if (mysql_stmt_store_result(stmt) != 0) {
+        std::cerr << "DB stmt store error: " << mysql_stmt_error(stmt) << "\n";
+        checkLost(mysql_stmt_errno(stmt));
+        mysql_free_result(meta);
+        return false;
+    }
 
+    // 整数列绑定到整数缓冲区，其它列按该列最大长度分配字符串缓冲区
+    using NullFlag = std::remove_pointer<decltype(MYSQL_BIND::is_null)>::type;
+    size_t n = mysql_num_fields(meta);
+    MYSQL_FIELD* fields = mysql_fetch_fields(meta);
+    std::vector<MYSQL_BIND> binds(n);
+    std::vector<std::vector<char>> bufs(n);
+    std::unique_ptr<NullFlag[]> nulls(new NullFlag[n]());
+    DbRow row;
+    row.cols_.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        MYSQL_BIND& b = binds[i];
+        std::memset(&b, 0, sizeof(b));
+        DbRow::Column& c = row.cols_[i];
+        switch (fields[i].type) {
+        case MYSQL_TYPE_TINY:
+        case MYSQL_TYPE_SHORT:
+        case MYSQL_TYPE_INT24:
+        case MYSQL_TYPE_LONG:
+        case MYSQL_TYPE_LONGLONG:
+            c.is_int = true;
+            b.buffer_type = MYSQL_TYPE_LONGLONG;
+            b.buffer = &c.i;
+            break;
+        default:
+            bufs[i].resize(fields[i].max_length + 1);
+            c.data = bufs[i].data();
+            b.buffer_type = MYSQL_TYPE_STRING;
+            b.buffer = bufs[i].data();
+            b.buffer_length = bufs[i].size();
+            break;
+        }
+        b.length = &c.len;
+        b.is_null = &nulls[i];
+    }
+    mysql_free_result(meta);
+
+    bool ok = mysql_stmt_bind_result(stmt, binds.data()) == 0;
+    if (ok) {
+        int ret;
+        while ((ret = mysql_stmt_fetch(stmt)) == 0 || ret == MYSQL_DATA_TRUNCATED) {
+            for (size_t i = 0; i < n; ++i) row.cols_[i].is_null = nulls[i];
+            on_row(row);
+        }
+        if (ret == 1) {
+            std::cerr << "DB stmt fetch error: " << mysql_stmt_error(stmt) << "\n";
+            checkLost(mysql_stmt_errno(stmt));
+        }
+    } else {
+        std::cerr << "DB stmt bind result error: " << mysql_stmt_error(stmt) << "\n";
+    }
+    mysql_stmt_free_result(stmt);
+    return ok;
+#else
+    (void)sql; (void)params; (void)on_row;
+    return false;
+#endif
+}
@@ -2,6 +2,7 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include <unordered_map>
 
 class DbConfig {
 public:
@@ -12,19 +13,71 @@ public:
     std::string database = "chatdb";
 };
 
+// 预处理语句的参数，按类型二进制绑定；String/Blob 不拷贝，执行结束前必须保持有效
+struct DbParam {
+    enum Type { Int, String, Blob };
+    Type type = Int;
+    long long i = 0;
+    const char* data = nullptr;
+    size_t len = 0;
+
+    static DbParam ofInt(long long v) { DbParam p; p.type = Int; p.i = v; return p; }
+    static DbParam ofString(const std::string& s) { DbParam p; p.type = String; p.data = s.data(); p.len = s.size(); return p; }
+    static DbParam ofBlob(const char* d, size_t n) { DbParam p; p.type = Blob; p.data = d; p.len = n; return p; }
+};
+
+// 预处理查询结果中的一行，整数列直接以整数读出，不经过字符串转换
+class DbRow {
+public:
+    size_t size() const { return cols_.size(); }
+    long long getInt(size_t i) const;
+    std::string getString(size_t i) const;
+    bool isNull(size_t i) const { return cols_[i].is_null; }
+
+private:
+    friend class DbConnection;
+    struct Column {
+        bool is_int = false;
+        bool is_null = false;
+        long long i = 0;
+        const char* data = nullptr;
+        unsigned long len = 0;
+    };
+    std::vector<Column> cols_;
+};
+
 class DbConnection {
 public:
     DbConnection();
     ~DbConnection();
 
+    // 当前线程复用的连接：gRPC 同步服务的工作线程各持有一条，预处理语句缓存跨请求保留；
+    // 尚未连接或上次操作发现连接已断开时按 cfg 重新连接，连接失败返回 nullptr
+    static DbConnection* threadLocal(const DbConfig& cfg);
+
     bool connect(const DbConfig& cfg);
+    // 操作中遇到连接断开（服务器重启、超时断开），该连接及其语句缓存都不能再用
+    bool isLost() const { return lost_; }
     bool execute(const std::string& sql);
     bool querySingleString(const std::string& sql, std::string& out);
     bool queryEach(const std::string& sql,
                    const std::function<void(const std::vector<std::string>&)>& on_row);
 
+    // 预处理语句：同一条 SQL 在该连接上只 prepare 一次，之后只传参数
+    bool executePrepared(const std::string& sql, const std::vector<DbParam>& params,
+                         unsigned long long* insert_id = nullptr);
+    bool queryPrepared(const std::string& sql, const std::vector<DbParam>& params,
+                       const std::function<void(const DbRow&)>& on_row);
+
 private:
+    // 取出缓存的语句（MYSQL_STMT*），不存在则 prepare 并缓存
+    void* prepareCached(const std::string& sql);
+    // 绑定参数并执行
+    bool bindAndExecute(void* stmt, const std::string& sql, const std::vector<DbParam>& params);
+    // 根据错误码判断连接是否已断开
+    void checkLost(unsigned int err);
+
     void* conn_ = nullptr; // Opaque pointer to MYSQL*
+    std::unordered_map<std::string, void*> stmt_cache_; // SQL -> MYSQL_STMT*
+    bool lost_ = false;
 };
-
-
@@ -0,0 +1,157 @@
+#pragma once
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+// 单個端点的負载统计：Peak EWMA 延迟 + 在途请求数 + 连续失败离群剔除
+class EndpointLoad {
+public:
+    // onComplete 造成的狀態变化，调用方据此同步熔斷器
+    enum class Transition {
+        NONE,
+        EJECTED,   // 连续失败达到閾值，暂时剔除
+        RESTORED   // 剔除期满后首個成功请求，恢复正常
+    };
+
+    explicit EndpointLoad(std::string key) : key_(std::move(key)) {}
+
+    const std::string& key() const { return key_; }
+
+    void onStart() { inflight_.fetch_add(1, std::memory_order_relaxed); }
+
+    // 请求结束：ok=false 只应表示端点本身的問題（不可达、超時），业务错误不算
+    Transition onComplete(std::chrono::microseconds latency, bool ok) {
+        inflight_.fetch_sub(1, std::memory_order_relaxed);
+        int64_t now = nowNs();
+        if (!ok) {
+            int fails = consecutiveFailures_.fetch_add(1, std::memory_order_relaxed) + 1;
+            if (fails >= kEjectAfterFailures && !isEjected(now)) {
+                std::lock_guard<std::mutex> lk(mu_);
+                consecutiveFailures_.store(0, std::memory_order_relaxed);
+                int times = std::min(++ejections_, kMaxEjectionMultiplier);
+                ejectedUntilNs_.store(now + kBaseEjectionNs * times, std::memory_order_release);
+                pendingRestore_ = true;
+                ejectedTotal_.fetch_add(1, std::memory_order_relaxed);
+                return Transition::EJECTED;
+            }
+            return Transition::NONE;
+        }
+
+        consecutiveFailures_.store(0, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lk(mu_);
+        // Peak EWMA：变慢立即生效，变快按时间衰减逐步跟上
+        double rtt = static_cast<double>(latency.count());
+        double ewma = ewmaUs_.load(std::memory_order_relaxed);
+        int64_t last = lastNs_.load(std::memory_order_relaxed);
+        if (rtt > ewma || last == 0) {
+            ewma = rtt;
+        } else {
+            double w = std::exp(-static_cast<double>(now - last) / kDecayNs);
+            ewma = ewma * w + rtt * (1.0 - w);
+        }
+        ewmaUs_.store(ewma, std::memory_order_relaxed);
+        lastNs_.store(now, std::memory_order_relaxed);
+        if (pendingRestore_) {
+            pendingRestore_ = false;
+            ejections_ = std::max(0, ejections_ - 1);
+            return Transition::RESTORED;
+        }
+        return Transition::NONE;
+    }
+
+    // 选择代价：衰减后的 EWMA 延迟 × (在途数 + 1)；长时间无请求时延迟衰减到 0，慢节点也会被重新探测
+    double cost(int64_t now) const {
+        double ewma = ewmaUs_.load(std::memory_order_relaxed);
+        int64_t last = lastNs_.load(std::memory_order_relaxed);
+        if (last == 0) {
+            ewma = kInitialLatencyUs;
+        } else if (now > last) {
+            ewma *= std::exp(-static_cast<double>(now - last) / kDecayNs);
+        }
+        return (ewma + 1.0) * (inflight_.load(std::memory_order_relaxed) + 1);
+    }
+
+    bool isEjected(int64_t now) const { return now < ejectedUntilNs_.load(std::memory_order_acquire); }
+
+    int inflight() const { return inflight_.load(std::memory_order_relaxed); }
+    double ewmaUs() const { return ewmaUs_.load(std::memory_order_relaxed); }
+    long ejectedTotal() const { return ejectedTotal_.load(std::memory_order_relaxed); }
+
+    static int64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    static constexpr double kDecayNs = 10e9;              // EWMA 衰减时间常数 10s
+    static constexpr double kInitialLatencyUs = 5000.0;   // 尚无样本时按 5ms 估计
+    static constexpr int kEjectAfterFailures = 5;
+    static constexpr int64_t kBaseEjectionNs = 10000000000LL;  // 每次剔除 10s × 剔除次数
+    static constexpr int kMaxEjectionMultiplier = 6;
+
+    const std::string key_;
+    std::atomic<int> inflight_{0};
+    std::atomic<double> ewmaUs_{0.0};
+    std::atomic<int64_t> lastNs_{0};
+    std::atomic<int> consecutiveFailures_{0};
+    std::atomic<int64_t> ejectedUntilNs_{0};
+    std::atomic<long> ejectedTotal_{0};
+
+    std::mutex mu_;            // 保护 EWMA 更新和剔除狀態
+    int ejections_ = 0;
+    bool pendingRestore_ = false;
+};
+
+/*
+P2C（power of two choices）选择
+1. 随机取两個不同端点，选代价较低者；比全量比较便宜，又能避开慢节点和排队深的节点
+2. 被剔除或 usable 判定不可用的端点不参与；两個候选都不可用时从随机位置扫描第一個可用端点
+3. 全部不可用时（例如同时剔除）仍返回代价较低的候选，避免把所有请求直接拒掉
+n: 端点数；loadOf(i) 返回 const EndpointLoad&；usable(i) 返回端点是否可用（如 channel 狀態）
+*/
+template <typename LoadOf, typename Usable>
+size_t p2cSelect(size_t n, LoadOf&& loadOf, Usable&& usable) {
+    if (n <= 1) {
+        return 0;
+    }
+    thread_local uint64_t seed = static_cast<uint64_t>(EndpointLoad::nowNs()) ^
+                                 reinterpret_cast<uintptr_t>(&seed);
+    auto next = [&]() {
+        // xorshift64*
+        seed ^= seed >> 12;
+        seed ^= seed << 25;
+        seed ^= seed >> 27;
+        return seed * 2685821657736338717ULL;
+    };
+    size_t a = next() % n;
+    size_t b = next() % (n - 1);
+    if (b >= a) {
+        ++b;
+    }
+
+    int64_t now = EndpointLoad::nowNs();
+    auto ok = [&](size_t i) { return !loadOf(i).isEjected(now) && usable(i); };
+    bool okA = ok(a);
+    bool okB = ok(b);
+    if (okA && okB) {
+        return loadOf(a).cost(now) <= loadOf(b).cost(now) ? a : b;
+    }
+    if (okA) {
+        return a;
+    }
+    if (okB) {
+        return b;
+    }
+    size_t start = next() % n;
+    for (size_t k = 0; k < n; ++k) {
+        size_t i = (start + k) % n;
+        if (ok(i)) {
+            return i;
+        }
+    }
+    return loadOf(a).cost(now) <= loadOf(b).cost(now) ? a : b;
+}
@@ -0,0 +1,131 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <grpcpp/grpcpp.h>
+
+// 在途请求计数器，超过上限时拒绝新请求
+class InflightLimiter {
+public:
+    explicit InflightLimiter(int limit) : limit_(limit) {}
+
+    bool tryAcquire() {
+        int cur = count_.load(std::memory_order_relaxed);
+        while (cur < limit_) {
+            if (count_.compare_exchange_weak(cur, cur + 1, std::memory_order_acq_rel)) {
+                return true;
+            }
+        }
+        ++rejected_;
+        return false;
+    }
+    void release() { count_.fetch_sub(1, std::memory_order_acq_rel); }
+
+    int inflight() const { return count_.load(); }
+    long rejected() const { return rejected_.load(); }
+
+private:
+    const int limit_;
+    std::atomic<int> count_{0};
+    std::atomic<long> rejected_{0};
+};
+
+/*
+gRPC 异步客户端
+1. 所有调用共用一個 CompletionQueue，由几個轮询线程取出完成事件，I/O 线程发起调用后立即返回，不再阻塞在 RPC 上
+2. 每個调用带截止时间，后端变慢时最多占用一個在途名额到超时
+3. 完成回调在轮询线程上执行，调用方负责把结果转交到连接所属的 EventLoop
+*/
+class AsyncRpcClient {
+public:
+    explicit AsyncRpcClient(int pollThreads = 2) {
+        for (int i = 0; i < pollThreads; ++i) {
+            threads_.emplace_back([this]() { pollLoop(); });
+        }
+    }
+
+    ~AsyncRpcClient() {
+        // 完成回调里也可能發起新调用（如批量接口不可用时逐条重发），等正在發起的调用结束后再关闭完成队列
+        shutdown_.store(true);
+        while (starting_.load() != 0) {
+            std::this_thread::yield();
+        }
+        cq_.Shutdown();
+        for (auto& t : threads_) {
+            if (t.joinable()) t.join();
+        }
+    }
+
+    /*
+    发起一次异步调用
+    prepare: (grpc::ClientContext*, grpc::CompletionQueue*) -> unique_ptr<ClientAsyncResponseReader<Resp>>，
+             通常是 stub->PrepareAsyncXxx(ctx, req, cq)
+    done:    (const grpc::Status&, const std::shared_ptr<Resp>&)，在轮询线程上调用
+    */
+    template <typename Resp, typename Prepare>
+    void call(int timeoutMs, Prepare&& prepare,
+              std::function<void(const grpc::Status&, const std::shared_ptr<Resp>&)> done) {
+        ++starting_;
+        if (shutdown_.load()) {
+            --starting_;
+            done(grpc::Status(grpc::StatusCode::CANCELLED, "client shutting down"), std::make_shared<Resp>());
+            return;
+        }
+        auto* c = new Call<Resp>();
+        c->done = std::move(done);
+        c->ctx.set_deadline(std::chrono::system_clock::now() + std::chrono::milliseconds(timeoutMs));
+        c->reader = prepare(&c->ctx, &cq_);
+        c->reader->StartCall();
+        c->reader->Finish(c->resp.get(), &c->status, c);
+        ++started_;
+        --starting_;
+    }
+
+    long started() const { return started_.load(); }
+    long completed() const { return completed_.load(); }
+
+private:
+    struct CallBase {
+        virtual ~CallBase() = default;
+        virtual void complete(bool ok) = 0;
+    };
+
+    template <typename Resp>
+    struct Call : CallBase {
+        grpc::ClientContext ctx;
+        grpc::Status status;
+        std::shared_ptr<Resp> resp = std::make_shared<Resp>();
+        std::unique_ptr<grpc::ClientAsyncResponseReader<Resp>> reader;
+        std::function<void(const grpc::Status&, const std::shared_ptr<Resp>&)> done;
+
+        void complete(bool ok) override {
+            if (!ok && status.ok()) {
+                status = grpc::Status(grpc::StatusCode::UNKNOWN, "rpc completion failed");
+            }
+            done(status, resp);
+        }
+    };
+
+    void pollLoop() {
+        void* tag = nullptr;
+        bool ok = false;
+        // Shutdown 之后取完剩余事件才返回 false
+        while (cq_.Next(&tag, &ok)) {
+            auto* c = static_cast<CallBase*>(tag);
+            c->complete(ok);
+            delete c;
+            ++completed_;
+        }
+    }
+
+    grpc::CompletionQueue cq_;
+    std::vector<std::thread> threads_;
+    std::atomic<bool> shutdown_{false};
+    std::atomic<int> starting_{0};
+    std::atomic<long> started_{0};
+    std::atomic<long> completed_{0};
+};
@@ -0,0 +1,115 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <functional>
+
+#include <grpcpp/support/status.h>
+#include "message_service.pb.h"
+
+/*
+私聊消息合并器
+1. 各 I/O 线程 add() 的消息先放进同一個待发批次，凑满 maxBatch 条时由当前线程立即发出，
+   否则由后台线程在第一条消息进入后 window 时间到期时发出，单条消息最多多等一個窗口
+2. 发出时交给 flush 回调（选择后端并發起 OneChatBatch 異步调用），批次的结果再逐条回给 add() 的 done
+3. 析构时停止后台线程并发出剩余消息
+*/
+class OneChatBatcher {
+public:
+    using Done = std::function<void(const grpc::Status& status, const chat::message::OneChatBatchResponse& resp)>;
+    using Flush = std::function<void(std::shared_ptr<chat::message::OneChatBatchRequest> req,
+                                     std::shared_ptr<std::vector<Done>> dones)>;
+
+    OneChatBatcher(Flush flush, size_t maxBatch = 64,
+                   std::chrono::microseconds window = std::chrono::microseconds(2000))
+        : flush_(std::move(flush)),
+          maxBatch_(maxBatch < 1 ? 1 : maxBatch),
+          window_(window) {
+        reset();
+        thread_ = std::thread([this]() { run(); });
+    }
+
+    ~OneChatBatcher() {
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            running_ = false;
+        }
+        cv_.notify_one();
+        if (thread_.joinable()) thread_.join();
+    }
+
+    OneChatBatcher(const OneChatBatcher&) = delete;
+    OneChatBatcher& operator=(const OneChatBatcher&) = delete;
+
+    void add(const chat::common::ChatMessage& msg, Done done) {
+        std::unique_lock<std::mutex> lk(mu_);
+        *req_->add_msgs() = msg;
+        dones_->push_back(std::move(done));
+        if (dones_->size() >= maxBatch_) {
+            takeAndFlush(lk);
+            return;
+        }
+        if (dones_->size() == 1) {
+            oldest_ = std::chrono::steady_clock::now();
+            lk.unlock();
+            cv_.notify_one();
+        }
+    }
+
+    long batches() const { return batches_.load(); }
+    long messages() const { return messages_.load(); }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lk(mu_);
+        while (running_ || !dones_->empty()) {
+            if (dones_->empty()) {
+                cv_.wait(lk);
+                continue;
+            }
+            auto deadline = oldest_ + window_;
+            if (running_ && std::chrono::steady_clock::now() < deadline) {
+                cv_.wait_until(lk, deadline);
+                continue;
+            }
+            takeAndFlush(lk);
+            lk.lock();
+        }
+    }
+
+    // 取出当前批次并在锁外发出；返回时锁已释放
+    void takeAndFlush(std::unique_lock<std::mutex>& lk) {
+        auto req = std::move(req_);
+        auto dones = std::move(dones_);
+        reset();
+        lk.unlock();
+        ++batches_;
+        messages_ += static_cast<long>(dones->size());
+        flush_(std::move(req), std::move(dones));
+    }
+
+    void reset() {
+        req_ = std::make_shared<chat::message::OneChatBatchRequest>();
+        dones_ = std::make_shared<std::vector<Done>>();
+        dones_->reserve(maxBatch_);
+    }
+
+    Flush flush_;
+    const size_t maxBatch_;
+    const std::chrono::microseconds window_;
+
+    std::mutex mu_;
+    std::condition_variable cv_;
+    bool running_ = true;
+    std::shared_ptr<chat::message::OneChatBatchRequest> req_;
+    std::shared_ptr<std::vector<Done>> dones_;
+    std::chrono::steady_clock::time_point oldest_;
+    std::thread thread_;
+
+    std::atomic<long> batches_{0};
+    std::atomic<long> messages_{0};
+};
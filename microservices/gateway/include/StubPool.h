@@ -0,0 +1,168 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+#include <grpcpp/grpcpp.h>
+
+#include "discovery/P2CBalancer.h"
+
+// 單個後端端点的連线：每個端点固定幾條 channel，stub 和 channel 一起建立、一起复用
+template <typename Service>
+struct StubEndpoint {
+    std::string endpoint;
+    std::vector<std::shared_ptr<grpc::Channel>> channels;
+    std::vector<std::shared_ptr<typename Service::Stub>> stubs;
+    // 延迟/在途/剔除统计，端点保留在新快照中时沿用
+    std::shared_ptr<EndpointLoad> load;
+};
+
+/*
+gRPC channel/stub 池
+1. 每個端点只在第一次出現時建立 channel（HTTP/2 握手一次），之後所有请求复用同一批 stub，
+   gRPC 的 channel 和 stub 本身是线程安全的，多個 I/O 线程共享
+2. 端点列表以不可变快照發布，通过 std::atomic_load/atomic_store 读写 shared_ptr（和 ServiceWatcher 一致），
+   选取 stub 时不占用 update() 的锁；服务發现结果变化时 update() 换入新快照，保留未变化端点已有的 channel；
+   旧快照在最後一個持有它的 pick() 返回後释放，下线端点的 channel 在最後一個请求結束後释放
+3. 端点之间用 P2C + Peak EWMA 选择（见 P2CBalancer.h），慢节点和排队深的节点自动少分流量，
+   连续失败的端点暂时剔除；所有 channel 都处于 TRANSIENT_FAILURE/SHUTDOWN 的端点不参与选择
+   端点内的 channel 輪询，优先 READY，其次 IDLE（顺便触发连线）
+4. 每個端点建立多條 channel 并使用本地 subchannel 池，避免单條 HTTP/2 连线的并发流上限成为瓶颈
+*/
+template <typename Service>
+class StubPool {
+public:
+    using StubPtr = std::shared_ptr<typename Service::Stub>;
+
+    struct Picked {
+        StubPtr stub;
+        std::shared_ptr<EndpointLoad> load;
+    };
+
+    explicit StubPool(int channelsPerEndpoint = 2)
+        : channelsPerEndpoint_(channelsPerEndpoint < 1 ? 1 : channelsPerEndpoint),
+          current_(std::make_shared<const Snapshot>()) {
+    }
+
+    StubPool(const StubPool&) = delete;
+    StubPool& operator=(const StubPool&) = delete;
+
+    // 更新端点列表，列表未变化时什么也不做；返回是否换入了新快照
+    bool update(std::vector<std::string> endpoints) {
+        std::lock_guard<std::mutex> lk(mu_);
+        SnapshotPtr live = std::atomic_load(&current_);
+        if (sameEndpoints(*live, endpoints)) {
+            return false;
+        }
+
+        auto next = std::make_shared<Snapshot>();
+        for (const auto& ep : endpoints) {
+            const StubEndpoint<Service>* existing = find(*live, ep);
+            next->push_back(existing ? *existing : connect(ep));
+        }
+
+        std::atomic_store(&current_, SnapshotPtr(std::move(next)));
+        ++updates_;
+        return true;
+    }
+
+    // 选取一個 stub，沒有端点时 stub 为 nullptr；调用方在请求前后通过 load 回报在途数和延迟
+    Picked pick() {
+        SnapshotPtr snap = std::atomic_load(&current_);
+        if (snap->empty()) {
+            return Picked{};
+        }
+        size_t i = p2cSelect(snap->size(),
+            [&snap](size_t k) -> const EndpointLoad& { return *(*snap)[k].load; },
+            [&snap](size_t k) { return connectable((*snap)[k]); });
+        const StubEndpoint<Service>& ep = (*snap)[i];
+        return Picked{pickChannel(ep), ep.load};
+    }
+
+    // 当前端点数量
+    size_t size() const { return std::atomic_load(&current_)->size(); }
+    // 换入新快照的次数
+    long updates() const { return updates_.load(); }
+
+private:
+    using Snapshot = std::vector<StubEndpoint<Service>>;
+    using SnapshotPtr = std::shared_ptr<const Snapshot>;
+
+    static bool sameEndpoints(const Snapshot& snap, const std::vector<std::string>& endpoints) {
+        if (snap.size() != endpoints.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < snap.size(); ++i) {
+            if (snap[i].endpoint != endpoints[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static const StubEndpoint<Service>* find(const Snapshot& snap, const std::string& endpoint) {
+        for (const auto& ep : snap) {
+            if (ep.endpoint == endpoint) {
+                return &ep;
+            }
+        }
+        return nullptr;
+    }
+
+    // 端点下任一 channel 尚可连线即视为可用
+    static bool connectable(const StubEndpoint<Service>& ep) {
+        for (const auto& ch : ep.channels) {
+            grpc_connectivity_state st = ch->GetState(false);
+            if (st != GRPC_CHANNEL_TRANSIENT_FAILURE && st != GRPC_CHANNEL_SHUTDOWN) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 端点内輪询 channel，优先 READY，其次 IDLE（触发连线），都沒有时返回輪询到的那條
+    StubPtr pickChannel(const StubEndpoint<Service>& ep) {
+        size_t n = ep.channels.size();
+        size_t start = rr_++ % n;
+        StubPtr idle;
+        for (size_t k = 0; k < n; ++k) {
+            size_t c = (start + k) % n;
+            grpc_connectivity_state st = ep.channels[c]->GetState(false);
+            if (st == GRPC_CHANNEL_READY) {
+                return ep.stubs[c];
+            }
+            if (st == GRPC_CHANNEL_IDLE && !idle) {
+                ep.channels[c]->GetState(true);
+                idle = ep.stubs[c];
+            }
+        }
+        return idle ? idle : ep.stubs[start];
+    }
+
+    // 为新端点建立 channel 和 stub
+    StubEndpoint<Service> connect(const std::string& endpoint) const {
+        StubEndpoint<Service> ep;
+        ep.endpoint = endpoint;
+        for (int i = 0; i < channelsPerEndpoint_; ++i) {
+            grpc::ChannelArguments args;
+            args.SetInt(GRPC_ARG_KEEPALIVE_TIME_MS, 30000);
+            args.SetInt(GRPC_ARG_KEEPALIVE_TIMEOUT_MS, 10000);
+            args.SetInt(GRPC_ARG_KEEPALIVE_PERMIT_WITHOUT_CALLS, 1);
+            // 每條 channel 使用自己的 subchannel，才會建立独立的 TCP 连线
+            args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+            auto ch = grpc::CreateCustomChannel(endpoint, grpc::InsecureChannelCredentials(), args);
+            ep.channels.push_back(ch);
+            ep.stubs.push_back(StubPtr(Service::NewStub(ch)));
+        }
+        ep.load = std::make_shared<EndpointLoad>(endpoint);
+        return ep;
+    }
+
+    int channelsPerEndpoint_;
+    std::mutex mu_;        // 只在 update() 之间互斥
+    SnapshotPtr current_;  // 通过 std::atomic_load/atomic_store 访问
+    std::atomic<size_t> rr_{0};
+    std::atomic<long> updates_{0};
+};
@@ -29,10 +29,16 @@ using namespace muduo::net;
 #include "user_service.grpc.pb.h"
 #include "message_service.grpc.pb.h"
 #include "social_service.grpc.pb.h"
+#include "StubPool.h"
+#include "AsyncRpcClient.h"
+#include "OneChatBatcher.h"
+#include "circuit/CircuitBreakerManager.h"
+#include <algorithm>
 #endif
 
 #ifdef HAVE_CURL
 #include "consul/ConsulClient.h"
+#include "consul/ServiceWatcher.h"
 #endif
 
 #ifdef HAVE_OPENSSL
@@ -74,11 +80,43 @@ public:
         user_eps_ = parseEndpoints("SERVICE_USER", "127.0.0.1:60051");
         msg_eps_ = parseEndpoints("SERVICE_MESSAGE", "127.0.0.1:60053");
         social_eps_ = parseEndpoints("SERVICE_SOCIAL", "127.0.0.1:60052");
+        // 先以環境变数端点建立 channel 池；有 Consul 时由后台监视线程在服务列表变化时换入新端点
+        user_pool_.update(sortedEndpoints(user_eps_));
+        msg_pool_.update(sortedEndpoints(msg_eps_));
+        social_pool_.update(sortedEndpoints(social_eps_));
+        // 私聊合并需要 message service 支持 OneChatBatch，默认关闭，GATEWAY_CHAT_BATCH=1 开启
+        const char* batchEnv = std::getenv("GATEWAY_CHAT_BATCH");
+        if (batchEnv && std::string(batchEnv) == "1") {
+            chatBatcher_.reset(new OneChatBatcher(
+                [this](std::shared_ptr<chat::message::OneChatBatchRequest> req,
+                       std::shared_ptr<std::vector<OneChatBatcher::Done>> dones) {
+                    flushChatBatch(std::move(req), std::move(dones));
+                },
+                kChatBatchMax, std::chrono::microseconds(kChatBatchWindowUs)));
+        }
+#ifdef HAVE_CURL
+        if (g_consul) {
+            watcher_.reset(new ServiceWatcher(*g_consul));
+            watcher_->watch("chat-user-service", user_eps_, [this](const std::string& name, const ServiceWatcher::EndpointsPtr& eps) {
+                if (user_pool_.update(*eps)) std::cout << "[Gateway] " << name << " endpoints: " << user_pool_.size() << "\n";
+            });
+            watcher_->watch("chat-message-service", msg_eps_, [this](const std::string& name, const ServiceWatcher::EndpointsPtr& eps) {
+                if (msg_pool_.update(*eps)) std::cout << "[Gateway] " << name << " endpoints: " << msg_pool_.size() << "\n";
+            });
+            watcher_->watch("chat-social-service", social_eps_, [this](const std::string& name, const ServiceWatcher::EndpointsPtr& eps) {
+                if (social_pool_.update(*eps)) std::cout << "[Gateway] " << name << " endpoints: " << social_pool_.size() << "\n";
+            });
+            watcher_->start();
+        }
+#endif
 #endif
         server_.setConnectionCallback(
             [this](const TcpConnectionPtr& conn) {
                 if (conn->connected()) {
                     std::cout << "[Gateway] new connection from " << conn->peerAddress().toIpPort() << "\n";
+#ifdef HAVE_GRPC
+                    conn->setContext(std::make_shared<InflightLimiter>(kConnInflightLimit));
+#endif
                 } else {
                     std::cout << "[Gateway] connection closed " << conn->peerAddress().toIpPort() << "\n";
                     unbindConn(conn);
@@ -96,23 +134,27 @@ public:
                         chat::user::LoginRequest req;
                         req.set_id(js.value("id", 0));
                         req.set_password(js.value("password", std::string("")));
-                        chat::user::LoginResponse resp;
-                        grpc::ClientContext ctx;
-                        auto stub = getUserStub();
-                        auto status = stub->Login(&ctx, req, &resp);
-                        json out;
-                        out["msgid"] = 2; // LOGIN_MSG_ACK
-                        if (status.ok()) {
-                            out["errno"] = resp.errno();
-                            out["errmsg"] = resp.errmsg();
-                            out["user"] = { {"id", resp.user().id()}, {"name", resp.user().name()}, {"state", resp.user().state()} };
-                            if (resp.errno() == 0) {
-                                bindUser(resp.user().id(), conn);
-                            }
-                        } else {
-                            out = { {"msgid", 2}, {"errno", 1}, {"errmsg", status.error_message()} };
-                        }
-                        conn->send(out.dump());
+                        auto picked = getUserStub();
+                        auto stub = picked.stub;
+                        forward<chat::user::LoginResponse>(conn, picked, "chat-user-service", user_inflight_, kLoginTimeoutMs, 2,
+                            [stub, req](grpc::ClientContext* ctx, grpc::CompletionQueue* cq) {
+                                return stub->PrepareAsyncLogin(ctx, req, cq);
+                            },
+                            [this](const TcpConnectionPtr& c, const grpc::Status& status, const chat::user::LoginResponse& resp) {
+                                json out;
+                                out["msgid"] = 2; // LOGIN_MSG_ACK
+                                if (status.ok()) {
+                                    out["errno"] = resp.err_no();
+                                    out["errmsg"] = resp.errmsg();
+                                    out["user"] = { {"id", resp.user().id()}, {"name", resp.user().name()}, {"state", resp.user().state()} };
+                                    if (resp.err_no() == 0) {
+                                        bindUser(resp.user().id(), c);
+                                    }
+                                } else {
+                                    out = { {"msgid", 2}, {"errno", 1}, {"errmsg", status.error_message()} };
+                                }
+                                c->send(out.dump());
+                            });
 #else
                         conn->send(s); // 無 gRPC 時暫時回顯
 #endif
@@ -125,12 +167,34 @@ public:
                         m->set_content(js.value("content", std::string("")));
                         m->set_timestamp_ms(js.value("timestamp_ms", 0LL));
                         m->set_msg_id(js.value("msg_id", std::string("")));
-                        chat::message::OneChatResponse resp;
-                        grpc::ClientContext ctx2;
-                        auto stub = getMsgStub();
-                        auto status2 = stub->OneChat(&ctx2, req, &resp);
-                        json out = { {"msgid", 1002}, {"errno", status2.ok() ? resp.errno() : 1}, {"errmsg", status2.ok() ? resp.errmsg() : status2.error_message()} };
-                        conn->send(out.dump());
+                        if (chatBatcher_ && !chatBatchUnsupported_.load()) {
+                            // 合并进 OneChatBatch，整批完成后逐条回覆
+                            std::shared_ptr<InflightLimiter> connLimiter;
+                            if (acquireSlots(conn, msg_inflight_, 1002, connLimiter)) {
+                                InflightLimiter* backendLimiter = &msg_inflight_;
+                                chatBatcher_->add(req.msg(),
+                                    [conn, connLimiter, backendLimiter](const grpc::Status& status, const chat::message::OneChatBatchResponse& resp) {
+                                        backendLimiter->release();
+                                        if (connLimiter) connLimiter->release();
+                                        json out = { {"msgid", 1002}, {"errno", status.ok() ? resp.err_no() : 1}, {"errmsg", status.ok() ? resp.errmsg() : status.error_message()} };
+                                        std::string payload = out.dump();
+                                        conn->getLoop()->queueInLoop([conn, payload]() {
+                                            if (conn->connected()) conn->send(payload);
+                                        });
+                                    });
+                            }
+                        } else {
+                            auto picked = getMsgStub();
+                            auto stub = picked.stub;
+                            forward<chat::message::OneChatResponse>(conn, picked, "chat-message-service", msg_inflight_, kChatTimeoutMs, 1002,
+                                [stub, req](grpc::ClientContext* ctx, grpc::CompletionQueue* cq) {
+                                    return stub->PrepareAsyncOneChat(ctx, req, cq);
+                                },
+                                [](const TcpConnectionPtr& c, const grpc::Status& status, const chat::message::OneChatResponse& resp) {
+                                    json out = { {"msgid", 1002}, {"errno", status.ok() ? resp.err_no() : 1}, {"errmsg", status.ok() ? resp.errmsg() : status.error_message()} };
+                                    c->send(out.dump());
+                                });
+                        }
 #else
                         conn->send(s);
 #endif
@@ -143,12 +207,16 @@ public:
                         m->set_content(js.value("content", std::string("")));
                         m->set_timestamp_ms(js.value("timestamp_ms", 0LL));
                         m->set_msg_id(js.value("msg_id", std::string("")));
-                        chat::message::GroupChatResponse resp;
-                        grpc::ClientContext ctx3;
-                        auto stub = getMsgStub();
-                        auto status3 = stub->GroupChat(&ctx3, req, &resp);
-                        json out = { {"msgid", 1004}, {"errno", status3.ok() ? resp.errno() : 1}, {"errmsg", status3.ok() ? resp.errmsg() : status3.error_message()} };
-                        conn->send(out.dump());
+                        auto picked = getMsgStub();
+                        auto stub = picked.stub;
+                        forward<chat::message::GroupChatResponse>(conn, picked, "chat-message-service", msg_inflight_, kChatTimeoutMs, 1004,
+                            [stub, req](grpc::ClientContext* ctx, grpc::CompletionQueue* cq) {
+                                return stub->PrepareAsyncGroupChat(ctx, req, cq);
+                            },
+                            [](const TcpConnectionPtr& c, const grpc::Status& status, const chat::message::GroupChatResponse& resp) {
+                                json out = { {"msgid", 1004}, {"errno", status.ok() ? resp.err_no() : 1}, {"errmsg", status.ok() ? resp.errmsg() : status.error_message()} };
+                                c->send(out.dump());
+                            });
 #else
                         conn->send(s);
 #endif
@@ -157,12 +225,16 @@ public:
                         chat::social::AddFriendRequest req;
                         req.set_user_id(js.value("user_id", 0));
                         req.set_friend_id(js.value("friend_id", 0));
-                        chat::social::AddFriendResponse resp;
-                        grpc::ClientContext ctx4;
-                        auto stub = getSocialStub();
-                        auto status4 = stub->AddFriend(&ctx4, req, &resp);
-                        json out = { {"msgid", 2002}, {"errno", status4.ok() ? resp.errno() : 1}, {"errmsg", status4.ok() ? resp.errmsg() : status4.error_message()} };
-                        conn->send(out.dump());
+                        auto picked = getSocialStub();
+                        auto stub = picked.stub;
+                        forward<chat::social::AddFriendResponse>(conn, picked, "chat-social-service", social_inflight_, kSocialTimeoutMs, 2002,
+                            [stub, req](grpc::ClientContext* ctx, grpc::CompletionQueue* cq) {
+                                return stub->PrepareAsyncAddFriend(ctx, req, cq);
+                            },
+                            [](const TcpConnectionPtr& c, const grpc::Status& status, const chat::social::AddFriendResponse& resp) {
+                                json out = { {"msgid", 2002}, {"errno", status.ok() ? resp.err_no() : 1}, {"errmsg", status.ok() ? resp.errmsg() : status.error_message()} };
+                                c->send(out.dump());
+                            });
 #else
                         conn->send(s);
 #endif
@@ -172,12 +244,16 @@ public:
                         req.set_owner_id(js.value("owner_id", 0));
                         req.set_name(js.value("name", std::string("")));
                         req.set_desc(js.value("desc", std::string("")));
-                        chat::social::CreateGroupResponse resp;
-                        grpc::ClientContext ctx5;
-                        auto stub = getSocialStub();
-                        auto status5 = stub->CreateGroup(&ctx5, req, &resp);
-                        json out = { {"msgid", 2004}, {"errno", status5.ok() ? resp.errno() : 1}, {"errmsg", status5.ok() ? resp.errmsg() : status5.error_message()}, {"group_id", resp.group_id()} };
-                        conn->send(out.dump());
+                        auto picked = getSocialStub();
+                        auto stub = picked.stub;
+                        forward<chat::social::CreateGroupResponse>(conn, picked, "chat-social-service", social_inflight_, kSocialTimeoutMs, 2004,
+                            [stub, req](grpc::ClientContext* ctx, grpc::CompletionQueue* cq) {
+                                return stub->PrepareAsyncCreateGroup(ctx, req, cq);
+                            },
+                            [](const TcpConnectionPtr& c, const grpc::Status& status, const chat::social::CreateGroupResponse& resp) {
+                                json out = { {"msgid", 2004}, {"errno", status.ok() ? resp.err_no() : 1}, {"errmsg", status.ok() ? resp.errmsg() : status.error_message()}, {"group_id", resp.group_id()} };
+                                c->send(out.dump());
+                            });
 #else
                         conn->send(s);
 #endif
@@ -186,12 +262,16 @@ public:
                         chat::social::AddGroupRequest req;
                         req.set_user_id(js.value("user_id", 0));
                         req.set_group_id(js.value("group_id", 0));
-                        chat::social::AddGroupResponse resp;
-                        grpc::ClientContext ctx6;
-                        auto stub = getSocialStub();
-                        auto status6 = stub->AddGroup(&ctx6, req, &resp);
-                        json out = { {"msgid", 2006}, {"errno", status6.ok() ? resp.errno() : 1}, {"errmsg", status6.ok() ? resp.errmsg() : status6.error_message()} };
-                        conn->send(out.dump());
+                        auto picked = getSocialStub();
+                        auto stub = picked.stub;
+                        forward<chat::social::AddGroupResponse>(conn, picked, "chat-social-service", social_inflight_, kSocialTimeoutMs, 2006,
+                            [stub, req](grpc::ClientContext* ctx, grpc::CompletionQueue* cq) {
+                                return stub->PrepareAsyncAddGroup(ctx, req, cq);
+                            },
+                            [](const TcpConnectionPtr& c, const grpc::Status& status, const chat::social::AddGroupResponse& resp) {
+                                json out = { {"msgid", 2006}, {"errno", status.ok() ? resp.err_no() : 1}, {"errmsg", status.ok() ? resp.errmsg() : status.error_message()} };
+                                c->send(out.dump());
+                            });
 #else
                         conn->send(s);
 #endif
@@ -204,70 +284,208 @@ public:
             });
     }
 
+    ~GatewayServer() {
+#if defined(HAVE_GRPC) && defined(HAVE_CURL)
+        // 先停止监视线程，避免 listener 在 stub 池析构后还被调用
+        if (watcher_) watcher_->stop();
+#endif
+    }
+
     void start() { server_.start(); }
 
 private:
     TcpServer server_;
 #ifdef HAVE_GRPC
+    // 環境变数配置的端点，Consul 不可用或沒有健康实例时使用
     std::vector<std::string> user_eps_, msg_eps_, social_eps_;
-    std::atomic<size_t> user_rr_{0}, msg_rr_{0}, social_rr_{0};
+    // 每個后端服务一個 channel/stub 池，所有 I/O 线程共享，请求路径上不再建立 channel 或查询 Consul
+    StubPool<chat::user::UserService> user_pool_;
+    StubPool<chat::message::MessageService> msg_pool_;
+    StubPool<chat::social::SocialService> social_pool_;
+#ifdef HAVE_CURL
+    std::unique_ptr<ServiceWatcher> watcher_;
+#endif
     
 #ifdef HAVE_OPENSSL
     std::unordered_map<std::string, CircuitBreaker> circuitBreakers_;
 #endif
 
-    std::unique_ptr<chat::user::UserService::Stub> getUserStub() {
-#ifdef HAVE_CURL
-        // 從 Consul 获取服务实例
-        if (g_consul) {
-            auto instances = g_consul->getHealthyServiceInstances("chat-user-service");
-            if (!instances.empty()) {
-                static std::atomic<size_t> rr{0};
-                auto& instance = instances[rr++ % instances.size()];
-                std::string ep = instance.address + ":" + std::to_string(instance.port);
-                auto ch = grpc::CreateChannel(ep, grpc::InsecureChannelCredentials());
-                return chat::user::UserService::NewStub(ch);
-            }
+    static std::vector<std::string> sortedEndpoints(std::vector<std::string> eps) {
+        std::sort(eps.begin(), eps.end());
+        return eps;
+    }
+
+    StubPool<chat::user::UserService>::Picked getUserStub() { return user_pool_.pick(); }
+    StubPool<chat::message::MessageService>::Picked getMsgStub() { return msg_pool_.pick(); }
+    StubPool<chat::social::SocialService>::Picked getSocialStub() { return social_pool_.pick(); }
+
+    // 每連線最多 64 個在途請求，每個后端服务最多 20000 個；超出时直接回覆忙碌，不排队
+    static constexpr int kConnInflightLimit = 64;
+    static constexpr int kBackendInflightLimit = 20000;
+    static constexpr int kLoginTimeoutMs = 3000;
+    static constexpr int kChatTimeoutMs = 2000;
+    static constexpr int kSocialTimeoutMs = 3000;
+
+    InflightLimiter user_inflight_{kBackendInflightLimit};
+    InflightLimiter msg_inflight_{kBackendInflightLimit};
+    InflightLimiter social_inflight_{kBackendInflightLimit};
+    // 放在限流器之后宣告，析构时先排空完成队列再销毁限流器
+    AsyncRpcClient rpc_{2};
+    // 私聊合并器在 rpc_ 之后宣告，析构时先发出剩余批次；未设置 GATEWAY_CHAT_BATCH=1 时为空，逐条调用 OneChat
+    static constexpr size_t kChatBatchMax = 64;
+    static constexpr int kChatBatchWindowUs = 2000;
+    std::unique_ptr<OneChatBatcher> chatBatcher_;
+    // 后端返回 UNIMPLEMENTED（旧版 message service）后不再合并，之后的私聊直接逐条调用
+    std::atomic<bool> chatBatchUnsupported_{false};
+
+    static std::shared_ptr<InflightLimiter> connInflight(const TcpConnectionPtr& conn) {
+        if (conn->getContext().empty()) return nullptr;
+        return boost::any_cast<std::shared_ptr<InflightLimiter>>(conn->getContext());
+    }
+
+    static void sendBusy(const TcpConnectionPtr& conn, int ackMsgid, const std::string& errmsg) {
+        json out = { {"msgid", ackMsgid}, {"errno", 1}, {"errmsg", errmsg} };
+        conn->send(out.dump());
+    }
+
+    // 只有端点本身的問題计入离群检测，业务错误在响应的 err_no 里，status 仍是 OK
+    static bool isEndpointFailure(const grpc::Status& status) {
+        switch (status.error_code()) {
+            case grpc::StatusCode::UNAVAILABLE:
+            case grpc::StatusCode::DEADLINE_EXCEEDED:
+            case grpc::StatusCode::INTERNAL:
+            case grpc::StatusCode::UNKNOWN:
+                return true;
+            default:
+                return false;
         }
-#endif
-        // 回退到环境变数或預设值
-        std::string ep = user_eps_.empty() ? std::string("127.0.0.1:60051") : user_eps_[(user_rr_++) % user_eps_.size()];
-        auto ch = grpc::CreateChannel(ep, grpc::InsecureChannelCredentials());
-        return chat::user::UserService::NewStub(ch);
     }
-    std::unique_ptr<chat::message::MessageService::Stub> getMsgStub() {
-#ifdef HAVE_CURL
-        if (g_consul) {
-            auto instances = g_consul->getHealthyServiceInstances("chat-message-service");
-            if (!instances.empty()) {
-                static std::atomic<size_t> rr{0};
-                auto& instance = instances[rr++ % instances.size()];
-                std::string ep = instance.address + ":" + std::to_string(instance.port);
-                auto ch = grpc::CreateChannel(ep, grpc::InsecureChannelCredentials());
-                return chat::message::MessageService::NewStub(ch);
-            }
+
+    // 离群剔除/恢复同步到 CircuitBreakerManager，熔斷器名称为 "<服务名>@<端点>"
+    static void syncBreaker(const char* service, const std::string& endpoint, EndpointLoad::Transition t) {
+        CircuitBreakerConfig cfg;
+        cfg.failureThreshold = 1;
+        cfg.timeout = std::chrono::milliseconds(10000);
+        std::string name = std::string(service) + "@" + endpoint;
+        CircuitBreaker* cb = CircuitBreakerManager::getInstance().getCircuitBreaker(name, cfg);
+        if (t == EndpointLoad::Transition::EJECTED) {
+            cb->recordFailure();
+            std::cout << "[Gateway] ejected outlier " << name << "\n";
+        } else {
+            cb->reset();
+            std::cout << "[Gateway] restored " << name << "\n";
         }
-#endif
-        std::string ep = msg_eps_.empty() ? std::string("127.0.0.1:60053") : msg_eps_[(msg_rr_++) % msg_eps_.size()];
-        auto ch = grpc::CreateChannel(ep, grpc::InsecureChannelCredentials());
-        return chat::message::MessageService::NewStub(ch);
     }
-    std::unique_ptr<chat::social::SocialService::Stub> getSocialStub() {
-#ifdef HAVE_CURL
-        if (g_consul) {
-            auto instances = g_consul->getHealthyServiceInstances("chat-social-service");
-            if (!instances.empty()) {
-                static std::atomic<size_t> rr{0};
-                auto& instance = instances[rr++ % instances.size()];
-                std::string ep = instance.address + ":" + std::to_string(instance.port);
-                auto ch = grpc::CreateChannel(ep, grpc::InsecureChannelCredentials());
-                return chat::social::SocialService::NewStub(ch);
+
+    // 占用連線和后端的在途名额，任一已满时回覆忙碌并返回 false
+    bool acquireSlots(const TcpConnectionPtr& conn, InflightLimiter& backend, int ackMsgid,
+                      std::shared_ptr<InflightLimiter>& connLimiter) {
+        connLimiter = connInflight(conn);
+        if (connLimiter && !connLimiter->tryAcquire()) {
+            sendBusy(conn, ackMsgid, "too many requests in flight");
+            return false;
+        }
+        if (!backend.tryAcquire()) {
+            if (connLimiter) connLimiter->release();
+            sendBusy(conn, ackMsgid, "service busy");
+            return false;
+        }
+        return true;
+    }
+
+    // 发出一批私聊消息：整批按 P2C 选一個后端、一次 OneChatBatch 调用，完成后逐条回覆
+    void flushChatBatch(std::shared_ptr<chat::message::OneChatBatchRequest> req,
+                        std::shared_ptr<std::vector<OneChatBatcher::Done>> dones) {
+        auto picked = getMsgStub();
+        if (!picked.stub) {
+            grpc::Status unavailable(grpc::StatusCode::UNAVAILABLE, "service unavailable");
+            chat::message::OneChatBatchResponse empty;
+            for (auto& done : *dones) done(unavailable, empty);
+            return;
+        }
+        auto stub = picked.stub;
+        std::shared_ptr<EndpointLoad> load = picked.load;
+        auto startedAt = std::chrono::steady_clock::now();
+        load->onStart();
+        rpc_.call<chat::message::OneChatBatchResponse>(kChatTimeoutMs,
+            [stub, req](grpc::ClientContext* ctx, grpc::CompletionQueue* cq) {
+                return stub->PrepareAsyncOneChatBatch(ctx, *req, cq);
+            },
+            [this, load, startedAt, req, dones](const grpc::Status& status, const std::shared_ptr<chat::message::OneChatBatchResponse>& resp) {
+                auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startedAt);
+                EndpointLoad::Transition t = load->onComplete(latency, !isEndpointFailure(status));
+                if (t != EndpointLoad::Transition::NONE) syncBreaker("chat-message-service", load->key(), t);
+                if (status.error_code() == grpc::StatusCode::UNIMPLEMENTED) {
+                    if (!chatBatchUnsupported_.exchange(true)) {
+                        std::cout << "[Gateway] OneChatBatch unimplemented by message service, falling back to OneChat\n";
+                    }
+                    resendOneByOne(req, dones);
+                    return;
+                }
+                for (auto& done : *dones) done(status, *resp);
+            });
+    }
+
+    // 批量接口不可用时把这一批逐条改用 OneChat 重发，结果仍经由各自的 done 回覆（在途名额由 done 归还）
+    void resendOneByOne(const std::shared_ptr<chat::message::OneChatBatchRequest>& req,
+                        const std::shared_ptr<std::vector<OneChatBatcher::Done>>& dones) {
+        for (int i = 0; i < req->msgs_size(); ++i) {
+            OneChatBatcher::Done done = (*dones)[i];
+            auto picked = getMsgStub();
+            if (!picked.stub) {
+                done(grpc::Status(grpc::StatusCode::UNAVAILABLE, "service unavailable"), chat::message::OneChatBatchResponse());
+                continue;
             }
+            auto stub = picked.stub;
+            std::shared_ptr<EndpointLoad> load = picked.load;
+            chat::message::OneChatRequest one;
+            *one.mutable_msg() = req->msgs(i);
+            auto startedAt = std::chrono::steady_clock::now();
+            load->onStart();
+            rpc_.call<chat::message::OneChatResponse>(kChatTimeoutMs,
+                [stub, one](grpc::ClientContext* ctx, grpc::CompletionQueue* cq) {
+                    return stub->PrepareAsyncOneChat(ctx, one, cq);
+                },
+                [load, startedAt, done](const grpc::Status& status, const std::shared_ptr<chat::message::OneChatResponse>& resp) {
+                    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startedAt);
+                    EndpointLoad::Transition t = load->onComplete(latency, !isEndpointFailure(status));
+                    if (t != EndpointLoad::Transition::NONE) syncBreaker("chat-message-service", load->key(), t);
+                    chat::message::OneChatBatchResponse batchResp;
+                    batchResp.set_err_no(resp->err_no());
+                    batchResp.set_errmsg(resp->errmsg());
+                    done(status, batchResp);
+                });
         }
-#endif
-        std::string ep = social_eps_.empty() ? std::string("127.0.0.1:60052") : social_eps_[(social_rr_++) % social_eps_.size()];
-        auto ch = grpc::CreateChannel(ep, grpc::InsecureChannelCredentials());
-        return chat::social::SocialService::NewStub(ch);
+    }
+
+    // 非阻塞转发：占用連線和后端的在途名额后發起異步调用，I/O 线程立即返回；
+    // 完成时在轮询线程上归还名额、回报端点延迟，再把回覆交回連線所屬的 EventLoop 执行
+    template <typename Resp, typename Picked, typename Prepare, typename Reply>
+    void forward(const TcpConnectionPtr& conn, const Picked& picked, const char* service, InflightLimiter& backend,
+                 int timeoutMs, int ackMsgid, Prepare&& prepare, Reply reply) {
+        if (!picked.stub) {
+            sendBusy(conn, ackMsgid, "service unavailable");
+            return;
+        }
+        std::shared_ptr<InflightLimiter> connLimiter;
+        if (!acquireSlots(conn, backend, ackMsgid, connLimiter)) {
+            return;
+        }
+        InflightLimiter* backendLimiter = &backend;
+        std::shared_ptr<EndpointLoad> load = picked.load;
+        auto startedAt = std::chrono::steady_clock::now();
+        load->onStart();
+        rpc_.call<Resp>(timeoutMs, std::forward<Prepare>(prepare),
+            [conn, connLimiter, backendLimiter, load, startedAt, service, reply](const grpc::Status& status, const std::shared_ptr<Resp>& resp) {
+                backendLimiter->release();
+                if (connLimiter) connLimiter->release();
+                auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startedAt);
+                EndpointLoad::Transition t = load->onComplete(latency, !isEndpointFailure(status));
+                if (t != EndpointLoad::Transition::NONE) syncBreaker(service, load->key(), t);
+                conn->getLoop()->queueInLoop([conn, reply, status, resp]() {
+                    if (conn->connected()) reply(conn, status, *resp);
+                });
+            });
     }
 #endif
 
@@ -10,6 +10,11 @@ public:
                            const chat::message::OneChatRequest* request,
                            chat::message::OneChatResponse* response) override;
 
+    // 一批私聊消息：一次连接、一條多行 INSERT、一個 Kafka producer
+    ::grpc::Status OneChatBatch(::grpc::ServerContext* context,
+                                const chat::message::OneChatBatchRequest* request,
+                                chat::message::OneChatBatchResponse* response) override;
+
     ::grpc::Status GroupChat(::grpc::ServerContext* context,
                              const chat::message::GroupChatRequest* request,
                              chat::message::GroupChatResponse* response) override;
@@ -2,7 +2,7 @@
 #include "MessageServiceImpl.h"
 #include "db/Db.h"
 #include <cstdlib>
-#include <sstream>
+#include <algorithm>
 #include "json.hpp"
 using json = nlohmann::json;
 
@@ -17,25 +17,29 @@ using json = nlohmann::json;
     if (auto v = std::getenv("DB_USER")) cfg.user = v;
     if (auto v = std::getenv("DB_PASS")) cfg.password = v;
     if (auto v = std::getenv("DB_NAME")) cfg.database = v;
-    DbConnection db;
-    if (!db.connect(cfg)) {
-        resp->set_errno(1);
+    DbConnection* db = DbConnection::threadLocal(cfg);
+    if (!db) {
+        resp->set_err_no(1);
         resp->set_errmsg("db connect failed");
         return ::grpc::Status::OK;
     }
-    std::ostringstream oss;
-    oss << "INSERT INTO messages(from_id, to_id, group_id, content, timestamp_ms, msg_id) VALUES("
-        << m.from_id() << "," << m.to_id() << ",0,'" << m.content() << "'," << m.timestamp_ms() << ",'" << m.msg_id() << "')";
-    if (!db.execute(oss.str())) {
-        resp->set_errno(2);
+    // 内容按参数绑定，不再拼接进 SQL
+    if (!db->executePrepared(
+            "INSERT INTO messages(from_id, to_id, group_id, content, timestamp_ms, msg_id) VALUES(?,?,0,?,?,?)",
+            {DbParam::ofInt(m.from_id()), DbParam::ofInt(m.to_id()), DbParam::ofString(m.content()),
+             DbParam::ofInt(m.timestamp_ms()), DbParam::ofString(m.msg_id())})) {
+        resp->set_err_no(2);
         resp->set_errmsg("insert message failed");
         return ::grpc::Status::OK;
     }
     // 簡化：先當對方離線，写入 offline_msgs
-    std::ostringstream off;
-    off << "INSERT INTO offline_msgs(user_id, payload) VALUES("
-        << m.to_id() << ",'{\\"type\\":\\"ONE_CHAT_MSG\\",\\"from_id\\":" << m.from_id() << ",\\"content\\":\\"" << m.content() << "\\"}')";
-    db.execute(off.str());
+    json off;
+    off["type"] = "ONE_CHAT_MSG";
+    off["from_id"] = m.from_id();
+    off["content"] = m.content();
+    std::string payload = off.dump();
+    db->executePrepared("INSERT INTO offline_msgs(user_id, payload) VALUES(?,?)",
+                       {DbParam::ofInt(m.to_id()), DbParam::ofBlob(payload.data(), payload.size())});
     
     // 发送 Kafka 讯息
 #ifdef HAVE_CPPKAFKA
@@ -58,7 +62,136 @@ using json = nlohmann::json;
     }
 #endif
     
-    resp->set_errno(0);
+    resp->set_err_no(0);
+    resp->set_errmsg("");
+    return ::grpc::Status::OK;
+}
+
+// 多行 INSERT 每條语句的行数只取这几档，批次按从大到小拆成多條语句；
+// 每张表最多 4 种语句文本，每個连线的预处理缓存不会随批大小增长，也不会逼近 max_prepared_stmt_count
+static const int kInsertBuckets[] = {128, 32, 8, 1};
+
+// 剩余 remaining 行时本條语句写入的行数：不超过 remaining 的最大一档
+static int insertBucket(int remaining) {
+    for (int rows : kInsertBuckets) {
+        if (rows <= remaining) return rows;
+    }
+    return 1;
+}
+
+// 生成 "<prefix> VALUES <row>,<row>,..." 的多行插入语句
+static std::string multiRowInsert(const std::string& prefix, const std::string& row, int rows) {
+    std::string sql = prefix + " VALUES ";
+    sql.reserve(sql.size() + rows * (row.size() + 1));
+    for (int i = 0; i < rows; ++i) {
+        if (i > 0) sql += ',';
+        sql += row;
+    }
+    return sql;
+}
+
+::grpc::Status MessageServiceImpl::OneChatBatch(::grpc::ServerContext* ctx,
+                                                const chat::message::OneChatBatchRequest* req,
+                                                chat::message::OneChatBatchResponse* resp) {
+    (void)ctx;
+    const int n = req->msgs_size();
+    if (n == 0) {
+        resp->set_err_no(0);
+        resp->set_errmsg("");
+        return ::grpc::Status::OK;
+    }
+    DbConfig cfg;
+    if (auto v = std::getenv("DB_HOST")) cfg.host = v;
+    if (auto v = std::getenv("DB_PORT")) cfg.port = std::atoi(v);
+    if (auto v = std::getenv("DB_USER")) cfg.user = v;
+    if (auto v = std::getenv("DB_PASS")) cfg.password = v;
+    if (auto v = std::getenv("DB_NAME")) cfg.database = v;
+    DbConnection* db = DbConnection::threadLocal(cfg);
+    if (!db) {
+        resp->set_err_no(1);
+        resp->set_errmsg("db connect failed");
+        return ::grpc::Status::OK;
+    }
+
+    // 离线消息内容先全部生成，DbParam 只引用不拷贝，执行期间必须保持有效
+    std::vector<std::string> payloads;
+    payloads.reserve(n);
+    for (const auto& m : req->msgs()) {
+        json off;
+        off["type"] = "ONE_CHAT_MSG";
+        off["from_id"] = m.from_id();
+        off["content"] = m.content();
+        payloads.push_back(off.dump());
+    }
+
+    // 整批在一個事務內寫入：任一分段失败都回滚，网关按整批失败处理，不会出現部分写入后整批重试造成的重複
+    if (!db->execute("START TRANSACTION")) {
+        resp->set_err_no(2);
+        resp->set_errmsg("begin transaction failed");
+        return ::grpc::Status::OK;
+    }
+    std::vector<DbParam> msgParams;
+    std::vector<DbParam> offParams;
+    for (int begin = 0, rows = 0; begin < n; begin += rows) {
+        rows = insertBucket(n - begin);
+        msgParams.clear();
+        offParams.clear();
+        for (int i = begin; i < begin + rows; ++i) {
+            const auto& m = req->msgs(i);
+            msgParams.push_back(DbParam::ofInt(m.from_id()));
+            msgParams.push_back(DbParam::ofInt(m.to_id()));
+            msgParams.push_back(DbParam::ofString(m.content()));
+            msgParams.push_back(DbParam::ofInt(m.timestamp_ms()));
+            msgParams.push_back(DbParam::ofString(m.msg_id()));
+            offParams.push_back(DbParam::ofInt(m.to_id()));
+            offParams.push_back(DbParam::ofBlob(payloads[i].data(), payloads[i].size()));
+        }
+        if (!db->executePrepared(
+                multiRowInsert("INSERT INTO messages(from_id, to_id, group_id, content, timestamp_ms, msg_id)", "(?,?,0,?,?,?)", rows),
+                msgParams)) {
+            db->execute("ROLLBACK");
+            resp->set_err_no(2);
+            resp->set_errmsg("insert message failed");
+            return ::grpc::Status::OK;
+        }
+        // 簡化：先當對方離線，写入 offline_msgs
+        if (!db->executePrepared(multiRowInsert("INSERT INTO offline_msgs(user_id, payload)", "(?,?)", rows), offParams)) {
+            db->execute("ROLLBACK");
+            resp->set_err_no(3);
+            resp->set_errmsg("insert offline message failed");
+            return ::grpc::Status::OK;
+        }
+    }
+    if (!db->execute("COMMIT")) {
+        db->execute("ROLLBACK");
+        resp->set_err_no(2);
+        resp->set_errmsg("commit failed");
+        return ::grpc::Status::OK;
+    }
+
+    // 整批共用一個 producer，最后 flush 一次
+#ifdef HAVE_CPPKAFKA
+    try {
+        std::string brokers = std::getenv("KAFKA_BROKERS") ? std::getenv("KAFKA_BROKERS") : std::string("127.0.0.1:9092");
+        cppkafka::Configuration cfg = {{"metadata.broker.list", brokers}};
+        cppkafka::Producer producer(cfg);
+        
+        for (const auto& m : req->msgs()) {
+            json msg_payload;
+            msg_payload["to_id"] = m.to_id();
+            msg_payload["from_id"] = m.from_id();
+            msg_payload["content"] = m.content();
+            msg_payload["timestamp_ms"] = m.timestamp_ms();
+            msg_payload["msg_id"] = m.msg_id();
+            producer.produce(cppkafka::MessageBuilder("chat.private").payload(msg_payload.dump()));
+        }
+        producer.flush();
+    } catch (...) {
+        // ignore kafka errors
+    }
+#endif
+    
+    resp->set_err_no(0);
     resp->set_errmsg("");
     return ::grpc::Status::OK;
 }
@@ -74,17 +207,17 @@ using json = nlohmann::json;
     if (auto v = std::getenv("DB_USER")) cfg.user = v;
     if (auto v = std::getenv("DB_PASS")) cfg.password = v;
     if (auto v = std::getenv("DB_NAME")) cfg.database = v;
-    DbConnection db;
-    if (!db.connect(cfg)) {
-        resp->set_errno(1);
+    DbConnection* db = DbConnection::threadLocal(cfg);
+    if (!db) {
+        resp->set_err_no(1);
         resp->set_errmsg("db connect failed");
         return ::grpc::Status::OK;
     }
-    std::ostringstream oss;
-    oss << "INSERT INTO messages(from_id, to_id, group_id, content, timestamp_ms, msg_id) VALUES("
-        << m.from_id() << ",0," << m.group_id() << ",'" << m.content() << "'," << m.timestamp_ms() << ",'" << m.msg_id() << "')";
-    if (!db.execute(oss.str())) {
-        resp->set_errno(2);
+    if (!db->executePrepared(
+            "INSERT INTO messages(from_id, to_id, group_id, content, timestamp_ms, msg_id) VALUES(?,0,?,?,?,?)",
+            {DbParam::ofInt(m.from_id()), DbParam::ofInt(m.group_id()), DbParam::ofString(m.content()),
+             DbParam::ofInt(m.timestamp_ms()), DbParam::ofString(m.msg_id())})) {
+        resp->set_err_no(2);
         resp->set_errmsg("insert group message failed");
         return ::grpc::Status::OK;
     }
@@ -109,7 +242,7 @@ using json = nlohmann::json;
     }
 #endif
     
-    resp->set_errno(0);
+    resp->set_err_no(0);
     resp->set_errmsg("");
     return ::grpc::Status::OK;
 }
@@ -125,38 +258,41 @@ using json = nlohmann::json;
     if (auto v = std::getenv("DB_PASS")) cfg.password = v;
     if (auto v = std::getenv("DB_NAME")) cfg.database = v;
 
-    DbConnection db;
-    if (!db.connect(cfg)) {
+    DbConnection* db = DbConnection::threadLocal(cfg);
+    if (!db) {
         return ::grpc::Status::OK;
     }
-    std::ostringstream q;
     // scope: "private:<peer>" or "group:<gid>"
+    // since 恒作为参数绑定（<=0 时取 0 等价于不过滤），保证每种 scope 只有一条固定 SQL 可复用
     std::string scope = req->scope();
-    int64_t since = req->since_ms();
+    int64_t since = req->since_ms() > 0 ? req->since_ms() : 0;
     int limit = req->limit() > 0 ? req->limit() : 100;
+    std::string sql;
+    std::vector<DbParam> params;
     if (scope.rfind("private:", 0) == 0) {
         int peer = std::atoi(scope.substr(8).c_str());
-        q << "SELECT from_id,to_id,group_id,content,timestamp_ms,IFNULL(msg_id,'') FROM messages WHERE "
-          << "((from_id=" << req->user_id() << " AND to_id=" << peer << ") OR (from_id=" << peer << " AND to_id=" << req->user_id() << "))";
+        sql = "SELECT from_id,to_id,group_id,content,timestamp_ms,IFNULL(msg_id,'') FROM messages WHERE "
+              "((from_id=? AND to_id=?) OR (from_id=? AND to_id=?)) AND timestamp_ms>=? ORDER BY id DESC LIMIT ?";
+        params = {DbParam::ofInt(req->user_id()), DbParam::ofInt(peer),
+                  DbParam::ofInt(peer), DbParam::ofInt(req->user_id()),
+                  DbParam::ofInt(since), DbParam::ofInt(limit)};
     } else if (scope.rfind("group:", 0) == 0) {
         int gid = std::atoi(scope.substr(6).c_str());
-        q << "SELECT from_id,to_id,group_id,content,timestamp_ms,IFNULL(msg_id,'') FROM messages WHERE group_id=" << gid;
+        sql = "SELECT from_id,to_id,group_id,content,timestamp_ms,IFNULL(msg_id,'') FROM messages WHERE "
+              "group_id=? AND timestamp_ms>=? ORDER BY id DESC LIMIT ?";
+        params = {DbParam::ofInt(gid), DbParam::ofInt(since), DbParam::ofInt(limit)};
     } else {
         return ::grpc::Status::OK;
     }
-    if (since > 0) {
-        q << " AND timestamp_ms>=" << since;
-    }
-    q << " ORDER BY id DESC LIMIT " << limit;
-    db.queryEach(q.str(), [&](const std::vector<std::string>& cols){
-        if (cols.size() >= 6) {
+    db->queryPrepared(sql, params, [&](const DbRow& row){
+        if (row.size() >= 6) {
             auto* m = resp->add_messages();
-            m->set_from_id(std::atoi(cols[0].c_str()));
-            m->set_to_id(std::atoi(cols[1].c_str()));
-            m->set_group_id(std::atoi(cols[2].c_str()));
-            m->set_content(cols[3]);
-            m->set_timestamp_ms(std::atoll(cols[4].c_str()));
-            m->set_msg_id(cols[5]);
+            m->set_from_id(row.getInt(0));
+            m->set_to_id(row.getInt(1));
+            m->set_group_id(row.getInt(2));
+            m->set_content(row.getString(3));
+            m->set_timestamp_ms(row.getInt(4));
+            m->set_msg_id(row.getString(5));
         }
     });
     return ::grpc::Status::OK;
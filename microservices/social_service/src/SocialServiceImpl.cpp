@@ -2,7 +2,6 @@
 #include "SocialServiceImpl.h"
 #include "db/Db.h"
 #include <cstdlib>
-#include <sstream>
 
 ::grpc::Status SocialServiceImpl::AddFriend(::grpc::ServerContext* ctx,
                                             const chat::social::AddFriendRequest* req,
@@ -15,25 +14,21 @@
     if (auto v = std::getenv("DB_PASS")) cfg.password = v;
     if (auto v = std::getenv("DB_NAME")) cfg.database = v;
 
-    DbConnection db;
-    if (!db.connect(cfg)) {
-        resp->set_errno(1);
+    DbConnection* db = DbConnection::threadLocal(cfg);
+    if (!db) {
+        resp->set_err_no(1);
         resp->set_errmsg("db connect failed");
         return ::grpc::Status::OK;
     }
-    std::ostringstream oss;
-    oss << "INSERT IGNORE INTO friends(user_id, friend_id) VALUES("
-        << req->user_id() << "," << req->friend_id() << ")";
-    bool ok1 = db.execute(oss.str());
-    std::ostringstream oss2;
-    oss2 << "INSERT IGNORE INTO friends(user_id, friend_id) VALUES("
-        << req->friend_id() << "," << req->user_id() << ")";
-    bool ok2 = db.execute(oss2.str());
+    // 两个方向复用同一条预处理语句
+    const std::string sql = "INSERT IGNORE INTO friends(user_id, friend_id) VALUES(?,?)";
+    bool ok1 = db->executePrepared(sql, {DbParam::ofInt(req->user_id()), DbParam::ofInt(req->friend_id())});
+    bool ok2 = db->executePrepared(sql, {DbParam::ofInt(req->friend_id()), DbParam::ofInt(req->user_id())});
     if (ok1 && ok2) {
-        resp->set_errno(0);
+        resp->set_err_no(0);
         resp->set_errmsg("");
     } else {
-        resp->set_errno(2);
+        resp->set_err_no(2);
         resp->set_errmsg("insert failed");
     }
     return ::grpc::Status::OK;
@@ -50,19 +45,17 @@
     if (auto v = std::getenv("DB_PASS")) cfg.password = v;
     if (auto v = std::getenv("DB_NAME")) cfg.database = v;
 
-    DbConnection db;
-    if (!db.connect(cfg)) {
+    DbConnection* db = DbConnection::threadLocal(cfg);
+    if (!db) {
         return ::grpc::Status::OK;
     }
-    std::ostringstream q;
-    q << "SELECT u.id,u.name,u.state FROM friends f JOIN users u ON u.id=f.friend_id WHERE f.user_id="
-      << req->user_id();
-    db.queryEach(q.str(), [&](const std::vector<std::string>& cols){
-        if (cols.size() >= 3) {
+    db->queryPrepared("SELECT u.id,u.name,u.state FROM friends f JOIN users u ON u.id=f.friend_id WHERE f.user_id=?",
+                     {DbParam::ofInt(req->user_id())}, [&](const DbRow& row){
+        if (row.size() >= 3) {
             auto* u = resp->add_friends();
-            u->set_id(std::atoi(cols[0].c_str()));
-            u->set_name(cols[1]);
-            u->set_state(cols[2]);
+            u->set_id(row.getInt(0));
+            u->set_name(row.getString(1));
+            u->set_state(row.getString(2));
         }
     });
     return ::grpc::Status::OK;
@@ -79,38 +72,28 @@
     if (auto v = std::getenv("DB_PASS")) cfg.password = v;
     if (auto v = std::getenv("DB_NAME")) cfg.database = v;
 
-    DbConnection db;
-    if (!db.connect(cfg)) {
-        resp->set_errno(1);
+    DbConnection* db = DbConnection::threadLocal(cfg);
+    if (!db) {
+        resp->set_err_no(1);
         resp->set_errmsg("db connect failed");
         return ::grpc::Status::OK;
     }
-    std::ostringstream oss;
-    oss << "INSERT INTO groups(owner_id, name, `desc`) VALUES("
-        << req->owner_id() << ",'" << req->name() << "','" << req->desc() << "')";
-    if (!db.execute(oss.str())) {
-        resp->set_errno(2);
+    // 新建 group 的 id 直接取语句生成的自增主键，不再按名称回查
+    unsigned long long gid = 0;
+    if (!db->executePrepared("INSERT INTO groups(owner_id, name, `desc`) VALUES(?,?,?)",
+                            {DbParam::ofInt(req->owner_id()), DbParam::ofString(req->name()),
+                             DbParam::ofString(req->desc())}, &gid)) {
+        resp->set_err_no(2);
         resp->set_errmsg("insert group failed");
         return ::grpc::Status::OK;
     }
-    // 取回剛建立 group 的 id（簡化：以名稱+owner 唯一查一次）
-    std::ostringstream q;
-    q << "SELECT id FROM groups WHERE owner_id=" << req->owner_id()
-      << " AND name='" << req->name() << "' ORDER BY id DESC LIMIT 1";
-    std::string gid;
-    if (db.querySingleString(q.str(), gid)) {
-        resp->set_group_id(std::atoi(gid.c_str()));
-    } else {
-        resp->set_group_id(0);
-    }
+    resp->set_group_id(static_cast<int>(gid));
     // 把 owner 加入 group_members
     if (resp->group_id() > 0) {
-        std::ostringstream gmem;
-        gmem << "INSERT IGNORE INTO group_members(group_id, user_id) VALUES("
-             << resp->group_id() << "," << req->owner_id() << ")";
-        db.execute(gmem.str());
+        db->executePrepared("INSERT IGNORE INTO group_members(group_id, user_id) VALUES(?,?)",
+                           {DbParam::ofInt(resp->group_id()), DbParam::ofInt(req->owner_id())});
     }
-    resp->set_errno(0);
+    resp->set_err_no(0);
     resp->set_errmsg("");
     return ::grpc::Status::OK;
 }
@@ -126,20 +109,18 @@
     if (auto v = std::getenv("DB_PASS")) cfg.password = v;
     if (auto v = std::getenv("DB_NAME")) cfg.database = v;
 
-    DbConnection db;
-    if (!db.connect(cfg)) {
-        resp->set_errno(1);
+    DbConnection* db = DbConnection::threadLocal(cfg);
+    if (!db) {
+        resp->set_err_no(1);
         resp->set_errmsg("db connect failed");
         return ::grpc::Status::OK;
     }
-    std::ostringstream oss;
-    oss << "INSERT IGNORE INTO group_members(group_id, user_id) VALUES("
-        << req->group_id() << "," << req->user_id() << ")";
-    if (db.execute(oss.str())) {
-        resp->set_errno(0);
+    if (db->executePrepared("INSERT IGNORE INTO group_members(group_id, user_id) VALUES(?,?)",
+                           {DbParam::ofInt(req->group_id()), DbParam::ofInt(req->user_id())})) {
+        resp->set_err_no(0);
         resp->set_errmsg("");
     } else {
-        resp->set_errno(2);
+        resp->set_err_no(2);
         resp->set_errmsg("insert group member failed");
     }
     return ::grpc::Status::OK;
@@ -156,21 +137,20 @@
     if (auto v = std::getenv("DB_PASS")) cfg.password = v;
     if (auto v = std::getenv("DB_NAME")) cfg.database = v;
 
-    DbConnection db;
-    if (!db.connect(cfg)) {
+    DbConnection* db = DbConnection::threadLocal(cfg);
+    if (!db) {
         return ::grpc::Status::OK;
     }
-    std::ostringstream q;
-    q << "SELECT g.id,g.name,COUNT(m2.user_id) AS mc FROM groups g "
-      << "JOIN group_members m ON m.group_id=g.id AND m.user_id=" << req->user_id() << " "
-      << "LEFT JOIN group_members m2 ON m2.group_id=g.id "
-      << "GROUP BY g.id,g.name";
-    db.queryEach(q.str(), [&](const std::vector<std::string>& cols){
-        if (cols.size() >= 3) {
+    db->queryPrepared("SELECT g.id,g.name,COUNT(m2.user_id) AS mc FROM groups g "
+                     "JOIN group_members m ON m.group_id=g.id AND m.user_id=? "
+                     "LEFT JOIN group_members m2 ON m2.group_id=g.id "
+                     "GROUP BY g.id,g.name",
+                     {DbParam::ofInt(req->user_id())}, [&](const DbRow& row){
+        if (row.size() >= 3) {
             auto* g = resp->add_groups();
-            g->set_id(std::atoi(cols[0].c_str()));
-            g->set_name(cols[1]);
-            g->set_member_count(std::atoi(cols[2].c_str()));
+            g->set_id(row.getInt(0));
+            g->set_name(row.getString(1));
+            g->set_member_count(row.getInt(2));
         }
     });
     return ::grpc::Status::OK;
@@ -11,21 +11,22 @@
     if (const char* v = std::getenv("DB_PASS")) cfg.password = v;
     if (const char* v = std::getenv("DB_NAME")) cfg.database = v;
     if (const char* v = std::getenv("DB_PORT")) cfg.port = std::atoi(v);
-    DbConnection db;
-    if (db.connect(cfg)) {
+    DbConnection* db = DbConnection::threadLocal(cfg);
+    if (db) {
         std::string name = req->name();
         std::string pwd = req->password();
-        std::string sql = "INSERT INTO users(name, hashed_pwd, state) VALUES('" + name + "','" + pwd + "','offline')";
-        if (!db.execute(sql)) {
-            resp->set_errno(1);
+        unsigned long long uid = 0;
+        if (!db->executePrepared("INSERT INTO users(name, hashed_pwd, state) VALUES(?,?,'offline')",
+                                {DbParam::ofString(name), DbParam::ofString(pwd)}, &uid)) {
+            resp->set_err_no(1);
             resp->set_errmsg("db insert failed");
             return ::grpc::Status::OK;
         }
-        resp->set_errno(0);
+        resp->set_err_no(0);
         resp->set_errmsg("");
-        resp->set_user_id(1);
+        resp->set_user_id(static_cast<int>(uid));
     } else {
-        resp->set_errno(1);
+        resp->set_err_no(1);
         resp->set_errmsg("db connect failed");
     }
     return ::grpc::Status::OK;
@@ -40,24 +41,29 @@
     if (const char* v = std::getenv("DB_PASS")) cfg.password = v;
     if (const char* v = std::getenv("DB_NAME")) cfg.database = v;
     if (const char* v = std::getenv("DB_PORT")) cfg.port = std::atoi(v);
-    DbConnection db;
-    if (!db.connect(cfg)) {
-        resp->set_errno(1);
+    DbConnection* db = DbConnection::threadLocal(cfg);
+    if (!db) {
+        resp->set_err_no(1);
         resp->set_errmsg("db connect failed");
         return ::grpc::Status::OK;
     }
     // 簡化：以 name 當作 id 或查询演示
     std::string out;
-    std::string sql = "SELECT name FROM users WHERE id=" + std::to_string(req->id());
-    if (db.querySingleString(sql, out)) {
+    bool found = false;
+    db->queryPrepared("SELECT name FROM users WHERE id=?", {DbParam::ofInt(req->id())},
+                     [&](const DbRow& row){
+        out = row.getString(0);
+        found = true;
+    });
+    if (found) {
         auto* u = resp->mutable_user();
         u->set_id(req->id());
         u->set_name(out);
         u->set_state("online");
-        resp->set_errno(0);
+        resp->set_err_no(0);
         resp->set_errmsg("");
     } else {
-        resp->set_errno(1);
+        resp->set_err_no(1);
         resp->set_errmsg("user not found");
     }
     return ::grpc::Status::OK;
@@ -66,7 +72,7 @@
 ::grpc::Status UserServiceImpl::Logout(::grpc::ServerContext* ctx,
                                        const chat::user::LogoutRequest* req,
                                        chat::user::LogoutResponse* resp) {
-    resp->set_errno(0);
+    resp->set_err_no(0);
     resp->set_errmsg("");
     return ::grpc::Status::OK;
 }
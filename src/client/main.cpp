@@ -21,6 +21,7 @@ using json = nlohmann::json;
 #include "group.hpp"
 #include "user.hpp"
 #include "public.hpp"
+#include "binproto.hpp"
 
 // 记录当前系统登录的用户信息
 User g_currentUser;
@@ -36,29 +37,36 @@ bool isMainMenuRunning = false;
 sem_t rwsem;
 // 记录登录状态
 atomic_bool g_isLoginSuccess{false};
+// 聊天消息是否使用二进制格式收发，启动参数指定
+bool g_useBinary = false;
 
 
 // 接收线程
 void readTaskHandler(int clientfd);
+// 按帧格式发送一条消息，返回-1表示发送失败
+int sendFrame(int clientfd, const string &msg);
 // 获取系统时间（聊天信息需要添加时间信息）
 string getCurrentTime();
 // 主聊天页面程序
 void mainMenu(int);
 // 显示当前登录成功用户的基本信息
 void showCurrentUserData();
+// 显示一条离线消息
+void showOfflineMsg(const string &str);
 
 // 聊天客户端程序实现，main线程用作发送线程，子线程用作接收线程
 int main(int argc, char **argv)
 {
     if (argc < 3)
     {
-        cerr << "command invalid! example: ./ChatClient 127.0.0.1 6000" << endl;
+        cerr << "command invalid! example: ./ChatClient 127.0.0.1 6000 [binary]" << endl;
         exit(-1);
     }
 
     // 解析通过命令行参数传递的ip和port
     char *ip = argv[1];
     uint16_t port = atoi(argv[2]);
+    g_useBinary = (argc > 3 && string(argv[3]) == "binary");
 
     // 创建client端的socket
     int clientfd = socket(AF_INET, SOCK_STREAM, 0);
@@ -121,11 +129,17 @@ int main(int argc, char **argv)
             js["msgid"] = LOGIN_MSG;
             js["id"] = id;
             js["password"] = pwd;
+            js["loginver"] = 2; // 登录响应中的列表直接使用对象数组
+            js["offlinever"] = 2; // 离线消息在登录响应之后分页下发，逐页确认
+            if (g_useBinary)
+            {
+                js["wire"] = "binary"; // 协商聊天消息使用二进制格式
+            }
             string request = js.dump();
 
             g_isLoginSuccess = false;
 
-            int len = send(clientfd, request.c_str(), strlen(request.c_str()) + 1, 0);
+            int len = sendFrame(clientfd, request);
             if (len == -1)
             {
                 cerr << "send login msg error:" << request << endl;
@@ -156,7 +170,7 @@ int main(int argc, char **argv)
             js["password"] = pwd;
             string request = js.dump();
 
-            int len = send(clientfd, request.c_str(), strlen(request.c_str()) + 1, 0);
+            int len = sendFrame(clientfd, request);
             if (len == -1)
             {
                 cerr << "send reg msg error:" << request << endl;
@@ -192,6 +206,12 @@ void doRegResponse(json &responsejs)
     }
 }
 
+// 登录响应中的列表元素，旧版本服务器是序列化后的json字符串
+static json loginItem(const json &item)
+{
+    return item.is_string() ? json::parse(item.get<string>()) : item;
+}
+
 // 处理登录的响应逻辑
 void doLoginResponse(json &responsejs)
 {
@@ -212,10 +232,9 @@ void doLoginResponse(json &responsejs)
             // 初始化
             g_currentUserFriendList.clear();
 
-            vector<string> vec = responsejs["friends"];
-            for (string &str : vec)
+            for (const json &item : responsejs["friends"])
             {
-                json js = json::parse(str);
+                json js = loginItem(item);
                 User user;
                 user.setId(js["id"].get<int>());
                 user.setName(js["name"]);
@@ -230,20 +249,18 @@ void doLoginResponse(json &responsejs)
             // 初始化
             g_currentUserGroupList.clear();
 
-            vector<string> vec1 = responsejs["groups"];
-            for (string &groupstr : vec1)
+            for (const json &groupItem : responsejs["groups"])
             {
-                json grpjs = json::parse(groupstr);
+                json grpjs = loginItem(groupItem);
                 Group group;
                 group.setId(grpjs["id"].get<int>());
                 group.setName(grpjs["groupname"]);
                 group.setDesc(grpjs["groupdesc"]);
 
-                vector<string> vec2 = grpjs["users"];
-                for (string &userstr : vec2)
+                for (const json &userItem : grpjs.value("users", json::array()))
                 {
                     GroupUser user;
-                    json js = json::parse(userstr);
+                    json js = loginItem(userItem);
                     user.setId(js["id"].get<int>());
                     user.setName(js["name"]);
                     user.setState(js["state"]);
@@ -258,75 +275,157 @@ void doLoginResponse(json &responsejs)
         // 显示登录用户的基本信息
         showCurrentUserData();
 
-        // 显示当前用户的离线消息  个人聊天信息或者群组消息
-        if (responsejs.contains("offlinemsg"))
-        {
-            vector<string> vec = responsejs["offlinemsg"];
-            for (string &str : vec)
-            {
-                json js = json::parse(str);
-                // time + [id] + name + " said: " + xxx
-                if (ONE_CHAT_MSG == js["msgid"].get<int>())
-                {
-                    cout << js["time"].get<string>() << " [" << js["id"] << "]" << js["name"].get<string>()
-                            << " said: " << js["msg"].get<string>() << endl;
-                }
-                else
-                {
-                    cout << "群消息[" << js["groupid"] << "]:" << js["time"].get<string>() << " [" << js["id"] << "]" << js["name"].get<string>()
-                            << " said: " << js["msg"].get<string>() << endl;
-                }
-            }
-        }
-
         g_isLoginSuccess = true;
     }
 }
 
+// 显示一条离线消息  个人聊天信息或者群组消息
+void showOfflineMsg(const string &str)
+{
+    json js = json::parse(str, nullptr, false);
+    if (js.is_discarded())
+    {
+        return;
+    }
+    // time + [id] + name + " said: " + xxx
+    if (ONE_CHAT_MSG == js["msgid"].get<int>())
+    {
+        cout << js["time"].get<string>() << " [" << js["id"] << "]" << js["name"].get<string>()
+                << " said: " << js["msg"].get<string>() << endl;
+    }
+    else
+    {
+        cout << "群消息[" << js["groupid"] << "]:" << js["time"].get<string>() << " [" << js["id"] << "]" << js["name"].get<string>()
+                << " said: " << js["msg"].get<string>() << endl;
+    }
+}
+
 // 子线程 - 接收线程
 void readTaskHandler(int clientfd)
 {
+    // 接收缓冲区，保存还没有凑成完整帧的数据
+    string recvbuf;
     for (;;)
     {
-        char buffer[1024] = {0};
-        int len = recv(clientfd, buffer, 1024, 0);  // 阻塞了
+        char buffer[4096] = {0};
+        int len = recv(clientfd, buffer, sizeof(buffer), 0);  // 阻塞了
         if (-1 == len || 0 == len)
         {
             close(clientfd);
             exit(-1);
         }
+        recvbuf.append(buffer, len);
 
-        // 接收ChatServer转发的数据，反序列化生成json数据对象
-        json js = json::parse(buffer);
-        int msgtype = js["msgid"].get<int>();
-        if (ONE_CHAT_MSG == msgtype)
+        // 从接收缓冲区中切出所有完整的帧
+        while (recvbuf.size() >= FRAME_HEADER_LEN)
         {
-            cout << js["time"].get<string>() << " [" << js["id"] << "]" << js["name"].get<string>()
-                 << " said: " << js["msg"].get<string>() << endl;
-            continue;
-        }
+            uint32_t netlen = 0;
+            memcpy(&netlen, recvbuf.data(), FRAME_HEADER_LEN);
+            uint32_t framelen = ntohl(netlen);
+            if (framelen > FRAME_MAX_LEN)
+            {
+                cerr << "invalid frame length " << framelen << endl;
+                close(clientfd);
+                exit(-1);
+            }
+            if (recvbuf.size() < FRAME_HEADER_LEN + framelen)
+            {
+                break; // 半包，继续接收
+            }
 
-        if (GROUP_CHAT_MSG == msgtype)
-        {
-            cout << "群消息[" << js["groupid"] << "]:" << js["time"].get<string>() << " [" << js["id"] << "]" << js["name"].get<string>()
-                 << " said: " << js["msg"].get<string>() << endl;
-            continue;
-        }
+            // 二进制格式的聊天消息
+            const char *frame = recvbuf.data() + FRAME_HEADER_LEN;
+            if (isBinaryFrame(frame, framelen))
+            {
+                BinChatMsg msg;
+                if (decodeBinChatMsg(frame, framelen, msg))
+                {
+                    if (GROUP_CHAT_MSG == msg.msgid)
+                    {
+                        cout << "群消息[" << msg.toid << "]:";
+                    }
+                    cout << string(msg.time, msg.timelen) << " [" << msg.id << "]" << string(msg.name, msg.namelen)
+                         << " said: " << string(msg.msg, msg.msglen) << endl;
+                }
+                recvbuf.erase(0, FRAME_HEADER_LEN + framelen);
+                continue;
+            }
 
-        if (LOGIN_MSG_ACK == msgtype)
-        {
-            doLoginResponse(js); // 处理登录响应的业务逻辑
-            sem_post(&rwsem);    // 通知主线程，登录结果处理完成
-            continue;
+            // 接收ChatServer转发的数据，反序列化生成json数据对象
+            json js = json::parse(recvbuf.begin() + FRAME_HEADER_LEN,
+                                  recvbuf.begin() + FRAME_HEADER_LEN + framelen, nullptr, false);
+            recvbuf.erase(0, FRAME_HEADER_LEN + framelen);
+            if (js.is_discarded())
+            {
+                cerr << "invalid json frame" << endl;
+                continue;
+            }
+
+            int msgtype = js["msgid"].get<int>();
+            if (ONE_CHAT_MSG == msgtype)
+            {
+                cout << js["time"].get<string>() << " [" << js["id"] << "]" << js["name"].get<string>()
+                     << " said: " << js["msg"].get<string>() << endl;
+                continue;
+            }
+
+            if (GROUP_CHAT_MSG == msgtype)
+            {
+                cout << "群消息[" << js["groupid"] << "]:" << js["time"].get<string>() << " [" << js["id"] << "]" << js["name"].get<string>()
+                     << " said: " << js["msg"].get<string>() << endl;
+                continue;
+            }
+
+            if (LOGIN_MSG_ACK == msgtype)
+            {
+                doLoginResponse(js); // 处理登录响应的业务逻辑
+                sem_post(&rwsem);    // 通知主线程，登录结果处理完成
+                continue;
+            }
+
+            if (OFFLINE_MSG_PAGE == msgtype)
+            {
+                // 显示这一页离线消息后确认，服务器收到确认才会删除并下发下一页
+                for (auto &str : js["offlinemsg"])
+                {
+                    showOfflineMsg(str.get<string>());
+                }
+                json ack;
+                ack["msgid"] = OFFLINE_MSG_ACK;
+                ack["lastid"] = js["lastid"];
+                sendFrame(clientfd, ack.dump());
+                continue;
+            }
+
+            if (REG_MSG_ACK == msgtype)
+            {
+                doRegResponse(js);
+                sem_post(&rwsem);    // 通知主线程，注册结果处理完成
+                continue;
+            }
         }
+    }
+}
+
+// 按帧格式发送一条消息：4字节网络字节序长度头 + json字符串
+int sendFrame(int clientfd, const string &msg)
+{
+    string frame(FRAME_HEADER_LEN, '\0');
+    uint32_t netlen = htonl(static_cast<uint32_t>(msg.size()));
+    memcpy(&frame[0], &netlen, FRAME_HEADER_LEN);
+    frame.append(msg);
 
-        if (REG_MSG_ACK == msgtype)
+    size_t sent = 0;
+    while (sent < frame.size())
+    {
+        int n = send(clientfd, frame.data() + sent, frame.size() - sent, 0);
+        if (-1 == n)
         {
-            doRegResponse(js);
-            sem_post(&rwsem);    // 通知主线程，注册结果处理完成
-            continue;
+            return -1;
         }
+        sent += n;
     }
+    return sent;
 }
 
 // 显示当前登录成功用户的基本信息
@@ -445,7 +544,7 @@ void addfriend(int clientfd, string str)
     js["friendid"] = friendid;
     string buffer = js.dump();
 
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendFrame(clientfd, buffer);
     if (-1 == len)
     {
         cerr << "send addfriend msg error -> " << buffer << endl;
@@ -471,9 +570,13 @@ void chat(int clientfd, string str)
     js["toid"] = friendid;
     js["msg"] = message;
     js["time"] = getCurrentTime();
-    string buffer = js.dump();
+    string buffer;
+    if (!g_useBinary || !jsonToBinChatMsg(js, buffer))
+    {
+        buffer = js.dump();
+    }
 
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendFrame(clientfd, buffer);
     if (-1 == len)
     {
         cerr << "send chat msg error -> " << buffer << endl;
@@ -499,7 +602,7 @@ void creategroup(int clientfd, string str)
     js["groupdesc"] = groupdesc;
     string buffer = js.dump();
 
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendFrame(clientfd, buffer);
     if (-1 == len)
     {
         cerr << "send creategroup msg error -> " << buffer << endl;
@@ -515,7 +618,7 @@ void addgroup(int clientfd, string str)
     js["groupid"] = groupid;
     string buffer = js.dump();
 
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendFrame(clientfd, buffer);
     if (-1 == len)
     {
         cerr << "send addgroup msg error -> " << buffer << endl;
@@ -541,9 +644,13 @@ void groupchat(int clientfd, string str)
     js["groupid"] = groupid;
     js["msg"] = message;
     js["time"] = getCurrentTime();
-    string buffer = js.dump();
+    string buffer;
+    if (!g_useBinary || !jsonToBinChatMsg(js, buffer))
+    {
+        buffer = js.dump();
+    }
 
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendFrame(clientfd, buffer);
     if (-1 == len)
     {
         cerr << "send groupchat msg error -> " << buffer << endl;
@@ -557,7 +664,7 @@ void loginout(int clientfd, string)
     js["id"] = g_currentUser.getId();
     string buffer = js.dump();
 
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendFrame(clientfd, buffer);
     if (-1 == len)
     {
         cerr << "send loginout msg error -> " << buffer << endl;
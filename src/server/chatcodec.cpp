@@ -0,0 +1,99 @@
+#include "chatcodec.hpp"
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <arpa/inet.h>
+
+ChatFrame::ChatFrame(const char *payload, size_t len)
+{
+    uint32_t netlen = htonl(static_cast<uint32_t>(len));
+    _buf.reserve(FRAME_HEADER_LEN + len);
+    _buf.append(reinterpret_cast<const char *>(&netlen), FRAME_HEADER_LEN);
+    _buf.append(payload, len);
+}
+
+ChatCodec::ChatCodec(const FrameCallback &cb, int maxFrameLen)
+    : _frameCallback(cb), _maxFrameLen(maxFrameLen)
+{
+}
+
+// 切出Buffer中所有完整的帧，半包留在Buffer里，下次数据到达时继续拼接
+void ChatCodec::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp time)
+{
+    while (buf->readableBytes() >= FRAME_HEADER_LEN)
+    {
+        const int32_t len = buf->peekInt32();
+        if (len < 0 || len > _maxFrameLen)
+        {
+            // 长度非法，无法再找到帧边界：丢弃已收到的数据并立即关闭连接，
+            // shutdown只关闭写端，对端不断开时连接和Buffer会一直保留
+            LOG_ERROR << "invalid frame length " << len << " from " << conn->peerAddress().toIpPort();
+            buf->retrieveAll();
+            conn->forceClose();
+            break;
+        }
+
+        if (buf->readableBytes() < static_cast<size_t>(FRAME_HEADER_LEN + len))
+        {
+            // 半包，等待后续数据
+            break;
+        }
+
+        buf->retrieve(FRAME_HEADER_LEN);
+        _frameCallback(conn, buf->peek(), len, time);
+        buf->retrieve(len);
+    }
+}
+
+void ChatCodec::send(const TcpConnectionPtr &conn, const string &msg)
+{
+    send(conn, msg.data(), msg.size());
+}
+
+void ChatCodec::send(const TcpConnectionPtr &conn, const char *data, size_t len)
+{
+    // 业务线程上发送，编码成帧后交给连接所属的EventLoop发送
+    if (!conn->getLoop()->isInLoopThread())
+    {
+        send(conn, encode(data, len));
+        return;
+    }
+
+    Buffer buf;
+    buf.append(data, len);
+    buf.prependInt32(static_cast<int32_t>(len));
+    conn->send(&buf);
+}
+
+// 发送已经写入Buffer的消息体
+void ChatCodec::send(const TcpConnectionPtr &conn, Buffer *body)
+{
+    body->prependInt32(static_cast<int32_t>(body->readableBytes()));
+    // 跨线程时TcpConnection::send会取出Buffer的内容转交给所属的EventLoop
+    conn->send(body);
+}
+
+ChatFramePtr ChatCodec::encode(const string &msg)
+{
+    return encode(msg.data(), msg.size());
+}
+
+ChatFramePtr ChatCodec::encode(const char *data, size_t len)
+{
+    return std::make_shared<const ChatFrame>(data, len);
+}
+
+void ChatCodec::send(const TcpConnectionPtr &conn, const ChatFramePtr &frame)
+{
+    EventLoop *loop = conn->getLoop();
+    if (loop->isInLoopThread())
+    {
+        conn->send(frame->data(), frame->size());
+    }
+    else
+    {
+        // TcpConnection::send跨线程时会把消息拷贝一份，这里改为只捕获共享帧的引用
+        loop->queueInLoop([conn, frame]() {
+            conn->send(frame->data(), frame->size());
+        });
+    }
+}
@@ -1,10 +1,12 @@
 #include "chatserver.hpp"
 #include "json.hpp"
 #include "chatservice.hpp"
+#include <muduo/base/Logging.h>
 
 #include <iostream>
 #include <functional>
 #include <string>
+#include <atomic>
 using namespace std;
 using namespace placeholders;
 using json = nlohmann::json;
@@ -13,50 +15,159 @@ using json = nlohmann::json;
 ChatServer::ChatServer(EventLoop *loop,
                        const InetAddress &listenAddr,
                        const string &nameArg)
-    : _server(loop, listenAddr, nameArg), _loop(loop)
+    : _server(loop, listenAddr, nameArg),
+      _codec(std::bind(&ChatServer::onMessage, this, _1, _2, _3, _4)),
+      _loop(loop),
+      _workerPool(8)
 {
     // 注册链接回调
     _server.setConnectionCallback(std::bind(&ChatServer::onConnection, this, _1));
 
-    // 注册消息回调
-    _server.setMessageCallback(std::bind(&ChatServer::onMessage, this, _1, _2, _3));
+    // 注册消息回调，先经过codec切帧，再把完整的消息交给onMessage
+    _server.setMessageCallback(std::bind(&ChatCodec::onMessage, &_codec, _1, _2, _3));
 
     // 设置线程数量
     _server.setThreadNum(4);
+
+    // 登记业务线程池，统计接口通过ChatService查询
+    ChatService::instance()->setWorkerPool(&_workerPool);
 }
 
 // 启动服务
 void ChatServer::start()
 {
+    _workerPool.start();
     _server.start();
 }
 
+// 单个连接在业务线程池中最多积压的任务数，达到后停止读该连接，积压降到CONN_RESUME_PENDING后恢复
+static const int CONN_PAUSE_PENDING = 64;
+static const int CONN_RESUME_PENDING = 16;
+
+// 取连接的分发key，同一连接的任务由同一个业务线程按顺序执行
+static size_t dispatchKey(const TcpConnectionPtr &conn)
+{
+    return boost::any_cast<const ConnContext &>(conn->getContext()).dispatchKey;
+}
+
+// 任务结束时减少连接的积压计数，积压降到恢复水位时恢复读取；
+// 放在析构函数中，处理函数抛异常（例如客户端发来字段类型不对的json）时也会执行，连接不会一直处于暂停状态
+struct FlowRelease
+{
+    const TcpConnectionPtr &conn;
+    ConnFlow &flow;
+
+    ~FlowRelease()
+    {
+        if (--flow.pending <= flow.resumeAt && flow.paused.exchange(false))
+        {
+            conn->startRead();
+        }
+    }
+};
+
+// 把会阻塞的处理交给业务线程池，I/O线程从不等待
+// 背压只作用在产生任务的连接上：暂停读取后内核接收缓冲区填满，由TCP流控让对端放慢
+void ChatServer::dispatch(const TcpConnectionPtr &conn, WorkerPool::Task task)
+{
+    const ConnContext &context = boost::any_cast<const ConnContext &>(conn->getContext());
+    shared_ptr<ConnFlow> flow = context.flow;
+    int pending = ++flow->pending;
+    bool queueOk = _workerPool.submit(context.dispatchKey, [conn, flow, task = std::move(task)]() {
+        FlowRelease release{conn, *flow};
+        task();
+    });
+
+    if ((pending >= CONN_PAUSE_PENDING || !queueOk) && !flow->paused.load())
+    {
+        // 连接自身积压过多时降到低水位再恢复；业务队列已满时，等该连接至少完成一个任务再恢复
+        flow->resumeAt = pending >= CONN_PAUSE_PENDING ? CONN_RESUME_PENDING : pending - 1;
+        flow->paused = true;
+        conn->stopRead();
+        // 业务线程可能在设置paused之前已经处理完了积压，此时不会再有任务来恢复读取
+        if (flow->pending <= flow->resumeAt && flow->paused.exchange(false))
+        {
+            conn->startRead();
+        }
+    }
+}
+
 // 上报链接相关信息的回调函数
 void ChatServer::onConnection(const TcpConnectionPtr &conn)
 {
+    // 新连接，初始化连接上下文
+    if (conn->connected())
+    {
+        // 连接按建立顺序轮流分配到业务线程
+        static atomic<size_t> nextKey{0};
+        ConnContext context;
+        context.dispatchKey = nextKey++;
+        context.flow = make_shared<ConnFlow>();
+        conn->setContext(context);
+    }
     // 客户端断开链接
-    if (!conn->connected())
+    else
     {
-        ChatService::instance()->clientCloseException(conn);
+        // 和该连接上的其它消息走同一个业务线程，保证在已提交的登录等处理之后执行；
+        // 清理任务不受背压限制，队列已满也要入队
+        _workerPool.submit(dispatchKey(conn), [conn]() {
+            ChatService::instance()->clientCloseException(conn);
+        });
         conn->shutdown();
     }
 }
 
-// 上报读写事件相关信息的回调函数
+// 上报一帧完整消息的回调函数
 void ChatServer::onMessage(const TcpConnectionPtr &conn,
-                           Buffer *buffer,
+                           const char *data,
+                           size_t len,
                            Timestamp time)
 {
-    string buf = buffer->retrieveAllAsString();
+    // 二进制格式的聊天消息，直接解码帧头分发，不构造json DOM
+    if (isBinaryFrame(data, len))
+    {
+        BinChatMsg msg;
+        if (!decodeBinChatMsg(data, len, msg))
+        {
+            LOG_ERROR << "invalid binary frame from " << conn->peerAddress().toIpPort();
+            return;
+        }
+        if (!ChatService::instance()->isBlockingMsg(msg.msgid))
+        {
+            ChatService::instance()->getBinHandler(msg.msgid)(conn, msg, time);
+            return;
+        }
 
-    // 测试，添加json打印代码
-    cout << buf << endl;
+        // msg只是输入Buffer上的视图，交给业务线程前拷贝一份帧
+        string frame(data, len);
+        dispatch(conn, [conn, frame, time]() {
+            BinChatMsg msg;
+            decodeBinChatMsg(frame.data(), frame.size(), msg);
+            ChatService::instance()->getBinHandler(msg.msgid)(conn, msg, time);
+        });
+        return;
+    }
 
-    // 数据的反序列化
-    json js = json::parse(buf);
+    // 数据的反序列化，直接在输入Buffer上解析，不额外拷贝成string
+    json js = json::parse(data, data + len, nullptr, false);
+    if (js.is_discarded() || !js.contains("msgid"))
+    {
+        LOG_ERROR << "invalid json frame from " << conn->peerAddress().toIpPort();
+        return;
+    }
     // 达到的目的：完全解耦网络模块的代码和业务模块的代码
     // 通过js["msgid"] 获取=》业务handler=》conn  js  time
-    auto msgHandler = ChatService::instance()->getHandler(js["msgid"].get<int>());
-    // 回调消息绑定好的事件处理器，来执行相应的业务处理
-    msgHandler(conn, js, time);
+    int msgid = js["msgid"].get<int>();
+    auto msgHandler = ChatService::instance()->getHandler(msgid);
+    if (!ChatService::instance()->isBlockingMsg(msgid))
+    {
+        // 回调消息绑定好的事件处理器，来执行相应的业务处理
+        msgHandler(conn, js, time);
+        return;
+    }
+
+    // 会阻塞的处理器交给业务线程池，I/O线程继续处理其它连接
+    dispatch(conn, [conn, js = std::move(js), msgHandler, time]() mutable {
+        msgHandler(conn, js, time);
+    });
 }
\ No newline at end of file
@@ -1,10 +1,87 @@
 #include "chatservice.hpp"
 #include "public.hpp"
+#include "chatcodec.hpp"
+#include "jsonwriter.hpp"
 #include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
 #include <vector>
+#include <algorithm>
+#include <cstring>
+#include <chrono>
+#include <condition_variable>
+#include <arpa/inet.h>
 using namespace std;
 using namespace muduo;
 
+// 离线消息每页最多的条数和字节数，一页之内的消息一次下发
+static const int OFFLINE_PAGE_MAX_MSGS = 100;
+static const size_t OFFLINE_PAGE_MAX_BYTES = 256 * 1024;
+// 不支持分页的旧客户端，离线消息随登录响应一次带上，每次登录最多带这么多条，其余下次登录再带
+static const int OFFLINE_LEGACY_MAX_MSGS = 1000;
+
+// 节点通道名
+static string nodeChannel(const string &nodeId)
+{
+    return "chat:node:" + nodeId;
+}
+
+// 节点stream名，消费组名固定，消费者名为节点id，重启后可以继续读取未确认的消息
+static string nodeStream(const string &nodeId)
+{
+    return "chat:stream:" + nodeId;
+}
+static const string NODE_STREAM_GROUP = "chatserver";
+
+// 用户信息缓存的失效通道，消息内容为"userid 节点id"，节点忽略自己发出的通知
+static const string USER_INVALIDATE_CHANNEL = "chat:user:invalidate";
+// 群成员缓存的失效通道，消息格式同上
+static const string GROUP_INVALIDATE_CHANNEL = "chat:group:invalidate";
+// 好友缓存的失效通道，消息格式同上
+static const string FRIEND_INVALIDATE_CHANNEL = "chat:friend:invalidate";
+
+/*
+节点通道上的消息格式，整数均为网络字节序：
+[4字节接收者个数n][n个4字节userid][json聊天消息]
+*/
+static string packNodeMsg(const vector<int> &useridVec, const string &msg)
+{
+    string out;
+    out.reserve(4 + 4 * useridVec.size() + msg.size());
+    uint32_t n = htonl(static_cast<uint32_t>(useridVec.size()));
+    out.append(reinterpret_cast<const char *>(&n), 4);
+    for (int id : useridVec)
+    {
+        uint32_t v = htonl(static_cast<uint32_t>(id));
+        out.append(reinterpret_cast<const char *>(&v), 4);
+    }
+    out.append(msg);
+    return out;
+}
+
+static bool unpackNodeMsg(const string &in, vector<int> &useridVec, string &msg)
+{
+    if (in.size() < 4)
+    {
+        return false;
+    }
+    uint32_t n = 0;
+    memcpy(&n, in.data(), 4);
+    n = ntohl(n);
+    if ((in.size() - 4) / 4 < n)
+    {
+        return false;
+    }
+    useridVec.reserve(n);
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        uint32_t v = 0;
+        memcpy(&v, in.data() + 4 + 4 * i, 4);
+        useridVec.push_back(static_cast<int>(ntohl(v)));
+    }
+    msg.assign(in, 4 + 4 * n, string::npos);
+    return true;
+}
+
 // 获取单例对象的接口函数
 ChatService *ChatService::instance()
 {
@@ -21,23 +98,97 @@ ChatService::ChatService()
     _msgHandlerMap.insert({REG_MSG, std::bind(&ChatService::reg, this, _1, _2, _3)});
     _msgHandlerMap.insert({ONE_CHAT_MSG, std::bind(&ChatService::oneChat, this, _1, _2, _3)});
     _msgHandlerMap.insert({ADD_FRIEND_MSG, std::bind(&ChatService::addFriend, this, _1, _2, _3)});
+    _msgHandlerMap.insert({OFFLINE_MSG_ACK, std::bind(&ChatService::offlineMsgAck, this, _1, _2, _3)});
 
     // 群组业务管理相关事件处理回调注册
     _msgHandlerMap.insert({CREATE_GROUP_MSG, std::bind(&ChatService::createGroup, this, _1, _2, _3)});
     _msgHandlerMap.insert({ADD_GROUP_MSG, std::bind(&ChatService::addGroup, this, _1, _2, _3)});
     _msgHandlerMap.insert({GROUP_CHAT_MSG, std::bind(&ChatService::groupChat, this, _1, _2, _3)});
+    _msgHandlerMap.insert({GROUP_MEMBERS_MSG, std::bind(&ChatService::groupMembers, this, _1, _2, _3)});
+
+    // 聊天热路径的二进制消息处理回调注册
+    _binMsgHandlerMap.insert({ONE_CHAT_MSG, std::bind(&ChatService::oneChatBin, this, _1, _2, _3)});
+    _binMsgHandlerMap.insert({GROUP_CHAT_MSG, std::bind(&ChatService::groupChatBin, this, _1, _2, _3)});
+
+    // 以上处理器都会访问MySQL或redis，不能在I/O线程上执行
+    _blockingMsgIds = {LOGIN_MSG, LOGINOUT_MSG, REG_MSG, ONE_CHAT_MSG, ADD_FRIEND_MSG, OFFLINE_MSG_ACK,
+                       CREATE_GROUP_MSG, ADD_GROUP_MSG, GROUP_CHAT_MSG, GROUP_MEMBERS_MSG};
 
     // 连接redis服务器
     if (_redis.connect())
     {
         // 设置上报消息的回调
-        _redis.init_notify_handler(std::bind(&ChatService::handleRedisSubscribeMessage, this, _1, _2));
+        _redis.init_notify_handler(std::bind(&ChatService::handleRedisSubscribeMessage, this, _1));
+        _redis.init_stream_handler(std::bind(&ChatService::handleRedisStreamMessage, this, _1));
+        _redis.init_reconnect_handler(std::bind(&ChatService::handleRedisReconnect, this));
+        _redisConnected = true;
+    }
+}
+
+// 订阅缓存的失效通道：本节点的修改以"key 节点id"广播，收到其它节点的通知时删除本地缓存
+template <typename Cache>
+void ChatService::subscribeInvalidate(const string &channel, Cache *cache)
+{
+    _redis.subscribe(channel);
+    cache->setInvalidateNotifier([this, channel](int key) {
+        _redis.publish(channel, to_string(key) + " " + _nodeId);
+    });
+    _invalidateHandlers[channel] = [cache](int key) {
+        cache->erase(key);
+    };
+}
+
+// 设置本节点id，并订阅本节点的通道，启动服务前调用
+void ChatService::setNodeId(const string &nodeId, bool useStream)
+{
+    _nodeId = nodeId;
+    _useStream = useStream;
+    if (_useStream)
+    {
+        _redis.startStreamConsumer(nodeStream(_nodeId), NODE_STREAM_GROUP, _nodeId);
+    }
+    else
+    {
+        _redis.subscribe(nodeChannel(_nodeId));
+    }
+    _redis.subscribe(PresenceService::invalidateChannel());
+    _presence.start(_nodeId);
+
+    // 本节点修改用户信息、群成员、好友关系后，通知其它节点删除对应的缓存
+    subscribeInvalidate(USER_INVALIDATE_CHANNEL, UserCache::instance());
+    subscribeInvalidate(GROUP_INVALIDATE_CHANNEL, GroupMemberCache::instance());
+    subscribeInvalidate(FRIEND_INVALIDATE_CHANNEL, FriendCache::instance());
+
+    // 所有通道登记完之后再启动订阅线程，由它在同一个连接上发送SUBSCRIBE
+    if (_redisConnected)
+    {
+        _redis.startSubscriber();
     }
 }
 
+// 停止后台线程，服务器退出时在reset之前调用
+void ChatService::stop()
+{
+    // 停止刷新本节点心跳，ChatService是静态单例，心跳线程不能留到静态析构阶段
+    _presence.stop();
+}
+
 // 服务器异常，业务重置方法
 void ChatService::reset()
 {
+    // 停止接收其它节点转发的消息
+    _redis.stopSubscriber();
+    _redis.stopStreamConsumer();
+
+    // 把队列中尚未写入的离线消息写入数据库
+    OfflineMsgWriter::instance()->flush();
+
+    // 清除本节点用户的在线位置，其它节点不再往本节点转发
+    for (int userid : _onlineRegistry.userids())
+    {
+        _presence.offline(userid);
+    }
+
     // 把online状态的用户，设置成offline
     _userModel.resetState();
 }
@@ -60,6 +211,185 @@ MsgHandler ChatService::getHandler(int msgid)
     }
 }
 
+// 获取二进制消息对应的处理器
+const BinMsgHandler &ChatService::getBinHandler(int msgid)
+{
+    static const BinMsgHandler defaultHandler = [](const TcpConnectionPtr &conn, const BinChatMsg &msg, Timestamp) {
+        LOG_ERROR << "binary msgid:" << msg.msgid << " can not find handler!";
+    };
+
+    auto it = _binMsgHandlerMap.find(msgid);
+    if (it == _binMsgHandlerMap.end())
+    {
+        return defaultHandler;
+    }
+    return it->second;
+}
+
+// 判断连接是否协商使用二进制格式
+bool ChatService::isBinaryConn(const TcpConnectionPtr &conn)
+{
+    const boost::any &context = conn->getContext();
+    if (context.empty())
+    {
+        return false;
+    }
+    return boost::any_cast<const ConnContext &>(context).binary;
+}
+
+// 按接收方连接协商的格式下发json聊天消息
+void ChatService::sendChatMsg(const TcpConnectionPtr &conn, const json &js)
+{
+    string bin;
+    if (isBinaryConn(conn) && jsonToBinChatMsg(js, bin))
+    {
+        ChatCodec::send(conn, bin);
+        return;
+    }
+    ChatCodec::send(conn, js.dump());
+}
+
+// 按接收方连接协商的格式下发二进制聊天消息
+void ChatService::sendChatMsg(const TcpConnectionPtr &conn, const BinChatMsg &msg)
+{
+    if (isBinaryConn(conn))
+    {
+        // 二进制连接直接转发原始帧，无需重新编码
+        ChatCodec::send(conn, msg.frame, msg.framelen);
+        return;
+    }
+    ChatCodec::send(conn, binChatMsgToJson(msg).dump());
+}
+
+// 登录响应（版本2），直接写入Buffer
+static void writeLoginAck(Buffer *buf, const User &user, const vector<FriendInfo> &friends,
+                          vector<Group> &groups, const unordered_set<int> &onlineSet, bool lazyMembers,
+                          const vector<string> &offlineMsgs)
+{
+    JsonWriter w(buf);
+    w.startObject()
+        .field("msgid", static_cast<int>(LOGIN_MSG_ACK))
+        .field("errno", 0)
+        .field("id", user.getId())
+        .field("name", user.getName());
+
+    if (!friends.empty())
+    {
+        w.key("friends").startArray();
+        for (const FriendInfo &info : friends)
+        {
+            w.startObject()
+                .field("id", info.id)
+                .field("name", info.name)
+                .field("state", onlineSet.count(info.id) ? "online" : "offline")
+                .endObject();
+        }
+        w.endArray();
+    }
+
+    if (!groups.empty())
+    {
+        w.key("groups").startArray();
+        for (Group &group : groups)
+        {
+            w.startObject()
+                .field("id", group.getId())
+                .field("groupname", group.getName())
+                .field("groupdesc", group.getDesc())
+                .field("membercount", group.getMemberCount());
+            if (!lazyMembers)
+            {
+                w.key("users").startArray();
+                for (GroupUser &member : group.getUsers())
+                {
+                    w.startObject()
+                        .field("id", member.getId())
+                        .field("name", member.getName())
+                        .field("state", onlineSet.count(member.getId()) ? "online" : "offline")
+                        .field("role", member.getRole())
+                        .endObject();
+                }
+                w.endArray();
+            }
+            w.endObject();
+        }
+        w.endArray();
+    }
+
+    if (!offlineMsgs.empty())
+    {
+        w.key("offlinemsg").startArray();
+        for (const string &msg : offlineMsgs)
+        {
+            w.value(msg);
+        }
+        w.endArray();
+    }
+    w.endObject();
+}
+
+// 登录响应（旧版本），数组元素是序列化后的json字符串
+static string legacyLoginAck(const User &user, const vector<FriendInfo> &friends,
+                             vector<Group> &groups, const unordered_set<int> &onlineSet, bool lazyMembers,
+                             const vector<string> &offlineMsgs)
+{
+    json response;
+    response["msgid"] = LOGIN_MSG_ACK;
+    response["errno"] = 0;
+    response["id"] = user.getId();
+    response["name"] = user.getName();
+
+    if (!friends.empty())
+    {
+        vector<string> vec2;
+        for (const FriendInfo &info : friends)
+        {
+            json js;
+            js["id"] = info.id;
+            js["name"] = info.name;
+            js["state"] = onlineSet.count(info.id) ? "online" : "offline";
+            vec2.push_back(js.dump());
+        }
+        response["friends"] = vec2;
+    }
+
+    if (!groups.empty())
+    {
+        // group:[{groupid:[xxx, xxx, xxx, xxx]}]
+        vector<string> groupV;
+        for (Group &group : groups)
+        {
+            json grpjson;
+            grpjson["id"] = group.getId();
+            grpjson["groupname"] = group.getName();
+            grpjson["groupdesc"] = group.getDesc();
+            grpjson["membercount"] = group.getMemberCount();
+            if (!lazyMembers)
+            {
+                vector<string> userV;
+                for (GroupUser &member : group.getUsers())
+                {
+                    json js;
+                    js["id"] = member.getId();
+                    js["name"] = member.getName();
+                    js["state"] = onlineSet.count(member.getId()) ? "online" : "offline";
+                    js["role"] = member.getRole();
+                    userV.push_back(js.dump());
+                }
+                grpjson["users"] = userV;
+            }
+            groupV.push_back(grpjson.dump());
+        }
+        response["groups"] = groupV;
+    }
+
+    if (!offlineMsgs.empty())
+    {
+        response["offlinemsg"] = offlineMsgs;
+    }
+    return response.dump();
+}
+
 // 处理登录业务  id  pwd   pwd
 void ChatService::login(const TcpConnectionPtr &conn, json &js, Timestamp time)
 {
@@ -69,90 +399,103 @@ void ChatService::login(const TcpConnectionPtr &conn, json &js, Timestamp time)
     User user = _userModel.query(id);
     if (user.getId() == id && user.getPwd() == pwd)
     {
-        if (user.getState() == "online")
+        // 在线状态以redis上的在线位置为准，不再查询MySQL的state字段；
+        // 指向本节点但本机没有连接的记录是上次异常退出的残留，视为不在线
+        string node = _presence.locate(id);
+        if (!node.empty() && (node != _nodeId || _onlineRegistry.find(id)))
         {
             // 该用户已经登录，不允许重复登录
             json response;
             response["msgid"] = LOGIN_MSG_ACK;
             response["errno"] = 2;
             response["errmsg"] = "this account is using, input another!";
-            conn->send(response.dump());
+            ChatCodec::send(conn, response.dump());
         }
         else
         {
-            // 登录成功，记录用户连接信息
+            // 客户端在登录请求中协商聊天消息的下发格式
+            if (js.value("wire", string()) == "binary")
             {
-                lock_guard<mutex> lock(_connMutex);
-                _userConnMap.insert({id, conn});
+                boost::any *context = conn->getMutableContext();
+                if (!context->empty())
+                {
+                    boost::any_cast<ConnContext>(context)->binary = true;
+                }
             }
 
-            // id用户登录成功后，向redis订阅channel(id)
-            _redis.subscribe(id); 
+            // 登录成功，记录用户连接信息
+            _onlineRegistry.add(id, conn);
 
-            // 登录成功，更新用户状态信息 state offline=>online
-            user.setState("online");
-            _userModel.updateState(user);
+            // id用户登录成功后，在redis中记录用户所在的节点，并通知其它节点失效本地缓存
+            _presence.online(id);
 
-            json response;
-            response["msgid"] = LOGIN_MSG_ACK;
-            response["errno"] = 0;
-            response["id"] = user.getId();
-            response["name"] = user.getName();
-            // 查询该用户是否有离线消息
-            vector<string> vec = _offlineMsgModel.query(id);
-            if (!vec.empty())
+            // 好友邻接表来自好友缓存，在线状态由在线状态服务叠加，不再使用数据库中的state
+            FriendListPtr friends = _friendModel.queryFriends(id);
+            bool lazyMembers = js.value("groupmembers", string()) == "lazy";
+            vector<Group> groupuserVec = lazyMembers ? _groupModel.queryGroupHeaders(id)
+                                                     : _groupModel.queryGroups(id);
+
+            // 好友和群成员的在线状态一次批量查询
+            vector<int> stateIds;
+            stateIds.reserve(friends->size());
+            for (const FriendInfo &info : *friends)
             {
-                response["offlinemsg"] = vec;
-                // 读取该用户的离线消息后，把该用户的所有离线消息删除掉
-                _offlineMsgModel.remove(id);
+                stateIds.push_back(info.id);
             }
-
-            // 查询该用户的好友信息并返回
-            vector<User> userVec = _friendModel.query(id);
-            if (!userVec.empty())
+            for (Group &group : groupuserVec)
             {
-                vector<string> vec2;
-                for (User &user : userVec)
+                for (GroupUser &user : group.getUsers())
                 {
-                    json js;
-                    js["id"] = user.getId();
-                    js["name"] = user.getName();
-                    js["state"] = user.getState();
-                    vec2.push_back(js.dump());
+                    stateIds.push_back(user.getId());
                 }
-                response["friends"] = vec2;
             }
+            unordered_set<int> onlineSet = queryOnline(stateIds);
 
-            // 查询用户的群组信息
-            vector<Group> groupuserVec = _groupModel.queryGroups(id);
-            if (!groupuserVec.empty())
+            /*
+            离线消息的下发方式由请求中的offlinever协商：
+            2    登录响应之后用OFFLINE_MSG_PAGE分页下发，客户端逐页确认后删除
+            缺省 旧方式，随登录响应的offlinemsg字段一次带上，发送后按id删除，兼容不会确认的老客户端
+            */
+            bool pagedOffline = js.value("offlinever", 1) >= 2;
+            // 异步写入器中还有发给该用户的离线消息时，先等待它们提交；没有时不等待，登录不承担攒批的时间窗口
+            OfflineMsgWriter::instance()->flushUser(id);
+            vector<string> offlineMsgs;
+            long long offlineMaxId = 0;
+            if (!pagedOffline)
             {
-                // group:[{groupid:[xxx, xxx, xxx, xxx]}]
-                vector<string> groupV;
-                for (Group &group : groupuserVec)
+                for (auto &row : _offlineMsgModel.query(id, 0, OFFLINE_LEGACY_MAX_MSGS))
                 {
-                    json grpjson;
-                    grpjson["id"] = group.getId();
-                    grpjson["groupname"] = group.getName();
-                    grpjson["groupdesc"] = group.getDesc();
-                    vector<string> userV;
-                    for (GroupUser &user : group.getUsers())
-                    {
-                        json js;
-                        js["id"] = user.getId();
-                        js["name"] = user.getName();
-                        js["state"] = user.getState();
-                        js["role"] = user.getRole();
-                        userV.push_back(js.dump());
-                    }
-                    grpjson["users"] = userV;
-                    groupV.push_back(grpjson.dump());
+                    offlineMaxId = row.first;
+                    offlineMsgs.push_back(std::move(row.second));
                 }
+            }
 
-                response["groups"] = groupV;
+            /*
+            登录响应的版本由请求中的loginver协商：
+            2    friends/groups/users是对象数组，由JsonWriter直接写入发送Buffer，不构造json DOM
+            缺省 旧格式，数组元素是序列化后的json字符串，兼容老客户端
+            */
+            if (js.value("loginver", 1) >= 2)
+            {
+                Buffer buf;
+                writeLoginAck(&buf, user, *friends, groupuserVec, onlineSet, lazyMembers, offlineMsgs);
+                ChatCodec::send(conn, &buf);
+            }
+            else
+            {
+                ChatCodec::send(conn, legacyLoginAck(user, *friends, groupuserVec, onlineSet, lazyMembers, offlineMsgs));
             }
 
-            conn->send(response.dump());
+            if (pagedOffline)
+            {
+                // 登录响应之后再分页下发离线消息
+                sendOfflineMsgPage(conn, id, 0);
+            }
+            else if (!offlineMsgs.empty())
+            {
+                // 只删除已经随响应带上的部分，查询之后新写入的离线消息留到下次
+                _offlineMsgModel.remove(id, offlineMaxId);
+            }
         }
     }
     else
@@ -162,7 +505,7 @@ void ChatService::login(const TcpConnectionPtr &conn, json &js, Timestamp time)
         response["msgid"] = LOGIN_MSG_ACK;
         response["errno"] = 1;
         response["errmsg"] = "id or password is invalid!";
-        conn->send(response.dump());
+        ChatCodec::send(conn, response.dump());
     }
 }
 
@@ -183,7 +526,7 @@ void ChatService::reg(const TcpConnectionPtr &conn, json &js, Timestamp time)
         response["msgid"] = REG_MSG_ACK;
         response["errno"] = 0;
         response["id"] = user.getId();
-        conn->send(response.dump());
+        ChatCodec::send(conn, response.dump());
     }
     else
     {
@@ -191,58 +534,87 @@ void ChatService::reg(const TcpConnectionPtr &conn, json &js, Timestamp time)
         json response;
         response["msgid"] = REG_MSG_ACK;
         response["errno"] = 1;
-        conn->send(response.dump());
+        ChatCodec::send(conn, response.dump());
     }
 }
 
-// 处理注销业务
-void ChatService::loginout(const TcpConnectionPtr &conn, json &js, Timestamp time)
+/*
+离线消息分页下发
+1. 每页最多OFFLINE_PAGE_MAX_MSGS条、OFFLINE_PAGE_MAX_BYTES字节，积压再多也不会生成超大的帧
+2. 客户端收到一页后回复OFFLINE_MSG_ACK，服务器才下发下一页，同一连接上最多只有一页在途，
+   慢客户端不会让服务器的输出缓冲区无限增长
+3. 按id游标读取、按id范围删除，只删除客户端已确认的消息，读取之后新写入的离线消息不会丢失
+*/
+void ChatService::sendOfflineMsgPage(const TcpConnectionPtr &conn, int userid, long long afterId)
 {
-    int userid = js["id"].get<int>();
+    vector<pair<long long, string>> rows = _offlineMsgModel.query(userid, afterId, OFFLINE_PAGE_MAX_MSGS);
+    if (rows.empty())
+    {
+        return;
+    }
 
+    json page;
+    page["msgid"] = OFFLINE_MSG_PAGE;
+    json &msgs = page["offlinemsg"] = json::array();
+    long long lastid = afterId;
+    size_t bytes = 0;
+    for (auto &row : rows)
     {
-        lock_guard<mutex> lock(_connMutex);
-        auto it = _userConnMap.find(userid);
-        if (it != _userConnMap.end())
+        // 至少下发一条，保证超大的单条消息也能被确认和删除
+        if (!msgs.empty() && bytes + row.second.size() > OFFLINE_PAGE_MAX_BYTES)
         {
-            _userConnMap.erase(it);
+            break;
         }
+        bytes += row.second.size();
+        lastid = row.first;
+        msgs.push_back(std::move(row.second));
+    }
+    page["lastid"] = lastid;
+    ChatCodec::send(conn, page.dump());
+}
+
+// 离线消息分页确认，删除已确认的部分并下发下一页  msgid lastid
+void ChatService::offlineMsgAck(const TcpConnectionPtr &conn, json &js, Timestamp time)
+{
+    // 用户id以连接上登录的用户为准，不信任客户端上报的id
+    const boost::any &context = conn->getContext();
+    if (context.empty())
+    {
+        return;
+    }
+    int userid = boost::any_cast<const ConnContext &>(context).userid;
+    if (userid == -1 || !js.contains("lastid"))
+    {
+        return;
     }
 
-    // 用户注销，相当于就是下线，在redis中取消订阅通道
-    _redis.unsubscribe(userid); 
+    long long lastid = js["lastid"].get<long long>();
+    _offlineMsgModel.remove(userid, lastid);
+    sendOfflineMsgPage(conn, userid, lastid);
+}
+
+// 处理注销业务
+void ChatService::loginout(const TcpConnectionPtr &conn, json &js, Timestamp time)
+{
+    int userid = js["id"].get<int>();
+
+    _onlineRegistry.remove(userid);
 
-    // 更新用户的状态信息
-    User user(userid, "", "", "offline");
-    _userModel.updateState(user);
+    // 用户注销，相当于就是下线，在redis中删除用户的在线位置
+    _presence.offline(userid);
 }
 
 // 处理客户端异常退出
 void ChatService::clientCloseException(const TcpConnectionPtr &conn)
 {
+    // 通过连接上下文反查用户，并删除用户的链接信息
     User user;
-    {
-        lock_guard<mutex> lock(_connMutex);
-        for (auto it = _userConnMap.begin(); it != _userConnMap.end(); ++it)
-        {
-            if (it->second == conn)
-            {
-                // 从map表删除用户的链接信息
-                user.setId(it->first);
-                _userConnMap.erase(it);
-                break;
-            }
-        }
-    }
-
-    // 用户注销，相当于就是下线，在redis中取消订阅通道
-    _redis.unsubscribe(user.getId()); 
+    user.setId(_onlineRegistry.remove(conn));
 
-    // 更新用户的状态信息
     if (user.getId() != -1)
     {
-        user.setState("offline");
-        _userModel.updateState(user);
+        // 用户注销，相当于就是下线，在redis中删除用户的在线位置
+        _presence.offline(user.getId());
     }
 }
 
@@ -251,27 +623,16 @@ void ChatService::oneChat(const TcpConnectionPtr &conn, json &js, Timestamp time
 {
     int toid = js["toid"].get<int>();
 
+    TcpConnectionPtr toConn = _onlineRegistry.find(toid);
+    if (toConn)
     {
-        lock_guard<mutex> lock(_connMutex);
-        auto it = _userConnMap.find(toid);
-        if (it != _userConnMap.end())
-        {
-            // toid在线，转发消息   服务器主动推送消息给toid用户
-            it->second->send(js.dump());
-            return;
-        }
-    }
-
-    // 查询toid是否在线 
-    User user = _userModel.query(toid);
-    if (user.getState() == "online")
-    {
-        _redis.publish(toid, js.dump());
+        // toid在线，转发消息   服务器主动推送消息给toid用户
+        sendChatMsg(toConn, js);
         return;
     }
 
-    // toid不在线，存储离线消息
-    _offlineMsgModel.insert(toid, js.dump());
+    // toid不在本机，转发到所在节点或存储离线消息
+    routeRemote({toid}, make_shared<const string>(js.dump()));
 }
 
 // 添加好友业务 msgid id friendid
@@ -308,50 +669,359 @@ void ChatService::addGroup(const TcpConnectionPtr &conn, json &js, Timestamp tim
     _groupModel.addGroup(userid, groupid, "normal");
 }
 
+// 查询群组成员业务  msgid groupid
+void ChatService::groupMembers(const TcpConnectionPtr &conn, json &js, Timestamp time)
+{
+    const boost::any &context = conn->getContext();
+    int userid = context.empty() ? -1 : boost::any_cast<const ConnContext &>(context).userid;
+    int groupid = js["groupid"].get<int>();
+
+    json response;
+    response["msgid"] = GROUP_MEMBERS_MSG_ACK;
+    response["groupid"] = groupid;
+
+    // 只有群组成员才能查询成员列表
+    vector<GroupUser> users = _groupModel.queryGroupUsers(groupid);
+    vector<int> memberIds;
+    for (GroupUser &user : users)
+    {
+        memberIds.push_back(user.getId());
+    }
+    unordered_set<int> onlineSet = queryOnline(memberIds);
+    bool isMember = false;
+    vector<string> userV;
+    for (GroupUser &user : users)
+    {
+        isMember = isMember || user.getId() == userid;
+        json ujs;
+        ujs["id"] = user.getId();
+        ujs["name"] = user.getName();
+        ujs["state"] = onlineSet.count(user.getId()) ? "online" : "offline";
+        ujs["role"] = user.getRole();
+        userV.push_back(ujs.dump());
+    }
+
+    if (!isMember)
+    {
+        response["errno"] = 1;
+        response["errmsg"] = "not a member of this group!";
+    }
+    else
+    {
+        response["errno"] = 0;
+        response["users"] = userV;
+    }
+    ChatCodec::send(conn, response.dump());
+}
+
 // 群组聊天业务
 void ChatService::groupChat(const TcpConnectionPtr &conn, json &js, Timestamp time)
 {
     int userid = js["id"].get<int>();
     int groupid = js["groupid"].get<int>();
-    vector<int> useridVec = _groupModel.queryGroupUsers(userid, groupid);
+    // 成员快照来自群成员缓存，扇出期间直接遍历，不复制也不加锁
+    GroupMembersPtr members = _groupModel.queryGroupMembers(groupid);
+    if (!members)
+    {
+        return;
+    }
+
+    fanoutGroupMsg(members->ids, userid,
+        [&js]() { return ChatCodec::encode(js.dump()); },
+        [&js]() {
+            string bin;
+            jsonToBinChatMsg(js, bin);
+            return ChatCodec::encode(bin);
+        });
+}
 
-    lock_guard<mutex> lock(_connMutex);
+// 发给本机在线的用户（跳过exceptId），返回不在本机的用户
+vector<int> ChatService::deliverLocal(const vector<int> &useridVec, int exceptId, LazyFrames &frames)
+{
+    vector<int> remoteVec;
     for (int id : useridVec)
     {
-        auto it = _userConnMap.find(id);
-        if (it != _userConnMap.end())
+        if (id == exceptId)
+        {
+            continue;
+        }
+        TcpConnectionPtr toConn = _onlineRegistry.find(id);
+        if (!toConn)
+        {
+            remoteVec.push_back(id);
+            continue;
+        }
+
+        // 每个接收者只增加一次共享帧的引用计数
+        if (isBinaryConn(toConn))
         {
-            // 转发群消息
-            it->second->send(js.dump());
+            ChatCodec::send(toConn, frames.binFrame());
         }
         else
         {
-            // 查询toid是否在线 
-            User user = _userModel.query(id);
-            if (user.getState() == "online")
-            {
-                _redis.publish(id, js.dump());
-            }
-            else
+            ChatCodec::send(toConn, frames.jsonFrame());
+        }
+    }
+    return remoteVec;
+}
+
+// 发给不在本机的用户：按在线位置表合并到目标节点，每个节点publish一次，不在线的存储离线消息
+void ChatService::routeRemote(const vector<int> &useridVec, const shared_ptr<const string> &payload)
+{
+    // 先查本地近端缓存，未命中的接收者一次HMGET查出所在的节点
+    vector<string> nodes = _presence.locate(useridVec);
+    unordered_map<string, vector<int>> nodeUsers;
+    vector<int> offlineVec;
+    for (size_t i = 0; i < useridVec.size(); ++i)
+    {
+        // 调用方已经确认接收者不在本机，指向本节点的位置是过期数据
+        if (nodes[i].empty() || nodes[i] == _nodeId)
+        {
+            offlineVec.push_back(useridVec[i]);
+        }
+        else
+        {
+            nodeUsers[nodes[i]].push_back(useridVec[i]);
+        }
+    }
+
+    for (auto &kv : nodeUsers)
+    {
+        auto packed = make_shared<const string>(packNodeMsg(kv.second, *payload));
+        if (_useStream)
+        {
+            _redis.appendStream(nodeStream(kv.first), packed);
+        }
+        else
+        {
+            _redis.publish(nodeChannel(kv.first), packed);
+        }
+    }
+    _nodePublishCnt += nodeUsers.size();
+
+    // 存储离线消息，所有离线用户共享一份消息内容，由写入器批量提交
+    if (!offlineVec.empty())
+    {
+        OfflineMsgWriter::instance()->append(offlineVec, *payload);
+    }
+}
+
+// 批量查询用户是否在线，本机注册表优先，其余查在线状态服务
+unordered_set<int> ChatService::queryOnline(const vector<int> &useridVec)
+{
+    unordered_set<int> onlineSet;
+    vector<int> remoteVec;
+    for (int id : useridVec)
+    {
+        if (_onlineRegistry.find(id))
+        {
+            onlineSet.insert(id);
+        }
+        else
+        {
+            remoteVec.push_back(id);
+        }
+    }
+
+    if (!remoteVec.empty())
+    {
+        vector<string> nodes = _presence.locate(remoteVec);
+        for (size_t i = 0; i < remoteVec.size(); ++i)
+        {
+            if (!nodes[i].empty() && nodes[i] != _nodeId)
             {
-                // 存储离线群消息
-                _offlineMsgModel.insert(id, js.dump());
+                onlineSet.insert(remoteVec[i]);
             }
         }
     }
+    return onlineSet;
+}
+
+// 群聊扇出：消息对每种格式只序列化一次，所有接收者共享同一份不可变的帧
+void ChatService::fanoutGroupMsg(const vector<int> &useridVec, int exceptId,
+                                 const function<ChatFramePtr()> &makeJsonFrame,
+                                 const function<ChatFramePtr()> &makeBinFrame)
+{
+    LazyFrames frames{makeJsonFrame, makeBinFrame};
+    vector<int> remoteVec = deliverLocal(useridVec, exceptId, frames);
+
+    // 不在本机的成员，按所在节点合并转发，跨N个节点只需要N次publish
+    if (!remoteVec.empty())
+    {
+        const ChatFramePtr &jsonFrame = frames.jsonFrame();
+        routeRemote(remoteVec, make_shared<const string>(jsonFrame->payload(), jsonFrame->payloadSize()));
+    }
+
+    _fanoutRecipients += useridVec.size() - count(useridVec.begin(), useridVec.end(), exceptId);
+    _fanoutEncodedBytes += (frames.json ? frames.json->size() : 0) + (frames.bin ? frames.bin->size() : 0);
+}
+
+// 一对一聊天业务（二进制格式），不构造json DOM
+void ChatService::oneChatBin(const TcpConnectionPtr &conn, const BinChatMsg &msg, Timestamp time)
+{
+    TcpConnectionPtr toConn = _onlineRegistry.find(msg.toid);
+    if (toConn)
+    {
+        // toid在线，转发消息
+        sendChatMsg(toConn, msg);
+        return;
+    }
+
+    // 跨服务器转发和离线存储仍然使用json格式
+    routeRemote({msg.toid}, make_shared<const string>(binChatMsgToJson(msg).dump()));
 }
 
-// 从redis消息队列中获取订阅的消息
-void ChatService::handleRedisSubscribeMessage(int userid, string msg)
+// 群组聊天业务（二进制格式），toid字段为groupid
+void ChatService::groupChatBin(const TcpConnectionPtr &conn, const BinChatMsg &msg, Timestamp time)
 {
-    lock_guard<mutex> lock(_connMutex);
-    auto it = _userConnMap.find(userid);
-    if (it != _userConnMap.end())
+    GroupMembersPtr members = _groupModel.queryGroupMembers(msg.toid);
+    if (!members)
     {
-        it->second->send(msg);
         return;
     }
 
-    // 存储该用户的离线消息
-    _offlineMsgModel.insert(userid, msg);
-}
\ No newline at end of file
+    fanoutGroupMsg(members->ids, msg.id,
+        [&msg]() { return ChatCodec::encode(binChatMsgToJson(msg).dump()); },
+        [&msg]() { return ChatCodec::encode(msg.frame, msg.framelen); });
+}
+
+// stream消息的投递进度，每个EventLoop上的发送任务执行完减一
+struct ChatService::DeliveryLatch
+{
+    mutex mtx;
+    condition_variable cv;
+    size_t remaining = 0;
+};
+
+// 等待一批stream消息交给连接发送的最长时间，超时不确认，由stream消费者稍后重新投递
+static const chrono::seconds STREAM_DELIVER_TIMEOUT(3);
+
+// 从redis订阅通道批量获取消息，运行在redis订阅线程上
+void ChatService::handleRedisSubscribeMessage(const RedisMessageBatch &batch)
+{
+    dispatchRedisBatch(batch, nullptr);
+}
+
+// 从本节点的stream批量获取消息，运行在stream消费线程上
+// 等到各EventLoop上的TcpConnection::send都执行过才返回true，stream消费者随后XACK整批
+bool ChatService::handleRedisStreamMessage(const RedisMessageBatch &batch)
+{
+    auto latch = make_shared<DeliveryLatch>();
+    dispatchRedisBatch(batch, latch);
+
+    unique_lock<mutex> lock(latch->mtx);
+    if (!latch->cv.wait_for(lock, STREAM_DELIVER_TIMEOUT, [&latch]() { return latch->remaining == 0; }))
+    {
+        LOG_WARN << "stream batch not delivered in time, " << latch->remaining << " event loops pending";
+        return false;
+    }
+    return true;
+}
+
+/*
+同一批消息的所有接收者按连接所属的EventLoop分组，每个loop只queueInLoop一次，
+减少跨线程唤醒；帧对每条消息每种格式只编码一次
+latch不为空时，每个loop的发送任务执行完后计数减一
+*/
+void ChatService::dispatchRedisBatch(const RedisMessageBatch &batch, const shared_ptr<DeliveryLatch> &latch)
+{
+    unordered_map<EventLoop *, vector<pair<TcpConnectionPtr, ChatFramePtr>>> loopSends;
+    for (const auto &item : batch)
+    {
+        // 其它节点上用户上下线，删除本地的在线位置缓存
+        if (item.first == PresenceService::invalidateChannel())
+        {
+            _presence.invalidate(atoi(item.second.c_str()));
+            continue;
+        }
+        // 其它节点修改了数据，删除本地缓存
+        auto invalidate = _invalidateHandlers.find(item.first);
+        if (invalidate != _invalidateHandlers.end())
+        {
+            size_t pos = item.second.find(' ');
+            if (pos != string::npos && item.second.compare(pos + 1, string::npos, _nodeId) != 0)
+            {
+                invalidate->second(atoi(item.second.c_str()));
+            }
+            continue;
+        }
+
+        vector<int> useridVec;
+        string payload;
+        if (!unpackNodeMsg(item.second, useridVec, payload))
+        {
+            LOG_ERROR << "invalid node message on channel " << item.first;
+            continue;
+        }
+
+        // redis上转发的都是json格式，二进制连接需要转换
+        LazyFrames frames{
+            [&payload]() { return ChatCodec::encode(payload); },
+            [&payload]() {
+                string bin;
+                json js = json::parse(payload, nullptr, false);
+                if (js.is_discarded() || !jsonToBinChatMsg(js, bin))
+                {
+                    return ChatCodec::encode(payload);
+                }
+                return ChatCodec::encode(bin);
+            }};
+
+        vector<int> offlineVec;
+        for (int id : useridVec)
+        {
+            TcpConnectionPtr conn = _onlineRegistry.find(id);
+            if (!conn)
+            {
+                offlineVec.push_back(id);
+                continue;
+            }
+            loopSends[conn->getLoop()].emplace_back(conn, isBinaryConn(conn) ? frames.binFrame() : frames.jsonFrame());
+        }
+
+        // 转发过程中已经下线的用户，存储离线消息，不再二次转发
+        if (!offlineVec.empty())
+        {
+            OfflineMsgWriter::instance()->append(offlineVec, payload);
+        }
+    }
+
+    if (latch)
+    {
+        lock_guard<mutex> lock(latch->mtx);
+        latch->remaining = loopSends.size();
+    }
+    for (auto &kv : loopSends)
+    {
+        auto sends = make_shared<vector<pair<TcpConnectionPtr, ChatFramePtr>>>(std::move(kv.second));
+        kv.first->queueInLoop([sends, latch]() {
+            for (auto &send : *sends)
+            {
+                send.first->send(send.second->data(), send.second->size());
+            }
+            if (latch)
+            {
+                lock_guard<mutex> lock(latch->mtx);
+                if (--latch->remaining == 0)
+                {
+                    latch->cv.notify_one();
+                }
+            }
+        });
+    }
+
+    ++_subscribeBatchCnt;
+    _subscribeLoopPosts += loopSends.size();
+}
+
+// redis订阅连接重连成功，redis可能已经重启，重新登记本节点的在线用户
+void ChatService::handleRedisReconnect()
+{
+    vector<int> userids = _onlineRegistry.userids();
+    _presence.replay(userids);
+    // 断开期间的用户、群成员和好友缓存的失效通知已经丢失
+    UserCache::instance()->clear();
+    GroupMemberCache::instance()->clear();
+    FriendCache::instance()->clear();
+    LOG_INFO << "redis reconnected, replayed presence of " << userids.size() << " users";
+}
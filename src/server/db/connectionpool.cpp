@@ -0,0 +1,260 @@
+#include "connectionpool.h"
+#include <muduo/base/Logging.h>
+#include <muduo/net/EventLoop.h>
+#include <thread>
+#include <vector>
+
+// 当前线程缓存的连接，只在该线程内借出和归还，不需要加锁
+static thread_local MySQL *t_cachedConn = nullptr;
+// 当前线程是否允许缓存连接，业务线程通过enableThreadCache打开
+static thread_local bool t_cacheEnabled = false;
+
+// 获取连接池单例对象
+ConnectionPool *ConnectionPool::instance()
+{
+    static ConnectionPool pool;
+    return &pool;
+}
+
+ConnectionPool::ConnectionPool()
+    : _initSize(4),
+      _maxSize(32),
+      _maxIdleTime(60),
+      _pingIdleTime(30),
+      _connectionTimeout(500)
+{
+    for (int i = 0; i < _initSize; ++i)
+    {
+        MySQL *conn = createConnection();
+        if (conn != nullptr)
+        {
+            _connectionQue.push(conn);
+            ++_connectionCnt;
+        }
+    }
+
+    // 在单独的线程中做空闲连接的健康检查和回收
+    _scanner = thread(std::bind(&ConnectionPool::scannerConnectionTask, this));
+}
+
+ConnectionPool::~ConnectionPool()
+{
+    stop();
+    // 关闭公共队列中的空闲连接，线程缓存的连接随进程退出
+    lock_guard<mutex> lock(_queueMutex);
+    while (!_connectionQue.empty())
+    {
+        delete _connectionQue.front();
+        _connectionQue.pop();
+    }
+}
+
+// 停止健康检查线程并等待其退出
+void ConnectionPool::stop()
+{
+    {
+        lock_guard<mutex> lock(_stopMutex);
+        _stopping = true;
+    }
+    _stopCond.notify_all();
+    if (_scanner.joinable())
+    {
+        _scanner.join();
+    }
+}
+
+// 创建一个新连接，失败返回nullptr
+MySQL *ConnectionPool::createConnection()
+{
+    MySQL *conn = new MySQL();
+    if (!conn->connect())
+    {
+        delete conn;
+        return nullptr;
+    }
+    conn->refreshAliveTime();
+    return conn;
+}
+
+// 关闭连接，空出的名额可以创建新连接，唤醒等待的线程
+void ConnectionPool::destroyConnection(MySQL *conn)
+{
+    delete conn;
+    {
+        lock_guard<mutex> lock(_queueMutex);
+        --_connectionCnt;
+    }
+    _cv.notify_one();
+}
+
+// 检查连接是否可用，空闲时间较长的连接才真正ping一次
+bool ConnectionPool::checkConnection(MySQL *conn)
+{
+    if (conn->getIdleTime() < _pingIdleTime)
+    {
+        return true;
+    }
+    return conn->ping();
+}
+
+// 从连接池获取一个可用连接
+shared_ptr<MySQL> ConnectionPool::getConnection()
+{
+    MySQL *conn = nullptr;
+
+    // 1.优先使用当前I/O线程缓存的连接
+    if (t_cachedConn != nullptr)
+    {
+        conn = t_cachedConn;
+        t_cachedConn = nullptr;
+        if (!checkConnection(conn))
+        {
+            destroyConnection(conn);
+            conn = nullptr;
+        }
+    }
+
+    // 2.从公共队列中获取，连接数未达上限时直接创建新连接
+    while (conn == nullptr)
+    {
+        unique_lock<mutex> lock(_queueMutex);
+        if (_connectionQue.empty())
+        {
+            if (_connectionCnt < _maxSize)
+            {
+                // 在锁内先占用名额再到锁外建立连接，并发的线程不会一起越过上限
+                ++_connectionCnt;
+                lock.unlock();
+                conn = createConnection();
+                if (conn == nullptr)
+                {
+                    lock.lock();
+                    --_connectionCnt;
+                    lock.unlock();
+                    _cv.notify_one();
+                    return nullptr;
+                }
+                break;
+            }
+
+            // 连接数已达上限，有界等待其它线程归还连接或空出名额
+            if (!_cv.wait_for(lock, _connectionTimeout,
+                              [this]() { return !_connectionQue.empty() || _connectionCnt < _maxSize; }))
+            {
+                ++_timeoutCnt;
+                LOG_ERROR << "get mysql connection timeout!";
+                return nullptr;
+            }
+            if (_connectionQue.empty())
+            {
+                // 空出了名额，回到循环开头创建新连接
+                continue;
+            }
+        }
+
+        conn = _connectionQue.front();
+        _connectionQue.pop();
+        lock.unlock();
+
+        if (!checkConnection(conn))
+        {
+            destroyConnection(conn);
+            conn = nullptr;
+        }
+    }
+
+    // 自定义删除器，智能指针析构时把连接归还到连接池，而不是关闭连接
+    return shared_ptr<MySQL>(conn, [this](MySQL *p) { releaseConnection(p); });
+}
+
+// 允许当前线程缓存一个连接
+void ConnectionPool::enableThreadCache()
+{
+    t_cacheEnabled = true;
+}
+
+// 归还连接，优先放回当前线程的缓存
+void ConnectionPool::releaseConnection(MySQL *conn)
+{
+    conn->refreshAliveTime();
+
+    // 只有muduo的I/O线程和业务线程才缓存连接，避免临时线程长期占用连接
+    if (t_cachedConn == nullptr
+        && (t_cacheEnabled || muduo::net::EventLoop::getEventLoopOfCurrentThread() != nullptr))
+    {
+        t_cachedConn = conn;
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(_queueMutex);
+        _connectionQue.push(conn);
+    }
+    _cv.notify_one();
+}
+
+// 公共队列中的空闲连接数
+int ConnectionPool::getIdleCount()
+{
+    lock_guard<mutex> lock(_queueMutex);
+    return _connectionQue.size();
+}
+
+// 后台健康检查线程
+void ConnectionPool::scannerConnectionTask()
+{
+    unique_lock<mutex> stopLock(_stopMutex);
+    while (!_stopCond.wait_for(stopLock, _pingIdleTime, [this]() { return _stopping; }))
+    {
+        stopLock.unlock();
+
+        // 只取出空闲较久、需要检查的连接，在锁外做ping，避免阻塞获取连接的线程
+        vector<MySQL *> idleVec;
+        {
+            lock_guard<mutex> lock(_queueMutex);
+            size_t n = _connectionQue.size();
+            for (size_t i = 0; i < n; ++i)
+            {
+                MySQL *conn = _connectionQue.front();
+                _connectionQue.pop();
+                if (conn->getIdleTime() >= _pingIdleTime)
+                {
+                    idleVec.push_back(conn);
+                }
+                else
+                {
+                    _connectionQue.push(conn);
+                }
+            }
+        }
+
+        vector<MySQL *> aliveVec;
+        for (MySQL *conn : idleVec)
+        {
+            // 超过最大空闲时间的多余连接直接回收
+            if (conn->getIdleTime() >= _maxIdleTime && _connectionCnt > _initSize)
+            {
+                destroyConnection(conn);
+            }
+            else if (!checkConnection(conn))
+            {
+                LOG_INFO << "mysql connection lost, destroy it";
+                destroyConnection(conn);
+            }
+            else
+            {
+                aliveVec.push_back(conn);
+            }
+        }
+
+        {
+            lock_guard<mutex> lock(_queueMutex);
+            for (MySQL *conn : aliveVec)
+            {
+                _connectionQue.push(conn);
+            }
+        }
+        _cv.notify_all();
+        stopLock.lock();
+    }
+}
@@ -11,11 +11,14 @@ static string dbname = "chat";
 MySQL::MySQL()
 {
     _conn = mysql_init(nullptr);
+    refreshAliveTime();
 }
 
 // 释放数据库连接资源
 MySQL::~MySQL()
 {
+    // 预处理语句依赖连接，必须在关闭连接之前释放
+    _stmtCache.clear();
     if (_conn != nullptr)
         mysql_close(_conn);
 }
@@ -69,4 +72,30 @@ MYSQL_RES *MySQL::query(string sql)
 MYSQL* MySQL::getConnection()
 {
     return _conn;
-}
\ No newline at end of file
+}
+
+// 检查连接是否可用
+bool MySQL::ping()
+{
+    return mysql_ping(_conn) == 0;
+}
+
+// 获取预处理语句，同一条SQL在该连接上只解析一次，之后直接复用
+PreparedStatement *MySQL::prepare(const string &sql)
+{
+    auto it = _stmtCache.find(sql);
+    if (it != _stmtCache.end())
+    {
+        it->second->reset();
+        return it->second.get();
+    }
+
+    unique_ptr<PreparedStatement> stmt(new PreparedStatement(_conn));
+    if (!stmt->prepare(sql))
+    {
+        return nullptr;
+    }
+    PreparedStatement *p = stmt.get();
+    _stmtCache.emplace(sql, std::move(stmt));
+    return p;
+}
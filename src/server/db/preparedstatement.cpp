@@ -0,0 +1,215 @@
+#include "preparedstatement.h"
+#include <muduo/base/Logging.h>
+#include <cstring>
+
+PreparedStatement::PreparedStatement(MYSQL *conn)
+{
+    _stmt = mysql_stmt_init(conn);
+}
+
+PreparedStatement::~PreparedStatement()
+{
+    if (_stmt != nullptr)
+        mysql_stmt_close(_stmt);
+}
+
+// 解析SQL，参数使用?占位
+bool PreparedStatement::prepare(const string &sql)
+{
+    if (_stmt == nullptr)
+    {
+        return false;
+    }
+
+    if (mysql_stmt_prepare(_stmt, sql.c_str(), sql.size()))
+    {
+        LOG_INFO << __FILE__ << ":" << __LINE__ << ":"
+                 << sql << "预处理失败:" << mysql_stmt_error(_stmt);
+        return false;
+    }
+    _sql = sql;
+
+    // 结果集按最大列长分配缓冲区
+    bool updateMaxLength = true;
+    mysql_stmt_attr_set(_stmt, STMT_ATTR_UPDATE_MAX_LENGTH, &updateMaxLength);
+
+    // 参数缓冲区的大小在语句生命周期内固定，绑定的指针不会失效
+    size_t count = mysql_stmt_param_count(_stmt);
+    _params.assign(count, MYSQL_BIND());
+    _paramInts.assign(count, 0);
+    _paramLens.assign(count, 0);
+    return true;
+}
+
+// 释放上一次执行的结果集，复用语句前调用
+void PreparedStatement::reset()
+{
+    mysql_stmt_free_result(_stmt);
+    for (MYSQL_BIND &bind : _params)
+    {
+        memset(&bind, 0, sizeof(bind));
+    }
+}
+
+void PreparedStatement::bindInt(int idx, long long value)
+{
+    _paramInts[idx] = value;
+    MYSQL_BIND &bind = _params[idx];
+    memset(&bind, 0, sizeof(bind));
+    bind.buffer_type = MYSQL_TYPE_LONGLONG;
+    bind.buffer = &_paramInts[idx];
+}
+
+void PreparedStatement::bindString(int idx, const string &value)
+{
+    _paramLens[idx] = value.size();
+    MYSQL_BIND &bind = _params[idx];
+    memset(&bind, 0, sizeof(bind));
+    bind.buffer_type = MYSQL_TYPE_STRING;
+    bind.buffer = const_cast<char *>(value.data());
+    bind.buffer_length = value.size();
+    bind.length = &_paramLens[idx];
+}
+
+void PreparedStatement::bindBlob(int idx, const char *data, size_t len)
+{
+    _paramLens[idx] = len;
+    MYSQL_BIND &bind = _params[idx];
+    memset(&bind, 0, sizeof(bind));
+    bind.buffer_type = MYSQL_TYPE_BLOB;
+    bind.buffer = const_cast<char *>(data);
+    bind.buffer_length = len;
+    bind.length = &_paramLens[idx];
+}
+
+// 执行语句，查询语句的结果集会缓存到客户端
+bool PreparedStatement::execute()
+{
+    if ((!_params.empty() && mysql_stmt_bind_param(_stmt, _params.data()))
+        || mysql_stmt_execute(_stmt))
+    {
+        LOG_INFO << __FILE__ << ":" << __LINE__ << ":"
+                 << _sql << "执行失败:" << mysql_stmt_error(_stmt);
+        return false;
+    }
+    return bindResult();
+}
+
+// 根据结果集的列类型分配缓冲区并绑定
+bool PreparedStatement::bindResult()
+{
+    MYSQL_RES *meta = mysql_stmt_result_metadata(_stmt);
+    if (meta == nullptr)
+    {
+        // insert/update/delete没有结果集
+        _results.clear();
+        return true;
+    }
+
+    if (mysql_stmt_store_result(_stmt))
+    {
+        LOG_INFO << __FILE__ << ":" << __LINE__ << ":"
+                 << _sql << "获取结果集失败:" << mysql_stmt_error(_stmt);
+        mysql_free_result(meta);
+        return false;
+    }
+
+    size_t count = mysql_num_fields(meta);
+    MYSQL_FIELD *fields = mysql_fetch_fields(meta);
+    _results.assign(count, MYSQL_BIND());
+    _resultIsInt.assign(count, false);
+    _resultInts.assign(count, 0);
+    _resultBufs.resize(count);
+    _resultLens.assign(count, 0);
+    _resultNulls.reset(new NullFlag[count]());
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        MYSQL_BIND &bind = _results[i];
+        switch (fields[i].type)
+        {
+        case MYSQL_TYPE_TINY:
+        case MYSQL_TYPE_SHORT:
+        case MYSQL_TYPE_INT24:
+        case MYSQL_TYPE_LONG:
+        case MYSQL_TYPE_LONGLONG:
+            // 整数列直接绑定到整数缓冲区
+            _resultIsInt[i] = true;
+            bind.buffer_type = MYSQL_TYPE_LONGLONG;
+            bind.buffer = &_resultInts[i];
+            break;
+        default:
+            // 其它列按字符串读取，缓冲区大小取该列在结果集中的最大长度
+            _resultBufs[i].resize(fields[i].max_length + 1);
+            bind.buffer_type = MYSQL_TYPE_STRING;
+            bind.buffer = _resultBufs[i].data();
+            bind.buffer_length = _resultBufs[i].size();
+            break;
+        }
+        bind.length = &_resultLens[i];
+        bind.is_null = &_resultNulls[i];
+    }
+    mysql_free_result(meta);
+
+    if (mysql_stmt_bind_result(_stmt, _results.data()))
+    {
+        LOG_INFO << __FILE__ << ":" << __LINE__ << ":"
+                 << _sql << "绑定结果集失败:" << mysql_stmt_error(_stmt);
+        return false;
+    }
+    return true;
+}
+
+// 取下一行结果，没有更多行返回false
+bool PreparedStatement::fetch()
+{
+    if (_results.empty())
+    {
+        return false;
+    }
+    int ret = mysql_stmt_fetch(_stmt);
+    return ret == 0 || ret == MYSQL_DATA_TRUNCATED;
+}
+
+long long PreparedStatement::getInt(int idx) const
+{
+    if (_resultNulls[idx])
+    {
+        return 0;
+    }
+    if (_resultIsInt[idx])
+    {
+        return _resultInts[idx];
+    }
+    return strtoll(string(_resultBufs[idx].data(), _resultLens[idx]).c_str(), nullptr, 10);
+}
+
+string PreparedStatement::getString(int idx) const
+{
+    if (_resultNulls[idx])
+    {
+        return string();
+    }
+    if (_resultIsInt[idx])
+    {
+        return to_string(_resultInts[idx]);
+    }
+    return string(_resultBufs[idx].data(), _resultLens[idx]);
+}
+
+bool PreparedStatement::isNull(int idx) const
+{
+    return _resultNulls[idx];
+}
+
+// insert语句生成的主键id
+unsigned long long PreparedStatement::insertId()
+{
+    return mysql_stmt_insert_id(_stmt);
+}
+
+// update/delete语句影响的行数
+unsigned long long PreparedStatement::affectedRows()
+{
+    return mysql_stmt_affected_rows(_stmt);
+}
@@ -0,0 +1,230 @@
+#include "jsonwriter.hpp"
+#include <cstdio>
+#include <cstring>
+
+JsonWriter::JsonWriter(Buffer *buf)
+    : _buf(buf), _afterKey(false)
+{
+}
+
+// 数组元素或对象的键之前按需写入逗号
+void JsonWriter::beforeValue()
+{
+    if (_afterKey)
+    {
+        _afterKey = false;
+        return;
+    }
+    if (!_first.empty())
+    {
+        if (!_first.back())
+        {
+            _buf->append(",", 1);
+        }
+        _first.back() = false;
+    }
+}
+
+JsonWriter &JsonWriter::startObject()
+{
+    beforeValue();
+    _buf->append("{", 1);
+    _first.push_back(true);
+    return *this;
+}
+
+JsonWriter &JsonWriter::endObject()
+{
+    _first.pop_back();
+    _buf->append("}", 1);
+    return *this;
+}
+
+JsonWriter &JsonWriter::startArray()
+{
+    beforeValue();
+    _buf->append("[", 1);
+    _first.push_back(true);
+    return *this;
+}
+
+JsonWriter &JsonWriter::endArray()
+{
+    _first.pop_back();
+    _buf->append("]", 1);
+    return *this;
+}
+
+// 对象中的键
+JsonWriter &JsonWriter::key(const char *name)
+{
+    beforeValue();
+    appendEscaped(name, strlen(name));
+    _buf->append(":", 1);
+    _afterKey = true;
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(long long v)
+{
+    beforeValue();
+    char tmp[24];
+    int n = snprintf(tmp, sizeof tmp, "%lld", v);
+    _buf->append(tmp, n);
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(bool v)
+{
+    beforeValue();
+    if (v)
+    {
+        _buf->append("true", 4);
+    }
+    else
+    {
+        _buf->append("false", 5);
+    }
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(const char *s, size_t len)
+{
+    beforeValue();
+    appendEscaped(s, len);
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(const char *s)
+{
+    return value(s, strlen(s));
+}
+
+// s[0]不是ASCII字节，返回从s开始的合法UTF-8序列的长度；
+// 非法时返回0，bad为需要替换的字节数：首字节加上后面符合要求的续字节(最长合法前缀)，至少为1
+static size_t utf8Length(const unsigned char *s, size_t len, size_t *bad)
+{
+    // 第一个续字节的取值范围随首字节变化，排除过长编码、代理区和超过U+10FFFF的码点
+    unsigned char lo = 0x80;
+    unsigned char hi = 0xBF;
+    size_t need;
+    if (s[0] >= 0xC2 && s[0] <= 0xDF)
+    {
+        need = 1;
+    }
+    else if (s[0] >= 0xE0 && s[0] <= 0xEF)
+    {
+        need = 2;
+        if (s[0] == 0xE0)
+        {
+            lo = 0xA0;
+        }
+        else if (s[0] == 0xED)
+        {
+            hi = 0x9F;
+        }
+    }
+    else if (s[0] >= 0xF0 && s[0] <= 0xF4)
+    {
+        need = 3;
+        if (s[0] == 0xF0)
+        {
+            lo = 0x90;
+        }
+        else if (s[0] == 0xF4)
+        {
+            hi = 0x8F;
+        }
+    }
+    else
+    {
+        *bad = 1;
+        return 0;
+    }
+
+    size_t i = 1;
+    for (; i <= need && i < len; ++i)
+    {
+        if (s[i] < lo || s[i] > hi)
+        {
+            break;
+        }
+        lo = 0x80;
+        hi = 0xBF;
+    }
+    if (i == need + 1)
+    {
+        return i;
+    }
+    *bad = i;
+    return 0;
+}
+
+// 带引号写入字符串，连续的无需转义的字节一次追加
+void JsonWriter::appendEscaped(const char *s, size_t len)
+{
+    const unsigned char *u = reinterpret_cast<const unsigned char *>(s);
+    _buf->append("\"", 1);
+    size_t start = 0;
+    for (size_t i = 0; i < len; ++i)
+    {
+        unsigned char c = u[i];
+        if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\')
+        {
+            continue;
+        }
+
+        if (c >= 0x80)
+        {
+            size_t bad = 0;
+            size_t n = utf8Length(u + i, len - i, &bad);
+            if (n > 0)
+            {
+                i += n - 1;
+                continue;
+            }
+            // 非法序列替换为U+FFFD
+            _buf->append(s + start, i - start);
+            _buf->append("\xEF\xBF\xBD", 3);
+            i += bad - 1;
+            start = i + 1;
+            continue;
+        }
+
+        _buf->append(s + start, i - start);
+        start = i + 1;
+        switch (c)
+        {
+        case '"':
+            _buf->append("\\\"", 2);
+            break;
+        case '\\':
+            _buf->append("\\\\", 2);
+            break;
+        case '\b':
+            _buf->append("\\b", 2);
+            break;
+        case '\f':
+            _buf->append("\\f", 2);
+            break;
+        case '\n':
+            _buf->append("\\n", 2);
+            break;
+        case '\r':
+            _buf->append("\\r", 2);
+            break;
+        case '\t':
+            _buf->append("\\t", 2);
+            break;
+        default:
+        {
+            char tmp[8];
+            int n = snprintf(tmp, sizeof tmp, "\\u%04x", c);
+            _buf->append(tmp, n);
+            break;
+        }
+        }
+    }
+    _buf->append(s + start, len - start);
+    _buf->append("\"", 1);
+}
@@ -1,21 +1,32 @@
 #include "chatserver.hpp"
 #include "chatservice.hpp"
+#include <muduo/net/Channel.h>
 #include <iostream>
 #include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
 using namespace std;
 
-// 处理服务器ctrl+c结束后，重置user的状态信息
+// 信号通知管道：信号处理函数只往写端写一个字节，读端由事件循环监听
+static int g_signalPipe[2] = {-1, -1};
+
+// 处理服务器ctrl+c结束
+// 信号可能落在任意线程上，这里只做异步信号安全的write，重置user状态等清理工作在事件循环退出后由main执行
 void resetHandler(int)
 {
-    ChatService::instance()->reset();
-    exit(0);
+    int savedErrno = errno;
+    char c = 1;
+    ssize_t n = ::write(g_signalPipe[1], &c, 1);
+    (void)n;
+    errno = savedErrno;
 }
 
 int main(int argc, char **argv)
 {
     if (argc < 3)
     {
-        cerr << "command invalid! example: ./ChatServer 127.0.0.1 6000" << endl;
+        cerr << "command invalid! example: ./ChatServer 127.0.0.1 6000 [pubsub|stream]" << endl;
         exit(-1);
     }
 
@@ -23,14 +34,42 @@ int main(int argc, char **argv)
     char *ip = argv[1];
     uint16_t port = atoi(argv[2]);
 
+    if (::pipe2(g_signalPipe, O_NONBLOCK | O_CLOEXEC) < 0)
+    {
+        cerr << "create signal pipe failed" << endl;
+        exit(-1);
+    }
     signal(SIGINT, resetHandler);
 
+    // 以监听地址作为集群中的节点id，订阅本节点的redis通道
+    // 可选的第三个参数stream表示节点间消息走redis stream
+    bool useStream = argc > 3 && string(argv[3]) == "stream";
+    ChatService::instance()->setNodeId(string(ip) + ":" + to_string(port), useStream);
+
     EventLoop loop;
     InetAddress addr(ip, port);
     ChatServer server(&loop, addr, "ChatServer");
 
+    // 收到信号后在事件循环线程里退出循环
+    Channel signalChannel(&loop, g_signalPipe[0]);
+    signalChannel.setReadCallback([&loop](Timestamp) {
+        char buf[16];
+        while (::read(g_signalPipe[0], buf, sizeof buf) > 0)
+        {
+        }
+        loop.quit();
+    });
+    signalChannel.enableReading();
+
     server.start();
     loop.loop();
 
+    signalChannel.disableAll();
+    signalChannel.remove();
+
+    // 事件循环已退出，先停止后台线程，再在普通线程上下文中重置user的状态信息
+    ChatService::instance()->stop();
+    ChatService::instance()->reset();
+
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,12 @@
+#include "friendcache.hpp"
+
+FriendCache *FriendCache::instance()
+{
+    static FriendCache cache;
+    return &cache;
+}
+
+FriendCache::FriendCache()
+    : ShardedCache(100000)
+{
+}
@@ -1,48 +1,85 @@
 #include "friendmodel.hpp"
-#include "db.h"
+#include "connectionpool.h"
 
 // 添加好友关系
 void FriendModel::insert(int userid, int friendid)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "insert into friend values(%d, %d)", userid, friendid);
-
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        mysql.update(sql);
+        PreparedStatement *stmt = mysql->prepare("insert into friend values(?, ?)");
+        if (stmt != nullptr)
+        {
+            stmt->bindInt(0, userid);
+            stmt->bindInt(1, friendid);
+            if (stmt->execute())
+            {
+                FriendCache::instance()->erase(userid);
+                FriendCache::instance()->notifyInvalidate(userid);
+            }
+        }
     }
 }
 
 // 返回用户好友列表
 vector<User> FriendModel::query(int userid)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-
-    sprintf(sql, "select a.id,a.name,a.state from user a inner join friend b on b.friendid = a.id where b.userid=%d", userid);
-
     vector<User> vec;
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
+        PreparedStatement *stmt = mysql->prepare(
+            "select a.id,a.name,a.state from user a inner join friend b on b.friendid = a.id where b.userid = ?");
+        if (stmt != nullptr)
         {
-            // 把userid用户的所有离线消息放入vec中返回
-            MYSQL_ROW row;
-            while((row = mysql_fetch_row(res)) != nullptr)
+            stmt->bindInt(0, userid);
+            if (stmt->execute())
             {
-                User user;
-                user.setId(atoi(row[0]));
-                user.setName(row[1]);
-                user.setState(row[2]);
-                vec.push_back(user);
+                // 把userid用户的所有好友放入vec中返回
+                while (stmt->fetch())
+                {
+                    User user;
+                    user.setId(stmt->getInt(0));
+                    user.setName(stmt->getString(1));
+                    user.setState(stmt->getString(2));
+                    vec.push_back(user);
+                }
             }
-            mysql_free_result(res);
-            return vec;
         }
     }
     return vec;
-}
\ No newline at end of file
+}
+
+// 返回用户好友邻接表的快照，先查好友缓存
+FriendListPtr FriendModel::queryFriends(int userid)
+{
+    unsigned long loadSeq = 0;
+    FriendListPtr friends;
+    if (FriendCache::instance()->get(userid, friends, &loadSeq))
+    {
+        return friends;
+    }
+
+    vector<FriendInfo> vec;
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
+    {
+        PreparedStatement *stmt = mysql->prepare(
+            "select a.id,a.name from user a inner join friend b on b.friendid = a.id where b.userid = ?");
+        if (stmt != nullptr)
+        {
+            stmt->bindInt(0, userid);
+            if (stmt->execute())
+            {
+                while (stmt->fetch())
+                {
+                    vec.push_back({static_cast<int>(stmt->getInt(0)), stmt->getString(1)});
+                }
+                vec.shrink_to_fit();
+                return FriendCache::instance()->put(userid, make_shared<const vector<FriendInfo>>(std::move(vec)), loadSeq);
+            }
+        }
+    }
+    // 查询失败不缓存
+    return make_shared<const vector<FriendInfo>>();
+}
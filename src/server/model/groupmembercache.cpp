@@ -0,0 +1,60 @@
+#include "groupmembercache.hpp"
+#include <algorithm>
+
+bool GroupMembers::contains(int userid) const
+{
+    return binary_search(ids.begin(), ids.end(), userid);
+}
+
+GroupMemberCache *GroupMemberCache::instance()
+{
+    static GroupMemberCache cache;
+    return &cache;
+}
+
+GroupMemberCache::GroupMemberCache()
+    : ShardedCache(20000, chrono::seconds(60))
+{
+}
+
+// 从数据库加载后放入缓存
+GroupMembersPtr GroupMemberCache::put(int groupid, vector<int> ids, unsigned long loadSeq)
+{
+    sort(ids.begin(), ids.end());
+    ids.erase(unique(ids.begin(), ids.end()), ids.end());
+    ids.shrink_to_fit();
+
+    auto members = make_shared<GroupMembers>();
+    members->ids = std::move(ids);
+    return put(groupid, members, loadSeq);
+}
+
+// 新建群组，缓存一个空的成员列表
+void GroupMemberCache::create(int groupid)
+{
+    put(groupid, make_shared<const GroupMembers>());
+}
+
+// 群组增加成员，复制数组后有序插入，替换快照
+void GroupMemberCache::addMember(int groupid, int userid)
+{
+    bool added = update(groupid, [userid](GroupMembersPtr &members) {
+        if (members->contains(userid))
+        {
+            return false;
+        }
+        const GroupMembers &old = *members;
+        auto next = make_shared<GroupMembers>();
+        next->ids.reserve(old.ids.size() + 1);
+        auto pos = lower_bound(old.ids.begin(), old.ids.end(), userid);
+        next->ids.insert(next->ids.end(), old.ids.begin(), pos);
+        next->ids.push_back(userid);
+        next->ids.insert(next->ids.end(), pos, old.ids.end());
+        members = next;
+        return true;
+    });
+    if (added)
+    {
+        ++_incrementalUpdates;
+    }
+}
@@ -1,21 +1,27 @@
 #include "groupmodel.hpp"
-#include "db.h"
+#include "connectionpool.h"
 
 // 创建群组
 bool GroupModel::createGroup(Group &group)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "insert into allgroup(groupname, groupdesc) values('%s', '%s')",
-            group.getName().c_str(), group.getDesc().c_str());
-
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        if (mysql.update(sql))
+        PreparedStatement *stmt = mysql->prepare("insert into allgroup(groupname, groupdesc) values(?, ?)");
+        if (stmt != nullptr)
         {
-            group.setId(mysql_insert_id(mysql.getConnection()));
-            return true;
+            string name = group.getName();
+            string desc = group.getDesc();
+            stmt->bindString(0, name);
+            stmt->bindString(1, desc);
+            if (stmt->execute())
+            {
+                group.setId(stmt->insertId());
+                // 本节点缓存空的成员列表，其它节点删除之前可能按不存在的群组缓存的结果
+                GroupMemberCache::instance()->create(group.getId());
+                GroupMemberCache::instance()->notifyInvalidate(group.getId());
+                return true;
+            }
         }
     }
 
@@ -25,73 +31,97 @@ bool GroupModel::createGroup(Group &group)
 // 加入群组
 void GroupModel::addGroup(int userid, int groupid, string role)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "insert into groupuser values(%d, %d, '%s')",
-            groupid, userid, role.c_str());
-
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        mysql.update(sql);
+        PreparedStatement *stmt = mysql->prepare("insert into groupuser values(?, ?, ?)");
+        if (stmt != nullptr)
+        {
+            stmt->bindInt(0, groupid);
+            stmt->bindInt(1, userid);
+            stmt->bindString(2, role);
+            if (stmt->execute())
+            {
+                // 增量更新本节点缓存，其它节点删除各自的缓存
+                GroupMemberCache::instance()->addMember(groupid, userid);
+                GroupMemberCache::instance()->notifyInvalidate(groupid);
+            }
+        }
     }
 }
 
-// 查询用户所在群组信息
+// 查询用户所在群组信息，包含每个群组的成员
 vector<Group> GroupModel::queryGroups(int userid)
 {
     /*
-    1. 先根据userid在groupuser表中查询出该用户所属的群组信息
-    2. 在根据群组信息，查询属于该群组的所有用户的userid，并且和user表进行多表联合查询，查出用户的详细信息
+    一次联表查询出userid所在的所有群组及每个群组的全部成员，按群组id排序，
+    遍历结果集时群组id变化即开始一个新的群组，不再对每个群组单独查询成员
     */
-    char sql[1024] = {0};
-    sprintf(sql, "select a.id,a.groupname,a.groupdesc from allgroup a inner join \
-         groupuser b on a.id = b.groupid where b.userid=%d",
-            userid);
-
     vector<Group> groupVec;
-
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
+        PreparedStatement *stmt = mysql->prepare(
+            "select g.id,g.groupname,g.groupdesc,u.id,u.name,u.state,m.grouprole from groupuser b "
+            "inner join allgroup g on g.id = b.groupid "
+            "inner join groupuser m on m.groupid = g.id "
+            "inner join user u on u.id = m.userid "
+            "where b.userid = ? order by g.id");
+        if (stmt != nullptr)
         {
-            MYSQL_ROW row;
-            // 查出userid所有的群组信息
-            while ((row = mysql_fetch_row(res)) != nullptr)
+            stmt->bindInt(0, userid);
+            if (stmt->execute())
             {
-                Group group;
-                group.setId(atoi(row[0]));
-                group.setName(row[1]);
-                group.setDesc(row[2]);
-                groupVec.push_back(group);
+                while (stmt->fetch())
+                {
+                    int groupid = stmt->getInt(0);
+                    if (groupVec.empty() || groupVec.back().getId() != groupid)
+                    {
+                        groupVec.emplace_back(groupid, stmt->getString(1), stmt->getString(2));
+                    }
+
+                    GroupUser user;
+                    user.setId(stmt->getInt(3));
+                    user.setName(stmt->getString(4));
+                    user.setState(stmt->getString(5));
+                    user.setRole(stmt->getString(6));
+                    groupVec.back().getUsers().push_back(user);
+                }
             }
-            mysql_free_result(res);
         }
     }
 
-    // 查询群组的用户信息
     for (Group &group : groupVec)
     {
-        sprintf(sql, "select a.id,a.name,a.state,b.grouprole from user a \
-            inner join groupuser b on b.userid = a.id where b.groupid=%d",
-                group.getId());
+        group.setMemberCount(group.getUsers().size());
+    }
+    return groupVec;
+}
 
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
+// 查询用户所在群组的概要信息，只包含成员数，不加载成员
+vector<Group> GroupModel::queryGroupHeaders(int userid)
+{
+    vector<Group> groupVec;
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
+    {
+        PreparedStatement *stmt = mysql->prepare(
+            "select g.id,g.groupname,g.groupdesc,count(m.userid) from groupuser b "
+            "inner join allgroup g on g.id = b.groupid "
+            "inner join groupuser m on m.groupid = g.id "
+            "where b.userid = ? group by g.id,g.groupname,g.groupdesc");
+        if (stmt != nullptr)
         {
-            MYSQL_ROW row;
-            while ((row = mysql_fetch_row(res)) != nullptr)
+            stmt->bindInt(0, userid);
+            if (stmt->execute())
             {
-                GroupUser user;
-                user.setId(atoi(row[0]));
-                user.setName(row[1]);
-                user.setState(row[2]);
-                user.setRole(row[3]);
-                group.getUsers().push_back(user);
+                while (stmt->fetch())
+                {
+                    Group group(stmt->getInt(0), stmt->getString(1), stmt->getString(2));
+                    group.setMemberCount(stmt->getInt(3));
+                    groupVec.push_back(group);
+                }
             }
-            mysql_free_result(res);
         }
     }
     return groupVec;
@@ -100,51 +130,78 @@ vector<Group> GroupModel::queryGroups(int userid)
 // 根据指定的groupid查询群组用户id列表，除userid自己，主要用户群聊业务给群组其它成员群发消息
 vector<int> GroupModel::queryGroupUsers(int userid, int groupid)
 {
-    char sql[1024] = {0};
-    sprintf(sql, "select userid from groupuser where groupid = %d and userid != %d", groupid, userid);
-
     vector<int> idVec;
-    MySQL mysql;
-    if (mysql.connect())
+    GroupMembersPtr members = queryGroupMembers(groupid);
+    if (members)
     {
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
+        idVec.reserve(members->ids.size());
+        for (int id : members->ids)
         {
-            MYSQL_ROW row;
-            while ((row = mysql_fetch_row(res)) != nullptr)
+            if (id != userid)
             {
-                idVec.push_back(atoi(row[0]));
+                idVec.push_back(id);
             }
-            mysql_free_result(res);
         }
     }
     return idVec;
 }
 
+// 查询群组成员id的快照，先查成员缓存
+GroupMembersPtr GroupModel::queryGroupMembers(int groupid)
+{
+    unsigned long loadSeq = 0;
+    GroupMembersPtr members;
+    if (GroupMemberCache::instance()->get(groupid, members, &loadSeq))
+    {
+        return members;
+    }
+
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
+    {
+        PreparedStatement *stmt = mysql->prepare("select userid from groupuser where groupid = ?");
+        if (stmt != nullptr)
+        {
+            stmt->bindInt(0, groupid);
+            if (stmt->execute())
+            {
+                vector<int> idVec;
+                while (stmt->fetch())
+                {
+                    idVec.push_back(stmt->getInt(0));
+                }
+                return GroupMemberCache::instance()->put(groupid, std::move(idVec), loadSeq);
+            }
+        }
+    }
+    return nullptr;
+}
+
 // 根据 groupid 查询群组所有成員（不含自己）
 std::vector<GroupUser> GroupModel::queryGroupUsers(int groupid)
 {
     std::vector<GroupUser> users;
-    char sql[1024] = {0};
-    sprintf(sql, "select a.id,a.name,a.state,b.role from user a inner join groupuser b on b.userid=a.id where b.groupid=%d", groupid);
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
+        PreparedStatement *stmt = mysql->prepare(
+            "select a.id,a.name,a.state,b.grouprole from user a inner join groupuser b on b.userid = a.id where b.groupid = ?");
+        if (stmt != nullptr)
         {
-            MYSQL_ROW row;
-            while ((row = mysql_fetch_row(res)) != nullptr)
+            stmt->bindInt(0, groupid);
+            if (stmt->execute())
             {
-                GroupUser user;
-                user.setId(atoi(row[0]));
-                user.setName(row[1]);
-                user.setState(row[2]);
-                user.setRole(row[3]);
-                users.push_back(user);
+                while (stmt->fetch())
+                {
+                    GroupUser user;
+                    user.setId(stmt->getInt(0));
+                    user.setName(stmt->getString(1));
+                    user.setState(stmt->getString(2));
+                    user.setRole(stmt->getString(3));
+                    users.push_back(user);
+                }
             }
-            mysql_free_result(res);
         }
     }
     return users;
-}
\ No newline at end of file
+}
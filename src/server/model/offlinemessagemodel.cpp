@@ -1,57 +1,120 @@
 #include "offlinemessagemodel.hpp"
-#include "db.h"
+#include "connectionpool.h"
 
-// 存储用户的离线消息
-void OfflineMsgModel::insert(int userid, string msg)
+// 批量insert一条语句最多的行数，按2的幂拆分，每个连接最多缓存9条预处理语句
+static const int MAX_ROWS_PER_STMT = 256;
+
+// 生成n行的insert语句
+static string batchInsertSql(int n)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "insert into offlinemessage values(%d, '%s')", userid, msg.c_str());
+    string sql = "insert into offlinemessage(userid, message) values(?, ?)";
+    sql.reserve(sql.size() + (n - 1) * 8);
+    for (int i = 1; i < n; ++i)
+    {
+        sql += ",(?, ?)";
+    }
+    return sql;
+}
 
-    MySQL mysql;
-    if (mysql.connect())
+// 存储用户的离线消息
+void OfflineMsgModel::insert(int userid, const string &msg)
+{
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        mysql.update(sql);
+        // 消息内容按参数绑定，不受SQL缓冲区长度限制，也不需要转义
+        PreparedStatement *stmt = mysql->prepare("insert into offlinemessage(userid, message) values(?, ?)");
+        if (stmt != nullptr)
+        {
+            stmt->bindInt(0, userid);
+            stmt->bindBlob(1, msg.data(), msg.size());
+            stmt->execute();
+        }
     }
 }
 
-// 删除用户的离线消息
-void OfflineMsgModel::remove(int userid)
+// 批量存储离线消息，多行insert在同一个事务中提交，整批成功或整批失败
+bool OfflineMsgModel::insert(const vector<OfflineMsg> &msgs)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "delete from offlinemessage where userid=%d", userid);
+    if (msgs.empty())
+    {
+        return true;
+    }
 
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (!mysql || !mysql->update("start transaction"))
     {
-        mysql.update(sql);
+        return false;
+    }
+
+    // 按行的顺序拆成256,128,...,1行的语句，保证同一用户的消息按原顺序写入
+    size_t pos = 0;
+    for (int n = MAX_ROWS_PER_STMT; n > 0 && pos < msgs.size(); n /= 2)
+    {
+        while (msgs.size() - pos >= (size_t)n)
+        {
+            PreparedStatement *stmt = mysql->prepare(batchInsertSql(n));
+            if (stmt == nullptr)
+            {
+                mysql->update("rollback");
+                return false;
+            }
+            for (int i = 0; i < n; ++i)
+            {
+                const OfflineMsg &m = msgs[pos + i];
+                stmt->bindInt(2 * i, m.userid);
+                stmt->bindBlob(2 * i + 1, m.msg->data(), m.msg->size());
+            }
+            if (!stmt->execute())
+            {
+                mysql->update("rollback");
+                return false;
+            }
+            pos += n;
+        }
     }
+
+    return mysql->update("commit");
 }
 
-// 查询用户的离线消息
-vector<string> OfflineMsgModel::query(int userid)
+// 删除用户id不超过maxId的离线消息，只删除客户端已确认收到的部分
+void OfflineMsgModel::remove(int userid, long long maxId)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "select message from offlinemessage where userid = %d", userid);
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
+    {
+        PreparedStatement *stmt = mysql->prepare("delete from offlinemessage where userid = ? and id <= ?");
+        if (stmt != nullptr)
+        {
+            stmt->bindInt(0, userid);
+            stmt->bindInt(1, maxId);
+            stmt->execute();
+        }
+    }
+}
 
-    vector<string> vec;
-    MySQL mysql;
-    if (mysql.connect())
+// 按id顺序查询用户id大于afterId的离线消息，最多limit条，返回<id, 消息>
+vector<pair<long long, string>> OfflineMsgModel::query(int userid, long long afterId, int limit)
+{
+    vector<pair<long long, string>> vec;
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
+        PreparedStatement *stmt = mysql->prepare(
+            "select id, message from offlinemessage where userid = ? and id > ? order by id limit ?");
+        if (stmt != nullptr)
         {
-            // 把userid用户的所有离线消息放入vec中返回
-            MYSQL_ROW row;
-            while((row = mysql_fetch_row(res)) != nullptr)
+            stmt->bindInt(0, userid);
+            stmt->bindInt(1, afterId);
+            stmt->bindInt(2, limit);
+            if (stmt->execute())
             {
-                vec.push_back(row[0]);
+                while (stmt->fetch())
+                {
+                    vec.emplace_back(stmt->getInt(0), stmt->getString(1));
+                }
             }
-            mysql_free_result(res);
-            return vec;
         }
     }
     return vec;
-}
\ No newline at end of file
+}
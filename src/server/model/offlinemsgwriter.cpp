@@ -0,0 +1,184 @@
+#include "offlinemsgwriter.hpp"
+#include <muduo/base/Logging.h>
+#include <thread>
+#include <functional>
+
+// 获取单例对象
+OfflineMsgWriter *OfflineMsgWriter::instance()
+{
+    static OfflineMsgWriter writer;
+    return &writer;
+}
+
+OfflineMsgWriter::OfflineMsgWriter()
+    : _maxBatch(256)
+    , _maxPending(100000)
+    , _flushInterval(5)
+    , _maxRetry(3)
+{
+    // 启动后台刷盘线程
+    thread t(std::bind(&OfflineMsgWriter::flushTask, this));
+    t.detach();
+}
+
+// 异步存储一条离线消息
+void OfflineMsgWriter::append(int userid, const string &msg)
+{
+    shared_ptr<const string> sp = make_shared<const string>(msg);
+    unique_lock<mutex> lock(_mutex);
+    _notFull.wait(lock, [&]() { return _queue.size() < _maxPending; });
+    _queue.push_back({userid, sp});
+    _userSeq[userid] = _appendSeq + 1;
+    enqueue(lock, 1);
+}
+
+// 异步存储一条群离线消息，所有接收者共享同一份消息内容
+void OfflineMsgWriter::append(const vector<int> &useridVec, const string &msg)
+{
+    if (useridVec.empty())
+    {
+        return;
+    }
+
+    shared_ptr<const string> sp = make_shared<const string>(msg);
+    unique_lock<mutex> lock(_mutex);
+    _notFull.wait(lock, [&]() { return _queue.size() < _maxPending; });
+    unsigned long seq = _appendSeq;
+    for (int userid : useridVec)
+    {
+        _queue.push_back({userid, sp});
+        _userSeq[userid] = ++seq;
+    }
+    enqueue(lock, useridVec.size());
+}
+
+// 入队，调用时持有_mutex
+void OfflineMsgWriter::enqueue(unique_lock<mutex> &lock, size_t count)
+{
+    size_t size = _queue.size();
+    _appendSeq += count;
+    lock.unlock();
+
+    // 队列从空变为非空时开始计时间窗口，攒够一批时立即唤醒，其余情况不需要通知
+    if (size == count || (size >= _maxBatch && size - count < _maxBatch))
+    {
+        _cv.notify_one();
+    }
+}
+
+// 等待调用前append的消息全部提交，超时返回false
+bool OfflineMsgWriter::flush(chrono::milliseconds timeout)
+{
+    unique_lock<mutex> lock(_mutex);
+    return waitDone(lock, _appendSeq, timeout);
+}
+
+// 只等待调用前append给userid的消息提交
+bool OfflineMsgWriter::flushUser(int userid, chrono::milliseconds timeout)
+{
+    unique_lock<mutex> lock(_mutex);
+    auto it = _userSeq.find(userid);
+    if (it == _userSeq.end())
+    {
+        return true;
+    }
+    return waitDone(lock, it->second, timeout);
+}
+
+// 等待序号target之前的消息全部处理，调用时持有_mutex
+bool OfflineMsgWriter::waitDone(unique_lock<mutex> &lock, unsigned long target, chrono::milliseconds timeout)
+{
+    if (_doneSeq >= target)
+    {
+        return true;
+    }
+    _urgentSeq = max(_urgentSeq, target);
+    _cv.notify_one();
+    return _flushed.wait_for(lock, timeout, [&]() { return _doneSeq >= target; });
+}
+
+size_t OfflineMsgWriter::getPendingCount()
+{
+    lock_guard<mutex> lock(_mutex);
+    return _appendSeq - _doneSeq;
+}
+
+// 后台刷盘线程
+void OfflineMsgWriter::flushTask()
+{
+    for (;;)
+    {
+        vector<OfflineMsg> batch;
+        {
+            unique_lock<mutex> lock(_mutex);
+            _cv.wait(lock, [&]() { return !_queue.empty(); });
+            // 时间窗口内继续攒批，攒够一批或有flush在等待时立即提交
+            _cv.wait_for(lock, _flushInterval, [&]() {
+                return _queue.size() >= _maxBatch || _urgentSeq > _doneSeq;
+            });
+
+            size_t n = min(_queue.size(), _maxBatch);
+            batch.reserve(n);
+            for (size_t i = 0; i < n; ++i)
+            {
+                batch.push_back(std::move(_queue.front()));
+                _queue.pop_front();
+            }
+        }
+        _notFull.notify_all();
+
+        commitBatch(batch);
+
+        {
+            lock_guard<mutex> lock(_mutex);
+            _doneSeq += batch.size();
+            // 这批用户的消息都已处理完时，不再记录
+            for (const OfflineMsg &msg : batch)
+            {
+                auto it = _userSeq.find(msg.userid);
+                if (it != _userSeq.end() && it->second <= _doneSeq)
+                {
+                    _userSeq.erase(it);
+                }
+            }
+        }
+        _flushed.notify_all();
+    }
+}
+
+// 提交一批消息并记录统计信息
+void OfflineMsgWriter::commitBatch(const vector<OfflineMsg> &batch)
+{
+    auto start = chrono::steady_clock::now();
+    bool ok = false;
+    for (int i = 0; i <= _maxRetry && !ok; ++i)
+    {
+        if (i > 0)
+        {
+            this_thread::sleep_for(chrono::milliseconds(50 * i));
+        }
+        ok = _offlineMsgModel.insert(batch);
+    }
+    long us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+
+    if (!ok)
+    {
+        _droppedCnt += batch.size();
+        LOG_ERROR << "offline message batch commit failed, dropped " << batch.size() << " messages";
+        return;
+    }
+
+    long size = batch.size();
+    ++_batchCnt;
+    _rowCnt += size;
+    _lastFlushUs = us;
+    _totalFlushUs += us;
+    long prev = _maxBatchSize;
+    while (size > prev && !_maxBatchSize.compare_exchange_weak(prev, size))
+    {
+    }
+    prev = _maxFlushUs;
+    while (us > prev && !_maxFlushUs.compare_exchange_weak(prev, us))
+    {
+    }
+}
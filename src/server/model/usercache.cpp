@@ -0,0 +1,12 @@
+#include "usercache.hpp"
+
+UserCache *UserCache::instance()
+{
+    static UserCache cache;
+    return &cache;
+}
+
+UserCache::UserCache()
+    : ShardedCache(100000)
+{
+}
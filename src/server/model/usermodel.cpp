@@ -1,52 +1,63 @@
 #include "usermodel.hpp"
-#include "db.h"
+#include "connectionpool.h"
+#include "usercache.hpp"
 #include <iostream>
 using namespace std;
 
 // User表的增加方法
 bool UserModel::insert(User &user)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "insert into user(name, password, state) values('%s', '%s', '%s')",
-            user.getName().c_str(), user.getPwd().c_str(), user.getState().c_str());
-
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        if (mysql.update(sql))
+        PreparedStatement *stmt = mysql->prepare("insert into user(name, password, state) values(?, ?, ?)");
+        if (stmt != nullptr)
         {
-            // 获取插入成功的用户数据生成的主键id
-            user.setId(mysql_insert_id(mysql.getConnection()));
-            return true;
+            string name = user.getName();
+            string pwd = user.getPwd();
+            string state = user.getState();
+            stmt->bindString(0, name);
+            stmt->bindString(1, pwd);
+            stmt->bindString(2, state);
+            if (stmt->execute())
+            {
+                // 获取插入成功的用户数据生成的主键id
+                user.setId(stmt->insertId());
+                // 新用户写入缓存，注册后紧接着的登录不再查询数据库
+                UserCache::instance()->put(user.getId(), user);
+                return true;
+            }
         }
     }
 
     return false;
 }
 
-// 根据用户号码查询用户信息
+// 根据用户号码查询用户信息，先查进程内缓存
 User UserModel::query(int id)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "select * from user where id = %d", id);
+    User cached;
+    unsigned long loadSeq = 0;
+    if (UserCache::instance()->get(id, cached, &loadSeq))
+    {
+        return cached;
+    }
 
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
+        PreparedStatement *stmt = mysql->prepare("select id,name,password,state from user where id = ?");
+        if (stmt != nullptr)
         {
-            MYSQL_ROW row = mysql_fetch_row(res);
-            if (row != nullptr)
+            stmt->bindInt(0, id);
+            if (stmt->execute() && stmt->fetch())
             {
                 User user;
-                user.setId(atoi(row[0]));
-                user.setName(row[1]);
-                user.setPwd(row[2]);
-                user.setState(row[3]);
-                mysql_free_result(res);
+                user.setId(stmt->getInt(0));
+                user.setName(stmt->getString(1));
+                user.setPwd(stmt->getString(2));
+                user.setState(stmt->getString(3));
+                UserCache::instance()->put(user.getId(), user, loadSeq);
                 return user;
             }
         }
@@ -55,60 +66,36 @@ User UserModel::query(int id)
     return User();
 }
 
-// 更新用户的状态信息
-bool UserModel::updateState(User user)
-{
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "update user set state = '%s' where id = %d", user.getState().c_str(), user.getId());
-
-    MySQL mysql;
-    if (mysql.connect())
-    {
-        if (mysql.update(sql))
-        {
-            return true;
-        }
-    }
-    return false;
-}
-
 // 重置用户的状态信息
 void UserModel::resetState()
 {
-    // 1.组装sql语句
-    char sql[1024] = "update user set state = 'offline' where state = 'online'";
-
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        mysql.update(sql);
+        mysql->update("update user set state = 'offline' where state = 'online'");
     }
+    UserCache::instance()->clear();
 }
 
 // 查询所有用户
 std::vector<User> UserModel::queryAll()
 {
     std::vector<User> users;
-    char sql[1024] = {0};
-    sprintf(sql, "select * from user");
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
+        PreparedStatement *stmt = mysql->prepare("select id,name,password,state from user");
+        if (stmt != nullptr && stmt->execute())
         {
-            MYSQL_ROW row;
-            while ((row = mysql_fetch_row(res)) != nullptr)
+            while (stmt->fetch())
             {
                 User user;
-                user.setId(atoi(row[0]));
-                user.setName(row[1]);
-                user.setPwd(row[2]);
-                user.setState(row[3]);
+                user.setId(stmt->getInt(0));
+                user.setName(stmt->getString(1));
+                user.setPwd(stmt->getString(2));
+                user.setState(stmt->getString(3));
                 users.push_back(user);
             }
-            mysql_free_result(res);
         }
     }
     return users;
@@ -117,40 +104,43 @@ std::vector<User> UserModel::queryAll()
 // 清空所有用户（僅用於调试）
 int UserModel::clearAll()
 {
-    char sql[1024] = "delete from user";
-    MySQL mysql;
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
     int affected = 0;
-    if (mysql.connect())
+    if (mysql)
     {
-        affected = mysql.update(sql);
+        PreparedStatement *stmt = mysql->prepare("delete from user");
+        if (stmt != nullptr && stmt->execute())
+        {
+            affected = stmt->affectedRows();
+        }
     }
+    // 其它节点同样清空用户缓存
+    UserCache::instance()->clear();
+    UserCache::instance()->notifyInvalidate(UserCache::ALL);
     return affected;
 }
 
 // 根据用户名查询
 User UserModel::queryByName(const std::string& name)
 {
-    char sql[1024] = {0};
-    sprintf(sql, "select * from user where name = '%s'", name.c_str());
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql)
     {
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
+        PreparedStatement *stmt = mysql->prepare("select id,name,password,state from user where name = ?");
+        if (stmt != nullptr)
         {
-            MYSQL_ROW row = mysql_fetch_row(res);
-            if (row != nullptr)
+            stmt->bindString(0, name);
+            if (stmt->execute() && stmt->fetch())
             {
                 User user;
-                user.setId(atoi(row[0]));
-                user.setName(row[1]);
-                user.setPwd(row[2]);
-                user.setState(row[3]);
-                mysql_free_result(res);
+                user.setId(stmt->getInt(0));
+                user.setName(stmt->getString(1));
+                user.setPwd(stmt->getString(2));
+                user.setState(stmt->getString(3));
+                // 查库前不知道userid，无法取得分片的修改序号，结果不回填缓存，避免覆盖并发的修改
                 return user;
             }
-            mysql_free_result(res);
         }
     }
     return User();
-}
\ No newline at end of file
+}
@@ -0,0 +1,92 @@
+#include "onlineregistry.hpp"
+#include <mutex>
+
+// 登记用户连接，并把userid记录到连接上下文中
+void OnlineRegistry::add(int userid, const TcpConnectionPtr &conn)
+{
+    // 同一连接上的消息由同一个业务线程串行处理，这里写上下文是安全的
+    boost::any *context = conn->getMutableContext();
+    if (!context->empty())
+    {
+        boost::any_cast<ConnContext>(context)->userid = userid;
+    }
+
+    Shard &shard = shardOf(userid);
+    unique_lock<shared_mutex> lock(shard.mutex);
+    shard.conns[userid] = conn;
+}
+
+// 按userid注销，返回是否存在
+bool OnlineRegistry::remove(int userid)
+{
+    Shard &shard = shardOf(userid);
+    unique_lock<shared_mutex> lock(shard.mutex);
+    return shard.conns.erase(userid) > 0;
+}
+
+// 按连接注销，通过连接上下文反查userid，不需要遍历连接表
+int OnlineRegistry::remove(const TcpConnectionPtr &conn)
+{
+    const boost::any &context = conn->getContext();
+    if (context.empty())
+    {
+        return -1;
+    }
+
+    int userid = boost::any_cast<const ConnContext &>(context).userid;
+    if (userid == -1)
+    {
+        return -1;
+    }
+
+    Shard &shard = shardOf(userid);
+    unique_lock<shared_mutex> lock(shard.mutex);
+    auto it = shard.conns.find(userid);
+    // 用户可能已经注销，或者该userid已经绑定到别的连接上
+    if (it == shard.conns.end() || it->second != conn)
+    {
+        return -1;
+    }
+    shard.conns.erase(it);
+    return userid;
+}
+
+// 查找用户连接，不在本机返回nullptr
+TcpConnectionPtr OnlineRegistry::find(int userid) const
+{
+    const Shard &shard = shardOf(userid);
+    shared_lock<shared_mutex> lock(shard.mutex);
+    auto it = shard.conns.find(userid);
+    if (it == shard.conns.end())
+    {
+        return TcpConnectionPtr();
+    }
+    return it->second;
+}
+
+// 本机在线用户数
+size_t OnlineRegistry::size() const
+{
+    size_t total = 0;
+    for (const Shard &shard : _shards)
+    {
+        shared_lock<shared_mutex> lock(shard.mutex);
+        total += shard.conns.size();
+    }
+    return total;
+}
+
+// 本机所有在线用户的id
+vector<int> OnlineRegistry::userids() const
+{
+    vector<int> ids;
+    for (const Shard &shard : _shards)
+    {
+        shared_lock<shared_mutex> lock(shard.mutex);
+        for (auto &kv : shard.conns)
+        {
+            ids.push_back(kv.first);
+        }
+    }
+    return ids;
+}
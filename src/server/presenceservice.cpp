@@ -0,0 +1,240 @@
+#include "presenceservice.hpp"
+#include <unordered_set>
+
+PresenceService::PresenceService(Redis &redis)
+    : _redis(redis)
+    , _cacheTtl(10)
+    , _heartbeat(5)
+    , _nodeTtl(15)
+{
+}
+
+PresenceService::~PresenceService()
+{
+    stop();
+}
+
+// 失效通知的通道名
+const string &PresenceService::invalidateChannel()
+{
+    static const string channel = "chat:presence:invalidate";
+    return channel;
+}
+
+// 设置本节点id并启动心跳线程
+void PresenceService::start(const string &nodeId)
+{
+    _nodeId = nodeId;
+    _redis.setNodeAlive(_nodeId, _nodeTtl);
+
+    _heartbeatThread = thread(std::bind(&PresenceService::heartbeatTask, this));
+}
+
+// 停止心跳线程并等待其退出
+void PresenceService::stop()
+{
+    {
+        lock_guard<mutex> lock(_stopMutex);
+        _stopping = true;
+    }
+    _stopCond.notify_all();
+    if (_heartbeatThread.joinable())
+    {
+        _heartbeatThread.join();
+    }
+}
+
+// 心跳线程
+void PresenceService::heartbeatTask()
+{
+    unique_lock<mutex> lock(_stopMutex);
+    while (!_stopCond.wait_for(lock, _heartbeat, [this]() { return _stopping; }))
+    {
+        lock.unlock();
+        _redis.setNodeAlive(_nodeId, _nodeTtl);
+        pruneCache();
+        lock.lock();
+    }
+}
+
+// 清理过期的缓存项，未命中时回填的不在线用户（空串）也会进缓存，不清理的话会随查询过的用户数无限增长
+void PresenceService::pruneCache()
+{
+    auto now = chrono::steady_clock::now();
+    lock_guard<mutex> lock(_mutex);
+    for (auto it = _cache.begin(); it != _cache.end();)
+    {
+        if (it->second.expire <= now)
+        {
+            it = _cache.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    for (auto it = _aliveNodes.begin(); it != _aliveNodes.end();)
+    {
+        if (it->second <= now)
+        {
+            it = _aliveNodes.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+// 用户在本节点上线
+void PresenceService::online(int userid)
+{
+    _redis.setPresence(userid, _nodeId);
+    _redis.publish(invalidateChannel(), to_string(userid));
+
+    lock_guard<mutex> lock(_mutex);
+    _cache[userid] = {_nodeId, chrono::steady_clock::now() + _cacheTtl};
+}
+
+// 用户在本节点下线
+void PresenceService::offline(int userid)
+{
+    _redis.clearPresence(userid, _nodeId);
+    _redis.publish(invalidateChannel(), to_string(userid));
+
+    lock_guard<mutex> lock(_mutex);
+    _cache.erase(userid);
+    ++_invalidateSeq;
+}
+
+// 收到失效通道上的消息，删除本地缓存
+void PresenceService::invalidate(int userid)
+{
+    lock_guard<mutex> lock(_mutex);
+    _cache.erase(userid);
+    ++_invalidateSeq;
+}
+
+// redis重连后重新登记本节点的心跳和在线用户
+void PresenceService::replay(const vector<int> &localUserids)
+{
+    _redis.setNodeAlive(_nodeId, _nodeTtl);
+    for (int userid : localUserids)
+    {
+        _redis.setPresence(userid, _nodeId);
+    }
+
+    lock_guard<mutex> lock(_mutex);
+    _cache.clear();
+    _aliveNodes.clear();
+    ++_invalidateSeq;
+}
+
+string PresenceService::locate(int userid)
+{
+    return locate(vector<int>{userid})[0];
+}
+
+// 批量查询用户所在的节点，不在线返回空串
+vector<string> PresenceService::locate(const vector<int> &userids)
+{
+    vector<string> nodes(userids.size());
+    vector<int> missIds;
+    vector<size_t> missIdx;
+    unsigned long seq;
+    {
+        auto now = chrono::steady_clock::now();
+        lock_guard<mutex> lock(_mutex);
+        for (size_t i = 0; i < userids.size(); ++i)
+        {
+            auto it = _cache.find(userids[i]);
+            if (it != _cache.end() && it->second.expire > now)
+            {
+                nodes[i] = it->second.node;
+            }
+            else
+            {
+                missIds.push_back(userids[i]);
+                missIdx.push_back(i);
+            }
+        }
+        seq = _invalidateSeq;
+    }
+    _cacheHits += userids.size() - missIds.size();
+    _cacheMisses += missIds.size();
+
+    // 未命中的用户一次HMGET查询
+    if (!missIds.empty())
+    {
+        vector<string> missNodes = _redis.getPresence(missIds);
+        auto expire = chrono::steady_clock::now() + _cacheTtl;
+        lock_guard<mutex> lock(_mutex);
+        // 查询期间有失效通知，结果可能已经过时，只使用不回填
+        bool fill = seq == _invalidateSeq;
+        for (size_t i = 0; i < missIds.size(); ++i)
+        {
+            nodes[missIdx[i]] = missNodes[i];
+            if (fill)
+            {
+                _cache[missIds[i]] = {missNodes[i], expire};
+            }
+        }
+    }
+
+    filterDeadNodes(nodes);
+    return nodes;
+}
+
+// 过滤掉心跳已过期的节点
+void PresenceService::filterDeadNodes(vector<string> &nodes)
+{
+    auto now = chrono::steady_clock::now();
+    vector<string> unknown;
+    {
+        lock_guard<mutex> lock(_mutex);
+        unordered_set<string> seen;
+        for (const string &node : nodes)
+        {
+            if (node.empty() || node == _nodeId || !seen.insert(node).second)
+            {
+                continue;
+            }
+            auto it = _aliveNodes.find(node);
+            if (it == _aliveNodes.end() || it->second <= now)
+            {
+                unknown.push_back(node);
+            }
+        }
+    }
+
+    unordered_set<string> dead;
+    if (!unknown.empty())
+    {
+        // 存活结果在一个心跳间隔内有效
+        vector<bool> alive = _redis.nodesAlive(unknown);
+        lock_guard<mutex> lock(_mutex);
+        for (size_t i = 0; i < unknown.size(); ++i)
+        {
+            if (alive[i])
+            {
+                _aliveNodes[unknown[i]] = now + _heartbeat;
+            }
+            else
+            {
+                _aliveNodes.erase(unknown[i]);
+                dead.insert(unknown[i]);
+            }
+        }
+    }
+
+    if (!dead.empty())
+    {
+        for (string &node : nodes)
+        {
+            if (dead.count(node))
+            {
+                node.clear();
+            }
+        }
+    }
+}
@@ -1,134 +1,557 @@
 #include "redis.hpp"
 #include <iostream>
+#include <chrono>
+#include <sys/socket.h>
+#include <errno.h>
 using namespace std;
 
+// 订阅线程一批最多上报的消息数
+static const size_t MAX_NOTIFY_BATCH = 1024;
+
+// 在线位置表的redis key
+static const char *PRESENCE_KEY = "chat:presence";
+// 节点心跳key的前缀
+static const string NODE_ALIVE_PREFIX = "chat:node:alive:";
+
+// 记录仍指向本节点时才删除
+static const char *CLEAR_PRESENCE_SCRIPT =
+    "if redis.call('hget', KEYS[1], ARGV[1]) == ARGV[2] then "
+    "return redis.call('hdel', KEYS[1], ARGV[1]) end return 0";
+
 Redis::Redis()
-    : _publish_context(nullptr), _subcribe_context(nullptr)
+    : _port(0), _subcribe_context(nullptr), _presence_context(nullptr)
 {
 }
 
 Redis::~Redis()
 {
-    if (_publish_context != nullptr)
-    {
-        redisFree(_publish_context);
-    }
+    stopSubscriber();
+    stopStreamConsumer();
 
-    if (_subcribe_context != nullptr)
+    if (_presence_context != nullptr)
     {
-        redisFree(_subcribe_context);
+        redisFree(_presence_context);
     }
 }
 
-bool Redis::connect()
+bool Redis::connect(const char *ip, int port)
 {
-    // 负责publish发布消息的上下文连接
-    _publish_context = redisConnect("127.0.0.1", 6379);
-    if (nullptr == _publish_context)
+    _ip = ip;
+    _port = port;
+
+    // 负责publish发布消息的连接池
+    if (!_publisher.connect(ip, port))
     {
         cerr << "connect redis failed!" << endl;
         return false;
     }
 
-    // 负责subscribe订阅消息的上下文连接
-    _subcribe_context = redisConnect("127.0.0.1", 6379);
-    if (nullptr == _subcribe_context)
+    // 负责在线位置表的上下文连接
+    _presence_context = redisConnect(ip, port);
+    if (nullptr == _presence_context || _presence_context->err)
     {
         cerr << "connect redis failed!" << endl;
         return false;
     }
 
+    cout << "connect redis-server success!" << endl;
+
+    return true;
+}
+
+// 启动订阅线程，重新订阅之前订阅过的所有通道
+bool Redis::startSubscriber()
+{
+    lock_guard<mutex> lock(_subscribeMutex);
+    if (_subscribeRunning)
+    {
+        return true;
+    }
+
+    // 负责subscribe订阅消息的上下文连接
+    _subcribe_context = redisConnect(_ip.c_str(), _port);
+    if (nullptr == _subcribe_context || _subcribe_context->err)
+    {
+        cerr << "connect redis subscriber failed!" << endl;
+        if (_subcribe_context != nullptr)
+        {
+            redisFree(_subcribe_context);
+            _subcribe_context = nullptr;
+        }
+        return false;
+    }
+
+    for (const string &channel : _channels)
+    {
+        sendSubscribeCommand("SUBSCRIBE", channel);
+    }
+
     // 在单独的线程中，监听通道上的事件，有消息给业务层进行上报
-    thread t([&]() {
-        observer_channel_message();
-    });
-    t.detach();
+    _subscribeRunning = true;
+    _subscribeThread = thread(&Redis::subscribeTask, this);
+    return true;
+}
 
-    cout << "connect redis-server success!" << endl;
+// 停止订阅线程并等待其退出
+void Redis::stopSubscriber()
+{
+    {
+        lock_guard<mutex> lock(_subscribeMutex);
+        if (!_subscribeRunning)
+        {
+            return;
+        }
+        _subscribeRunning = false;
+        // 关闭socket，使阻塞在redisGetReply上的订阅线程返回；重连等待中的订阅线程会检查_subscribeRunning
+        if (_subcribe_context != nullptr)
+        {
+            ::shutdown(_subcribe_context->fd, SHUT_RDWR);
+        }
+    }
+
+    if (_subscribeThread.joinable())
+    {
+        _subscribeThread.join();
+    }
+
+    lock_guard<mutex> lock(_subscribeMutex);
+    if (_subcribe_context != nullptr)
+    {
+        redisFree(_subcribe_context);
+        _subcribe_context = nullptr;
+    }
+}
+
+// 订阅线程：接收通道消息，连接断开后重连
+void Redis::subscribeTask()
+{
+    redisContext *context = nullptr;
+    {
+        lock_guard<mutex> lock(_subscribeMutex);
+        context = _subcribe_context;
+    }
+
+    while (_subscribeRunning)
+    {
+        // 连接正常时一直阻塞在这里
+        observer_channel_message(context);
+        if (!_subscribeRunning)
+        {
+            break;
+        }
+
+        cerr << "redis subscriber disconnected, reconnecting..." << endl;
+        auto start = chrono::steady_clock::now();
+        context = reconnectSubscriber();
+        if (nullptr == context)
+        {
+            break;
+        }
+        _lastRecoveryMs = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+        ++_reconnectCnt;
+        cerr << "redis subscriber recovered after " << _lastRecoveryMs << "ms" << endl;
+
+        // redis可能是重启后恢复的，由业务层重新登记在线位置等状态
+        if (_reconnect_handler)
+        {
+            _reconnect_handler();
+        }
+    }
+}
+
+// 退避重连订阅连接并重新订阅所有通道，stopSubscriber时返回nullptr
+redisContext *Redis::reconnectSubscriber()
+{
+    for (int backoff = 100; _subscribeRunning; backoff = min(backoff * 2, 5000))
+    {
+        // 分段等待，及时响应stopSubscriber
+        for (int waited = 0; waited < backoff && _subscribeRunning; waited += 100)
+        {
+            this_thread::sleep_for(chrono::milliseconds(100));
+        }
+
+        redisContext *context = redisConnect(_ip.c_str(), _port);
+        if (nullptr == context || context->err)
+        {
+            if (context != nullptr)
+            {
+                redisFree(context);
+            }
+            continue;
+        }
+
+        lock_guard<mutex> lock(_subscribeMutex);
+        if (!_subscribeRunning)
+        {
+            redisFree(context);
+            return nullptr;
+        }
+        // 旧连接只有订阅线程在读，此时可以安全释放
+        redisFree(_subcribe_context);
+        _subcribe_context = context;
+        for (const string &channel : _channels)
+        {
+            sendSubscribeCommand("SUBSCRIBE", channel);
+        }
+        return context;
+    }
+    return nullptr;
+}
 
+// 在线位置表的连接断开时重连，调用时持有_presenceMutex
+bool Redis::ensurePresenceContext()
+{
+    if (_presence_context != nullptr && !_presence_context->err)
+    {
+        return true;
+    }
+    if (_presence_context != nullptr)
+    {
+        redisFree(_presence_context);
+    }
+    _presence_context = redisConnect(_ip.c_str(), _port);
+    if (nullptr == _presence_context || _presence_context->err)
+    {
+        if (_presence_context != nullptr)
+        {
+            redisFree(_presence_context);
+            _presence_context = nullptr;
+        }
+        return false;
+    }
+    cerr << "redis presence context reconnected" << endl;
     return true;
 }
 
 // 向redis指定的通道channel发布消息
-bool Redis::publish(int channel, string message)
+bool Redis::publish(const string &channel, const string &message)
 {
-    redisReply *reply = (redisReply *)redisCommand(_publish_context, "PUBLISH %d %s", channel, message.c_str());
-    if (nullptr == reply)
+    return _publisher.publish(channel, message.data(), message.size());
+}
+
+bool Redis::publish(const string &channel, const shared_ptr<const string> &message)
+{
+    return _publisher.publish(channel, message);
+}
+
+// 追加消息到stream
+bool Redis::appendStream(const string &stream, const shared_ptr<const string> &message)
+{
+    return _publisher.append(stream, message);
+}
+
+// 启动stream消费线程，收到的消息通过stream回调（没有设置时用notify回调）上报
+bool Redis::startStreamConsumer(const string &stream, const string &group, const string &consumer)
+{
+    if (_streamConsumer)
+    {
+        return true;
+    }
+
+    // 没有设置stream回调时，notify回调返回即确认
+    RedisStreamConsumer::Handler handler = _stream_handler;
+    if (!handler)
+    {
+        function<void(const RedisMessageBatch &)> notify = _notify_message_handler;
+        handler = [notify](const RedisMessageBatch &batch) {
+            notify(batch);
+            return true;
+        };
+    }
+
+    unique_ptr<RedisStreamConsumer> streamConsumer(new RedisStreamConsumer(stream, group, consumer));
+    if (!streamConsumer->start(_ip.c_str(), _port, handler))
     {
-        cerr << "publish command failed!" << endl;
         return false;
     }
-    freeReplyObject(reply);
+    _streamConsumer = std::move(streamConsumer);
     return true;
 }
 
-// 向redis指定的通道subscribe订阅消息
-bool Redis::subscribe(int channel)
+// 停止stream消费线程
+void Redis::stopStreamConsumer()
+{
+    if (_streamConsumer)
+    {
+        _streamConsumer->stop();
+        _streamConsumer.reset();
+    }
+}
+
+// 发送订阅相关命令，不等待响应，调用时持有_subscribeMutex
+bool Redis::sendSubscribeCommand(const char *cmd, const string &channel)
 {
+    if (nullptr == _subcribe_context)
+    {
+        // 订阅线程没有运行，启动时会重新订阅
+        return true;
+    }
+
     // SUBSCRIBE命令本身会造成线程阻塞等待通道里面发生消息，这里只做订阅通道，不接收通道消息
     // 通道消息的接收专门在observer_channel_message函数中的独立线程中进行
-    // 只负责发送命令，不阻塞接收redis server响应消息，否则和notifyMsg线程抢占响应资源
-    if (REDIS_ERR == redisAppendCommand(this->_subcribe_context, "SUBSCRIBE %d", channel))
+    // 订阅线程可能正阻塞在redisGetReply上使用这个上下文，hiredis上下文不是线程安全的，
+    // 所以不经过上下文的输出缓冲区（redisAppendCommand/redisBufferWrite），而是把格式化好的命令直接写socket，
+    // 订阅线程只读socket，两个线程不会同时修改上下文
+    char *command = nullptr;
+    int len = redisFormatCommand(&command, "%s %b", cmd, channel.data(), channel.size());
+    if (len < 0)
     {
-        cerr << "subscribe command failed!" << endl;
+        cerr << cmd << " command failed!" << endl;
         return false;
     }
-    // redisBufferWrite可以循环发送缓冲区，直到缓冲区数据发送完毕（done被置为1）
-    int done = 0;
-    while (!done)
+    int sent = 0;
+    while (sent < len)
     {
-        if (REDIS_ERR == redisBufferWrite(this->_subcribe_context, &done))
+        ssize_t n = ::send(_subcribe_context->fd, command + sent, len - sent, MSG_NOSIGNAL);
+        if (n < 0)
         {
-            cerr << "subscribe command failed!" << endl;
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            // 连接已断开，订阅线程重连后会重新订阅_channels中的所有通道
+            cerr << cmd << " command failed!" << endl;
+            redisFreeCommand(command);
             return false;
         }
+        sent += n;
     }
-    // redisGetReply
-
+    redisFreeCommand(command);
     return true;
 }
 
+// 向redis指定的通道subscribe订阅消息
+bool Redis::subscribe(const string &channel)
+{
+    lock_guard<mutex> lock(_subscribeMutex);
+    _channels.insert(channel);
+    return sendSubscribeCommand("SUBSCRIBE", channel);
+}
+
 // 向redis指定的通道unsubscribe取消订阅消息
-bool Redis::unsubscribe(int channel)
+bool Redis::unsubscribe(const string &channel)
 {
-    if (REDIS_ERR == redisAppendCommand(this->_subcribe_context, "UNSUBSCRIBE %d", channel))
+    lock_guard<mutex> lock(_subscribeMutex);
+    _channels.erase(channel);
+    return sendSubscribeCommand("UNSUBSCRIBE", channel);
+}
+
+// 记录用户登录在哪个节点
+bool Redis::setPresence(int userid, const string &node)
+{
+    lock_guard<mutex> lock(_presenceMutex);
+    if (!ensurePresenceContext())
     {
-        cerr << "unsubscribe command failed!" << endl;
         return false;
     }
-    // redisBufferWrite可以循环发送缓冲区，直到缓冲区数据发送完毕（done被置为1）
-    int done = 0;
-    while (!done)
+    redisReply *reply = (redisReply *)redisCommand(_presence_context, "HSET %s %d %b",
+                                                   PRESENCE_KEY, userid, node.data(), node.size());
+    if (nullptr == reply)
+    {
+        cerr << "set presence failed!" << endl;
+        return false;
+    }
+    freeReplyObject(reply);
+    return true;
+}
+
+// 删除用户的在线位置，只有记录仍指向node时才删除
+bool Redis::clearPresence(int userid, const string &node)
+{
+    lock_guard<mutex> lock(_presenceMutex);
+    if (!ensurePresenceContext())
+    {
+        return false;
+    }
+    redisReply *reply = (redisReply *)redisCommand(_presence_context, "EVAL %s 1 %s %d %b",
+                                                   CLEAR_PRESENCE_SCRIPT, PRESENCE_KEY, userid,
+                                                   node.data(), node.size());
+    if (nullptr == reply)
+    {
+        cerr << "clear presence failed!" << endl;
+        return false;
+    }
+    freeReplyObject(reply);
+    return true;
+}
+
+// 批量查询用户所在的节点，一次往返，不在线的用户返回空串
+vector<string> Redis::getPresence(const vector<int> &userids)
+{
+    vector<string> nodes(userids.size());
+    if (userids.empty())
+    {
+        return nodes;
+    }
+
+    // HMGET chat:presence id1 id2 ...
+    vector<string> args;
+    args.reserve(userids.size() + 2);
+    args.push_back("HMGET");
+    args.push_back(PRESENCE_KEY);
+    for (int id : userids)
+    {
+        args.push_back(to_string(id));
+    }
+    vector<const char *> argv;
+    vector<size_t> argvlen;
+    for (const string &arg : args)
+    {
+        argv.push_back(arg.data());
+        argvlen.push_back(arg.size());
+    }
+
+    lock_guard<mutex> lock(_presenceMutex);
+    if (!ensurePresenceContext())
+    {
+        return nodes;
+    }
+    redisReply *reply = (redisReply *)redisCommandArgv(_presence_context, argv.size(), argv.data(), argvlen.data());
+    if (nullptr == reply)
+    {
+        cerr << "get presence failed!" << endl;
+        return nodes;
+    }
+    if (reply->type == REDIS_REPLY_ARRAY && reply->elements == userids.size())
     {
-        if (REDIS_ERR == redisBufferWrite(this->_subcribe_context, &done))
+        for (size_t i = 0; i < reply->elements; ++i)
         {
-            cerr << "unsubscribe command failed!" << endl;
-            return false;
+            redisReply *r = reply->element[i];
+            if (r->type == REDIS_REPLY_STRING)
+            {
+                nodes[i].assign(r->str, r->len);
+            }
         }
     }
+    freeReplyObject(reply);
+    return nodes;
+}
+
+// 刷新节点心跳，ttl秒内没有再次刷新则认为节点已经下线
+bool Redis::setNodeAlive(const string &node, int ttl)
+{
+    string key = NODE_ALIVE_PREFIX + node;
+    lock_guard<mutex> lock(_presenceMutex);
+    if (!ensurePresenceContext())
+    {
+        return false;
+    }
+    redisReply *reply = (redisReply *)redisCommand(_presence_context, "SET %b 1 EX %d",
+                                                   key.data(), key.size(), ttl);
+    if (nullptr == reply)
+    {
+        cerr << "set node alive failed!" << endl;
+        return false;
+    }
+    freeReplyObject(reply);
     return true;
 }
 
+// 批量查询节点心跳是否有效
+vector<bool> Redis::nodesAlive(const vector<string> &nodes)
+{
+    // 查询失败时按存活处理，最多把消息转发给一个已下线的节点，由它的离线逻辑兜底
+    vector<bool> alive(nodes.size(), true);
+    if (nodes.empty())
+    {
+        return alive;
+    }
+
+    vector<string> args;
+    args.push_back("MGET");
+    for (const string &node : nodes)
+    {
+        args.push_back(NODE_ALIVE_PREFIX + node);
+    }
+    vector<const char *> argv;
+    vector<size_t> argvlen;
+    for (const string &arg : args)
+    {
+        argv.push_back(arg.data());
+        argvlen.push_back(arg.size());
+    }
+
+    lock_guard<mutex> lock(_presenceMutex);
+    if (!ensurePresenceContext())
+    {
+        return alive;
+    }
+    redisReply *reply = (redisReply *)redisCommandArgv(_presence_context, argv.size(), argv.data(), argvlen.data());
+    if (nullptr == reply)
+    {
+        cerr << "get node alive failed!" << endl;
+        return alive;
+    }
+    if (reply->type == REDIS_REPLY_ARRAY && reply->elements == nodes.size())
+    {
+        for (size_t i = 0; i < reply->elements; ++i)
+        {
+            alive[i] = reply->element[i]->type != REDIS_REPLY_NIL;
+        }
+    }
+    freeReplyObject(reply);
+    return alive;
+}
+
+// 订阅收到的消息加入批次
+static void appendMessage(redisReply *reply, RedisMessageBatch &batch)
+{
+    // 订阅收到的消息是一个带三元素的数组，subscribe/unsubscribe的响应第三个元素是整数
+    if (reply != nullptr && reply->type == REDIS_REPLY_ARRAY && reply->elements == 3
+        && reply->element[2]->type == REDIS_REPLY_STRING)
+    {
+        // 按长度构造，消息内容中有'\0'也不会被截断
+        batch.emplace_back(string(reply->element[1]->str, reply->element[1]->len),
+                           string(reply->element[2]->str, reply->element[2]->len));
+    }
+    freeReplyObject(reply);
+}
+
 // 在独立线程中接收订阅通道中的消息
-void Redis::observer_channel_message()
+void Redis::observer_channel_message(redisContext *context)
 {
+    RedisMessageBatch batch;
     redisReply *reply = nullptr;
-    while (REDIS_OK == redisGetReply(this->_subcribe_context, (void **)&reply))
+    // 没有消息时阻塞在redisGetReply上
+    while (REDIS_OK == redisGetReply(context, (void **)&reply))
     {
-        // 订阅收到的消息是一个带三元素的数组
-        if (reply != nullptr && reply->element[2] != nullptr && reply->element[2]->str != nullptr)
+        appendMessage(reply, batch);
+
+        // 一次read可能读入了多条消息，把已经解析出来的都取出，不再阻塞读socket
+        while (batch.size() < MAX_NOTIFY_BATCH)
         {
-            // 给业务层上报通道上发生的消息
-            _notify_message_handler(atoi(reply->element[1]->str) , reply->element[2]->str);
+            reply = nullptr;
+            if (REDIS_OK != redisReaderGetReply(context->reader, (void **)&reply) || nullptr == reply)
+            {
+                break;
+            }
+            appendMessage(reply, batch);
         }
 
-        freeReplyObject(reply);
+        if (!batch.empty())
+        {
+            _notify_message_handler(batch);
+            batch.clear();
+        }
     }
 
-    cerr << ">>>>>>>>>>>>> observer_channel_message quit <<<<<<<<<<<<<" << endl;
+    if (_subscribeRunning)
+    {
+        cerr << ">>>>>>>>>>>>> observer_channel_message quit <<<<<<<<<<<<<" << endl;
+    }
 }
 
-void Redis::init_notify_handler(function<void(int,string)> fn)
+void Redis::init_notify_handler(function<void(const RedisMessageBatch &)> fn)
 {
     this->_notify_message_handler = fn;
-}
\ No newline at end of file
+}
+
+void Redis::init_stream_handler(RedisStreamConsumer::Handler fn)
+{
+    this->_stream_handler = fn;
+}
+
+void Redis::init_reconnect_handler(function<void()> fn)
+{
+    this->_reconnect_handler = fn;
+}
@@ -0,0 +1,263 @@
+#include "redispublisher.hpp"
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <iterator>
+using namespace std;
+
+// 每个stream保留的消息条数，近似裁剪，超出的最早消息被删除
+static const long long STREAM_MAX_LEN = 100000;
+
+RedisPublisher::RedisPublisher(int connNum, size_t maxPending)
+    : _connNum(connNum), _maxPending(maxPending), _port(0)
+{
+}
+
+RedisPublisher::~RedisPublisher()
+{
+    // 先让发送线程退出，再释放它们独占的连接
+    _stopping = true;
+    for (auto &sender : _senders)
+    {
+        {
+            // 持锁设置后通知，等待中的线程不会错过唤醒
+            lock_guard<mutex> lock(sender->mtx);
+        }
+        sender->notEmpty.notify_all();
+        sender->notFull.notify_all();
+    }
+    for (auto &sender : _senders)
+    {
+        if (sender->worker.joinable())
+        {
+            sender->worker.join();
+        }
+    }
+
+    for (auto &sender : _senders)
+    {
+        if (sender->context != nullptr)
+        {
+            redisFree(sender->context);
+        }
+    }
+}
+
+// 建立连接池并启动发送线程
+bool RedisPublisher::connect(const char *ip, int port)
+{
+    _ip = ip;
+    _port = port;
+    for (int i = 0; i < _connNum; ++i)
+    {
+        unique_ptr<Sender> sender(new Sender);
+        sender->context = redisConnect(ip, port);
+        if (nullptr == sender->context || sender->context->err)
+        {
+            cerr << "connect redis publisher failed!" << endl;
+            if (sender->context != nullptr)
+            {
+                redisFree(sender->context);
+            }
+            return false;
+        }
+        _senders.push_back(std::move(sender));
+    }
+
+    for (auto &sender : _senders)
+    {
+        sender->worker = thread(std::bind(&RedisPublisher::sendTask, this, sender.get()));
+    }
+    return true;
+}
+
+// 异步发布消息，返回false表示发布器未连接
+bool RedisPublisher::publish(const string &channel, const char *data, size_t len)
+{
+    return publish(channel, make_shared<const string>(data, len));
+}
+
+// 异步发布共享的消息内容，群消息发往多个channel时不重复拷贝
+bool RedisPublisher::publish(const string &channel, const shared_ptr<const string> &message)
+{
+    return enqueue(channel, message, false);
+}
+
+// 异步追加消息到stream
+bool RedisPublisher::append(const string &stream, const shared_ptr<const string> &message)
+{
+    return enqueue(stream, message, true);
+}
+
+// 放入channel对应连接的发送队列，同一channel/stream的消息保持顺序
+bool RedisPublisher::enqueue(const string &channel, const shared_ptr<const string> &message, bool stream)
+{
+    if (_senders.empty() || _stopping)
+    {
+        return false;
+    }
+
+    Sender *sender = _senders[hash<string>()(channel) % _senders.size()].get();
+    bool wasEmpty;
+    {
+        unique_lock<mutex> lock(sender->mtx);
+        if (sender->down)
+        {
+            // 连接断开期间不阻塞业务线程，队列满时丢弃最早的消息
+            if (sender->queue.size() >= _maxPending)
+            {
+                sender->queue.pop_front();
+                ++_failedCnt;
+            }
+        }
+        else
+        {
+            sender->notFull.wait(lock, [&]() { return sender->queue.size() < _maxPending || sender->down || _stopping; });
+            if (_stopping)
+            {
+                return false;
+            }
+        }
+        wasEmpty = sender->queue.empty();
+        sender->queue.push_back({channel, message, stream});
+    }
+    // 发送线程只在队列为空时等待，非空时不需要通知
+    if (wasEmpty)
+    {
+        sender->notEmpty.notify_one();
+    }
+    return true;
+}
+
+// 发送线程
+void RedisPublisher::sendTask(Sender *sender)
+{
+    deque<PendingMsg> batch;
+    for (;;)
+    {
+        {
+            unique_lock<mutex> lock(sender->mtx);
+            sender->notEmpty.wait(lock, [&]() { return !sender->queue.empty() || _stopping; });
+            if (sender->queue.empty())
+            {
+                return;
+            }
+            // 取出所有积压的消息作为一批，发送期间新到的消息进入下一批
+            batch.swap(sender->queue);
+        }
+        sender->notFull.notify_all();
+
+        size_t sent = sendBatch(sender, batch);
+        _publishCnt += sent;
+        _batchCnt += sent > 0 ? 1 : 0;
+        long size = sent;
+        long prev = _maxBatchSize;
+        while (size > prev && !_maxBatchSize.compare_exchange_weak(prev, size))
+        {
+        }
+
+        if (sent < batch.size() && _stopping)
+        {
+            // 正在停止，不再重连，丢弃未发送的消息
+            lock_guard<mutex> lock(sender->mtx);
+            _failedCnt += batch.size() - sent + sender->queue.size();
+            sender->queue.clear();
+        }
+        else if (sent < batch.size())
+        {
+            // 没有确认的消息放回队列头部，保持顺序，重连后重发；redis可能已经执行了其中一部分，接收方需要容忍重复
+            cerr << "publish batch failed, " << batch.size() - sent << " messages wait for reconnect" << endl;
+            {
+                lock_guard<mutex> lock(sender->mtx);
+                sender->down = true;
+                sender->queue.insert(sender->queue.begin(),
+                                     make_move_iterator(batch.begin() + sent),
+                                     make_move_iterator(batch.end()));
+                if (sender->queue.size() > _maxPending)
+                {
+                    size_t drop = sender->queue.size() - _maxPending;
+                    sender->queue.erase(sender->queue.begin(), sender->queue.begin() + drop);
+                    _failedCnt += drop;
+                }
+            }
+            // 唤醒等待队列空间的业务线程，断开期间它们不再阻塞
+            sender->notFull.notify_all();
+            if (!reconnect(sender))
+            {
+                // 重连期间开始停止，留在队列中的消息不再发送
+                lock_guard<mutex> lock(sender->mtx);
+                _failedCnt += sender->queue.size();
+                sender->queue.clear();
+                return;
+            }
+            {
+                lock_guard<mutex> lock(sender->mtx);
+                sender->down = false;
+            }
+        }
+        batch.clear();
+    }
+}
+
+// 流水线发送一批消息，返回已经确认发送成功的条数
+size_t RedisPublisher::sendBatch(Sender *sender, const deque<PendingMsg> &batch)
+{
+    redisContext *c = sender->context;
+    if (nullptr == c || c->err)
+    {
+        return 0;
+    }
+
+    for (const PendingMsg &msg : batch)
+    {
+        int ret = msg.stream
+            ? redisAppendCommand(c, "XADD %b MAXLEN ~ %lld * m %b", msg.channel.data(), msg.channel.size(),
+                                 STREAM_MAX_LEN, msg.message->data(), msg.message->size())
+            : redisAppendCommand(c, "PUBLISH %b %b", msg.channel.data(), msg.channel.size(),
+                                 msg.message->data(), msg.message->size());
+        if (REDIS_ERR == ret)
+        {
+            return 0;
+        }
+    }
+
+    // 第一次redisGetReply会把输出缓冲区整批写出，之后的响应依次读取
+    for (size_t i = 0; i < batch.size(); ++i)
+    {
+        redisReply *reply = nullptr;
+        if (REDIS_OK != redisGetReply(c, (void **)&reply))
+        {
+            return i;
+        }
+        freeReplyObject(reply);
+    }
+    return batch.size();
+}
+
+// 连接断开后重连，停止时返回false
+bool RedisPublisher::reconnect(Sender *sender)
+{
+    auto start = chrono::steady_clock::now();
+    for (int backoff = 100; !_stopping; backoff = min(backoff * 2, 5000))
+    {
+        if (sender->context != nullptr)
+        {
+            redisFree(sender->context);
+        }
+        sender->context = redisConnect(_ip.c_str(), _port);
+        if (sender->context != nullptr && !sender->context->err)
+        {
+            _lastRecoveryMs = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+            ++_reconnectCnt;
+            cerr << "redis publisher reconnected after " << _lastRecoveryMs << "ms" << endl;
+            return true;
+        }
+        // 分段等待，及时响应析构
+        for (int waited = 0; waited < backoff && !_stopping; waited += 100)
+        {
+            this_thread::sleep_for(chrono::milliseconds(100));
+        }
+    }
+    return false;
+}
@@ -0,0 +1,236 @@
+#include "redisstreamconsumer.hpp"
+#include <iostream>
+#include <chrono>
+#include <cstring>
+using namespace std;
+
+// 一次XREADGROUP最多读取的消息数
+static const int READ_COUNT = 256;
+// 没有消息时XREADGROUP的阻塞时间，也是stop的最长等待时间
+static const int BLOCK_MS = 1000;
+
+RedisStreamConsumer::RedisStreamConsumer(const string &stream, const string &group, const string &consumer)
+    : _stream(stream), _group(group), _consumer(consumer), _port(0), _context(nullptr)
+{
+}
+
+RedisStreamConsumer::~RedisStreamConsumer()
+{
+    stop();
+}
+
+// 启动消费线程
+bool RedisStreamConsumer::start(const char *ip, int port, Handler handler)
+{
+    if (_running)
+    {
+        return true;
+    }
+
+    _ip = ip;
+    _port = port;
+    _handler = handler;
+    if (!connectAndCreateGroup())
+    {
+        return false;
+    }
+
+    _running = true;
+    _thread = thread(&RedisStreamConsumer::consumeTask, this);
+    return true;
+}
+
+// 停止消费线程并等待其退出
+void RedisStreamConsumer::stop()
+{
+    _running = false;
+    if (_thread.joinable())
+    {
+        _thread.join();
+    }
+
+    if (_context != nullptr)
+    {
+        redisFree(_context);
+        _context = nullptr;
+    }
+}
+
+// 建立连接并创建消费组
+bool RedisStreamConsumer::connectAndCreateGroup()
+{
+    if (_context != nullptr)
+    {
+        redisFree(_context);
+    }
+    _context = redisConnect(_ip.c_str(), _port);
+    if (nullptr == _context || _context->err)
+    {
+        cerr << "connect redis stream consumer failed!" << endl;
+        return false;
+    }
+    return createGroup();
+}
+
+// 从stream开头创建消费组，已经存在时忽略
+bool RedisStreamConsumer::createGroup()
+{
+    // 从id 0开始消费，redis重启后由发布器补发重建的stream中的消息不会被跳过；已经存在时返回BUSYGROUP错误，忽略
+    redisReply *reply = (redisReply *)redisCommand(_context, "XGROUP CREATE %b %b 0 MKSTREAM",
+                                                   _stream.data(), _stream.size(),
+                                                   _group.data(), _group.size());
+    if (nullptr == reply)
+    {
+        cerr << "create redis stream group failed!" << endl;
+        return false;
+    }
+    bool ok = reply->type != REDIS_REPLY_ERROR || strncmp(reply->str, "BUSYGROUP", 9) == 0;
+    if (!ok)
+    {
+        cerr << "create redis stream group failed: " << reply->str << endl;
+    }
+    freeReplyObject(reply);
+    return ok;
+}
+
+// 消费线程
+void RedisStreamConsumer::consumeTask()
+{
+    RedisMessageBatch batch;
+    vector<string> ids;
+    // 启动和重连后先把pending列表读完
+    bool pending = true;
+    int backoff = 100;
+    while (_running)
+    {
+        int n = readBatch(pending, batch, ids);
+        if (n < 0)
+        {
+            // 连接出错，退避重连，重连后重新读取pending列表
+            this_thread::sleep_for(chrono::milliseconds(backoff));
+            backoff = min(backoff * 2, 5000);
+            if (connectAndCreateGroup())
+            {
+                cerr << "redis stream consumer reconnected" << endl;
+                backoff = 100;
+                pending = true;
+            }
+            continue;
+        }
+
+        if (pending)
+        {
+            _redeliverCnt += n;
+            // pending列表读完，切换到读取新消息
+            pending = n > 0;
+        }
+        if (ids.empty())
+        {
+            continue;
+        }
+
+        _readCnt += ids.size();
+        ++_batchCnt;
+        if (!batch.empty() && !_handler(batch))
+        {
+            // 没有在限定时间内投递完，整批不确认，稍后从pending列表重新读取
+            batch.clear();
+            ids.clear();
+            pending = true;
+            this_thread::sleep_for(chrono::milliseconds(100));
+            continue;
+        }
+        // 消息已经交给连接发送，整批确认；确认失败的消息重连后会重新投递
+        if (ack(ids))
+        {
+            _ackCnt += ids.size();
+        }
+        batch.clear();
+        ids.clear();
+    }
+}
+
+// 读取一批消息
+int RedisStreamConsumer::readBatch(bool pending, RedisMessageBatch &batch, vector<string> &ids)
+{
+    if (nullptr == _context || _context->err)
+    {
+        return -1;
+    }
+
+    // pending列表立即返回，不需要阻塞
+    redisReply *reply = pending
+        ? (redisReply *)redisCommand(_context, "XREADGROUP GROUP %b %b COUNT %d STREAMS %b 0",
+                                     _group.data(), _group.size(), _consumer.data(), _consumer.size(),
+                                     READ_COUNT, _stream.data(), _stream.size())
+        : (redisReply *)redisCommand(_context, "XREADGROUP GROUP %b %b COUNT %d BLOCK %d STREAMS %b >",
+                                     _group.data(), _group.size(), _consumer.data(), _consumer.size(),
+                                     READ_COUNT, BLOCK_MS, _stream.data(), _stream.size());
+    if (nullptr == reply)
+    {
+        cerr << "redis stream read failed!" << endl;
+        return -1;
+    }
+    if (reply->type == REDIS_REPLY_ERROR)
+    {
+        cerr << "redis stream read failed: " << reply->str << endl;
+        // stream被删除或redis重启导致消费组不存在，在当前连接上从0重建消费组
+        bool noGroup = strncmp(reply->str, "NOGROUP", 7) == 0;
+        freeReplyObject(reply);
+        return noGroup && createGroup() ? 0 : -1;
+    }
+
+    // 超时返回nil；否则为[[stream, [[id, [field, value, ...]], ...]]]
+    if (reply->type == REDIS_REPLY_ARRAY && reply->elements > 0
+        && reply->element[0]->type == REDIS_REPLY_ARRAY && reply->element[0]->elements == 2)
+    {
+        redisReply *entries = reply->element[0]->element[1];
+        for (size_t i = 0; i < entries->elements; ++i)
+        {
+            redisReply *entry = entries->element[i];
+            if (entry->type != REDIS_REPLY_ARRAY || entry->elements != 2)
+            {
+                continue;
+            }
+            ids.emplace_back(entry->element[0]->str, entry->element[0]->len);
+
+            // 已经被裁剪掉的pending消息字段为nil，只确认不上报
+            redisReply *fields = entry->element[1];
+            if (fields->type == REDIS_REPLY_ARRAY && fields->elements >= 2)
+            {
+                batch.emplace_back(_stream, string(fields->element[1]->str, fields->element[1]->len));
+            }
+        }
+    }
+    freeReplyObject(reply);
+    return ids.size();
+}
+
+// 确认一批消息 XACK stream group id1 id2 ...
+bool RedisStreamConsumer::ack(const vector<string> &ids)
+{
+    vector<const char *> argv;
+    vector<size_t> argvlen;
+    argv.reserve(ids.size() + 3);
+    argvlen.reserve(ids.size() + 3);
+    argv.push_back("XACK");
+    argvlen.push_back(4);
+    argv.push_back(_stream.data());
+    argvlen.push_back(_stream.size());
+    argv.push_back(_group.data());
+    argvlen.push_back(_group.size());
+    for (const string &id : ids)
+    {
+        argv.push_back(id.data());
+        argvlen.push_back(id.size());
+    }
+
+    redisReply *reply = (redisReply *)redisCommandArgv(_context, argv.size(), argv.data(), argvlen.data());
+    if (nullptr == reply)
+    {
+        cerr << "redis stream ack failed!" << endl;
+        return false;
+    }
+    freeReplyObject(reply);
+    return true;
+}
@@ -1,4 +1,7 @@
 #include "web_controller.hpp"
+#include "workerpool.hpp"
+#include "groupmembercache.hpp"
+#include "friendcache.hpp"
 #include <iostream>
 #include <sstream>
 #include <iomanip>
@@ -65,6 +68,12 @@ void WebController::init()
         handleDebugUsers(req, res);
         return res;
     });
+    CROW_ROUTE(app, "/api/debug/stats")([this](const crow::request& req){
+        if (req.method != crow::HTTPMethod::Get) return crow::response(405);
+        crow::response res;
+        handleDebugStats(req, res);
+        return res;
+    });
     CROW_ROUTE(app, "/api/debug/clear")([this](const crow::request& req){
         if (req.method != crow::HTTPMethod::Post) return crow::response(405);
         crow::response res;
@@ -158,7 +167,6 @@ void WebController::handleRegister(const crow::request& req, crow::response& res
         User newUser;
         newUser.setName(name);
         newUser.setPwd(pwd);
-        newUser.setState("online");
         if (ChatService::instance()->getUserModel().insert(newUser)) {
             json response_json;
             response_json["success"] = true;
@@ -251,6 +259,8 @@ void WebController::handleGetFriends(const crow::request& req, crow::response& r
         // 获取好友列表
         std::vector<User> friends = ChatService::instance()->getFriendModel().query(userId);
         
+        std::unordered_set<int> onlineSet = queryStatus(friends);
+        
         json response_json;
         response_json["success"] = true;
         response_json["friends"] = json::array();
@@ -259,7 +269,7 @@ void WebController::handleGetFriends(const crow::request& req, crow::response& r
             json friend_json;
             friend_json["id"] = friend_user.getId();
             friend_json["name"] = friend_user.getName();
-            friend_json["status"] = friend_user.getState();
+            friend_json["status"] = onlineSet.count(friend_user.getId()) ? "online" : "offline";
             response_json["friends"].push_back(friend_json);
         }
         
@@ -329,6 +339,8 @@ void WebController::handleDebugUsers(const crow::request& req, crow::response& r
         // 获取所有用户
         std::vector<User> users = ChatService::instance()->getUserModel().queryAll();
         
+        std::unordered_set<int> onlineSet = queryStatus(users);
+        
         json response_json;
         response_json["success"] = true;
         response_json["users"] = json::array();
@@ -338,7 +350,7 @@ void WebController::handleDebugUsers(const crow::request& req, crow::response& r
             user_json["id"] = user.getId();
             user_json["name"] = user.getName();
             user_json["pwd"] = user.getPwd();
-            user_json["status"] = user.getState();
+            user_json["status"] = onlineSet.count(user.getId()) ? "online" : "offline";
             response_json["users"].push_back(user_json);
         }
         
@@ -351,6 +363,65 @@ void WebController::handleDebugUsers(const crow::request& req, crow::response& r
     }
 }
 
+// ShardedCache的通用統計
+template <typename Cache>
+static json cacheStats(const Cache& cache)
+{
+    return {
+        {"hits", cache.getHits()},
+        {"misses", cache.getMisses()},
+        {"evictions", cache.getEvictions()},
+        {"expired", cache.getExpired()},
+        {"size", cache.size()}};
+}
+
+void WebController::handleDebugStats(const crow::request& req, crow::response& res)
+{
+    try {
+        ChatService* service = ChatService::instance();
+        json response_json;
+        response_json["success"] = true;
+        response_json["node"] = service->getNodeId();
+        response_json["online"] = service->getOnlineCount();
+
+        response_json["usercache"] = cacheStats(service->getUserCache());
+        response_json["usercache"]["memoryBytes"] = service->getUserCache().memoryBytes();
+        response_json["groupmembercache"] = cacheStats(*GroupMemberCache::instance());
+        response_json["groupmembercache"]["incrementalUpdates"] = GroupMemberCache::instance()->getIncrementalUpdates();
+        response_json["friendcache"] = cacheStats(*FriendCache::instance());
+
+        const PresenceService& presence = service->getPresence();
+        response_json["presence"] = {
+            {"cacheHits", presence.getCacheHits()},
+            {"cacheMisses", presence.getCacheMisses()}};
+
+        response_json["fanout"] = {
+            {"recipients", service->getFanoutRecipients()},
+            {"encodedBytes", service->getFanoutEncodedBytes()},
+            {"nodePublishCount", service->getNodePublishCount()},
+            {"subscribeBatchCount", service->getSubscribeBatchCount()},
+            {"subscribeLoopPosts", service->getSubscribeLoopPosts()}};
+
+        // 业务线程池只在ChatServer进程中存在
+        WorkerPool* pool = service->getWorkerPool();
+        if (pool != nullptr) {
+            long tasks = pool->getTaskCount();
+            response_json["workerpool"] = {
+                {"queueSize", pool->getQueueSize()},
+                {"taskCount", tasks},
+                {"avgWaitUs", tasks > 0 ? pool->getTotalWaitUs() / tasks : 0},
+                {"maxWaitUs", pool->getMaxWaitUs()}};
+        }
+
+        res = crow::response(200, "application/json", response_json.dump());
+    } catch (const std::exception& e) {
+        json response_json;
+        response_json["success"] = false;
+        response_json["message"] = "服务器错误: " + std::string(e.what());
+        res = crow::response(500, "application/json", response_json.dump());
+    }
+}
+
 void WebController::handleDebugClear(const crow::request& req, crow::response& res)
 {
     try {
@@ -396,10 +467,8 @@ void WebController::handleWebSocketMessage(crow::websocket::connection& conn, co
                 std::lock_guard<std::mutex> lock(_wsMutex);
                 _userWebSocketMap[userId] = &conn;
             }
-            // 更新用户狀態
+            // 在線狀態由WebSocket連接表和在线状态服务給出，不再寫MySQL的state字段
             User user = ChatService::instance()->getUserModel().query(userId);
-            user.setState("online");
-            ChatService::instance()->getUserModel().updateState(user);
             json resp = { {"type", "AUTH_ACK"}, {"success", true}, {"message", "认证成功"} };
             conn.send_text(resp.dump());
             std::cout << "用户 " << user.getName() << " WebSocket认证成功" << std::endl;
@@ -439,17 +508,20 @@ void WebController::handleWebSocketMessage(crow::websocket::connection& conn, co
             int groupId = message["groupid"];
             std::string msg = message["msg"];
             std::string time = message["time"];
-            std::vector<GroupUser> groupUsers = ChatService::instance()->getGroupModel().queryGroupUsers(groupId);
-            for (const auto& groupUser : groupUsers) {
-                if (groupUser.getId() != userId) {
-                    json forward_msg = {
-                        {"type", "GROUP_CHAT_MSG"},
-                        {"groupid", groupId},
-                        {"fromid", userId},
-                        {"msg", msg},
-                        {"time", time}
-                    };
-                    sendMessageToUser(groupUser.getId(), forward_msg);
+            // 成员id来自群成员缓存，不再每条消息联表查询
+            GroupMembersPtr members = ChatService::instance()->getGroupModel().queryGroupMembers(groupId);
+            if (members) {
+                json forward_msg = {
+                    {"type", "GROUP_CHAT_MSG"},
+                    {"groupid", groupId},
+                    {"fromid", userId},
+                    {"msg", msg},
+                    {"time", time}
+                };
+                for (int memberId : members->ids) {
+                    if (memberId != userId) {
+                        sendMessageToUser(memberId, forward_msg);
+                    }
                 }
             }
         }
@@ -474,16 +546,33 @@ void WebController::handleWebSocketClose(crow::websocket::connection& conn)
     }
     
     if (userId != -1) {
-        // 更新用户狀態
+        // 從連接表移除即視為離線，不再寫MySQL的state字段
         User user = ChatService::instance()->getUserModel().query(userId);
         if (user.getId() != -1) {
-            user.setState("offline");
-            ChatService::instance()->getUserModel().updateState(user);
             std::cout << "用户 " << user.getName() << " WebSocket连接关闭" << std::endl;
         }
     }
 }
 
+// 查詢用户的在線狀態：持有WebSocket連接的用户，以及在线状态服务中登記在聊天節點上的用户
+std::unordered_set<int> WebController::queryStatus(const std::vector<User>& users)
+{
+    std::vector<int> ids;
+    ids.reserve(users.size());
+    for (const auto& user : users) {
+        ids.push_back(user.getId());
+    }
+    std::unordered_set<int> onlineSet = ChatService::instance()->queryOnline(ids);
+
+    std::lock_guard<std::mutex> lock(_wsMutex);
+    for (int id : ids) {
+        if (_userWebSocketMap.count(id)) {
+            onlineSet.insert(id);
+        }
+    }
+    return onlineSet;
+}
+
 void WebController::sendMessageToUser(int userId, const json& message)
 {
     std::lock_guard<std::mutex> lock(_wsMutex);
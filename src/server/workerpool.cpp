@@ -0,0 +1,88 @@
+#include "workerpool.hpp"
+#include "connectionpool.h"
+#include <muduo/base/Logging.h>
+#include <thread>
+#include <exception>
+
+WorkerPool::WorkerPool(int threadNum, size_t maxQueueSize)
+    : _threadNum(threadNum)
+    , _maxQueueSize(maxQueueSize)
+{
+    for (int i = 0; i < _threadNum; ++i)
+    {
+        _workers.emplace_back(new Worker);
+    }
+}
+
+// 启动工作线程
+void WorkerPool::start()
+{
+    for (auto &worker : _workers)
+    {
+        thread t(std::bind(&WorkerPool::runInThread, this, worker.get()));
+        t.detach();
+    }
+}
+
+// 提交任务，key相同的任务按提交顺序串行执行
+bool WorkerPool::submit(size_t key, Task task)
+{
+    Worker *worker = _workers[key % _workers.size()].get();
+    bool belowLimit;
+    {
+        lock_guard<mutex> lock(worker->mtx);
+        worker->queue.push_back({std::move(task), chrono::steady_clock::now()});
+        belowLimit = worker->queue.size() < _maxQueueSize;
+    }
+    worker->notEmpty.notify_one();
+    return belowLimit;
+}
+
+// 当前所有队列中等待执行的任务数
+size_t WorkerPool::getQueueSize()
+{
+    size_t size = 0;
+    for (auto &worker : _workers)
+    {
+        lock_guard<mutex> lock(worker->mtx);
+        size += worker->queue.size();
+    }
+    return size;
+}
+
+// 工作线程
+void WorkerPool::runInThread(Worker *worker)
+{
+    // 模型操作都在业务线程上执行，每个业务线程固定缓存一个MySQL连接
+    ConnectionPool::enableThreadCache();
+
+    for (;;)
+    {
+        PendingTask pending;
+        {
+            unique_lock<mutex> lock(worker->mtx);
+            worker->notEmpty.wait(lock, [&]() { return !worker->queue.empty(); });
+            pending = std::move(worker->queue.front());
+            worker->queue.pop_front();
+        }
+
+        long waitUs = chrono::duration_cast<chrono::microseconds>(
+                          chrono::steady_clock::now() - pending.enqueueTime).count();
+        _totalWaitUs += waitUs;
+        long prev = _maxWaitUs;
+        while (waitUs > prev && !_maxWaitUs.compare_exchange_weak(prev, waitUs))
+        {
+        }
+
+        // 单个任务的异常不能让工作线程退出
+        try
+        {
+            pending.task();
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERROR << "worker task exception: " << e.what();
+        }
+        ++_taskCnt;
+    }
+}
@@ -0,0 +1,253 @@
+/*
+OneChatBatcher 并发测试与参数扫描（模拟后端，不需要真实的 message service）
+1. 多个生产者线程并发 add()，模拟网关的多个 I/O 线程；校验每条消息的 done 恰好调用一次、批次不超过 maxBatch，
+   可以配合 -DENABLE_TSAN=ON 构建检查数据竞争
+2. 模拟后端：固定数量的工作线程处理批次，每次调用有固定开销，另加每条消息的落库开销，
+   批越大摊到每条消息上的固定开销越小，但消息要多等攒批窗口
+3. 扫描 maxBatch × window，分两种负载输出吞吐、平均批大小和 add() 到 done 的 p50/p99 延迟：
+   saturated  每个生产者最多 64 条在途（对应网关单连接的在途上限），测后端能承受的吞吐
+   light      每个生产者每 1ms 发一条，测低负载时攒批窗口带来的额外延迟
+用法：chat_batch_bench [生产者线程数] [每线程消息数]
+*/
+#include "OneChatBatcher.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+using Clock = chrono::steady_clock;
+
+// 模拟的 message service：workers 个线程并发处理批次，处理完逐条回调 done
+class FakeMessageService
+{
+public:
+    FakeMessageService(int workers, chrono::microseconds perCall, chrono::microseconds perMessage)
+        : _perCall(perCall), _perMessage(perMessage)
+    {
+        for (int i = 0; i < workers; ++i)
+        {
+            _threads.emplace_back([this]() { run(); });
+        }
+    }
+
+    ~FakeMessageService()
+    {
+        {
+            lock_guard<mutex> lock(_mutex);
+            _running = false;
+        }
+        _cv.notify_all();
+        for (thread &t : _threads)
+        {
+            t.join();
+        }
+    }
+
+    // 对应 OneChatBatcher 的 flush 回调，只入队不阻塞
+    void submit(shared_ptr<chat::message::OneChatBatchRequest> req, shared_ptr<vector<OneChatBatcher::Done>> dones)
+    {
+        {
+            lock_guard<mutex> lock(_mutex);
+            _queue.emplace_back(std::move(req), std::move(dones));
+        }
+        _cv.notify_one();
+    }
+
+    long calls() const { return _calls; }
+    long maxBatch() const { return _maxBatch; }
+    bool sizeMismatch() const { return _sizeMismatch; }
+
+private:
+    void run()
+    {
+        for (;;)
+        {
+            pair<shared_ptr<chat::message::OneChatBatchRequest>, shared_ptr<vector<OneChatBatcher::Done>>> batch;
+            {
+                unique_lock<mutex> lock(_mutex);
+                _cv.wait(lock, [this]() { return !_running || !_queue.empty(); });
+                if (_queue.empty())
+                {
+                    return;
+                }
+                batch = std::move(_queue.front());
+                _queue.pop_front();
+            }
+            const auto &req = *batch.first;
+            auto &dones = *batch.second;
+            if (static_cast<size_t>(req.msgs_size()) != dones.size())
+            {
+                _sizeMismatch = true;
+            }
+            long n = static_cast<long>(dones.size());
+            long prev = _maxBatch.load();
+            while (n > prev && !_maxBatch.compare_exchange_weak(prev, n))
+            {
+            }
+            ++_calls;
+
+            this_thread::sleep_for(_perCall + _perMessage * n);
+            chat::message::OneChatBatchResponse resp;
+            resp.set_err_no(0);
+            for (auto &done : dones)
+            {
+                done(grpc::Status::OK, resp);
+            }
+        }
+    }
+
+    const chrono::microseconds _perCall;
+    const chrono::microseconds _perMessage;
+    vector<thread> _threads;
+    mutex _mutex;
+    condition_variable _cv;
+    bool _running = true;
+    deque<pair<shared_ptr<chat::message::OneChatBatchRequest>, shared_ptr<vector<OneChatBatcher::Done>>>> _queue;
+    atomic<long> _calls{0};
+    atomic<long> _maxBatch{0};
+    atomic<bool> _sizeMismatch{false};
+};
+
+struct Result
+{
+    double seconds = 0;
+    long messages = 0;
+    long calls = 0;
+    long p50Us = 0;
+    long p99Us = 0;
+    bool ok = true;
+};
+
+static const int kProducerInflight = 64;
+
+static Result run(size_t maxBatch, chrono::microseconds window, bool saturated, int producers, int perProducer)
+{
+    const long total = static_cast<long>(producers) * perProducer;
+    vector<long> latencyUs(total, -1);
+    vector<unique_ptr<atomic<int>>> inflight;
+    for (int i = 0; i < producers; ++i)
+    {
+        inflight.emplace_back(new atomic<int>(0));
+    }
+    atomic<long> doneCount{0};
+    atomic<long> duplicate{0};
+
+    Result r;
+    auto begin = Clock::now();
+    {
+        // 后端 4 个工作线程，每次调用 300us 固定开销，每条消息 5us
+        FakeMessageService backend(4, chrono::microseconds(300), chrono::microseconds(5));
+        {
+            OneChatBatcher batcher(
+                [&backend](shared_ptr<chat::message::OneChatBatchRequest> req, shared_ptr<vector<OneChatBatcher::Done>> dones) {
+                    backend.submit(std::move(req), std::move(dones));
+                },
+                maxBatch, window);
+
+            vector<thread> threads;
+            for (int p = 0; p < producers; ++p)
+            {
+                threads.emplace_back([&, p]() {
+                    atomic<int> &mine = *inflight[p];
+                    auto next = Clock::now();
+                    for (int i = 0; i < perProducer; ++i)
+                    {
+                        if (saturated)
+                        {
+                            while (mine.load() >= kProducerInflight)
+                            {
+                                this_thread::sleep_for(chrono::microseconds(20));
+                            }
+                        }
+                        else
+                        {
+                            next += chrono::milliseconds(1);
+                            this_thread::sleep_until(next);
+                        }
+                        long slot = static_cast<long>(p) * perProducer + i;
+                        chat::common::ChatMessage msg;
+                        msg.set_from_id(p);
+                        msg.set_to_id(i);
+                        msg.set_content("hello");
+                        ++mine;
+                        auto added = Clock::now();
+                        batcher.add(msg, [&, slot, added](const grpc::Status &, const chat::message::OneChatBatchResponse &) {
+                            long us = chrono::duration_cast<chrono::microseconds>(Clock::now() - added).count();
+                            if (latencyUs[slot] != -1)
+                            {
+                                ++duplicate;
+                            }
+                            latencyUs[slot] = us;
+                            --*inflight[slot / perProducer];
+                            ++doneCount;
+                        });
+                    }
+                });
+            }
+            for (thread &t : threads)
+            {
+                t.join();
+            }
+            // 析构时发出剩余批次
+        }
+        while (doneCount.load() < total && Clock::now() - begin < chrono::seconds(60))
+        {
+            this_thread::sleep_for(chrono::microseconds(200));
+        }
+        r.calls = backend.calls();
+        r.ok = !backend.sizeMismatch() && static_cast<size_t>(backend.maxBatch()) <= maxBatch;
+    }
+    r.seconds = chrono::duration<double>(Clock::now() - begin).count();
+    r.messages = doneCount;
+    r.ok = r.ok && duplicate == 0 && r.messages == total;
+
+    sort(latencyUs.begin(), latencyUs.end());
+    r.p50Us = latencyUs[total / 2];
+    r.p99Us = latencyUs[static_cast<size_t>(total * 0.99)];
+    return r;
+}
+
+int main(int argc, char **argv)
+{
+    int producers = argc > 1 ? atoi(argv[1]) : 4;
+    int perProducer = argc > 2 ? atoi(argv[2]) : 5000;
+
+    const size_t batches[] = {1, 8, 32, 64, 128};
+    const int windowsUs[] = {500, 2000, 5000};
+    bool allOk = true;
+
+    printf("producers=%d messages/producer=%d backend: 4 workers, 300us/call + 5us/message\n", producers, perProducer);
+    for (int saturated = 1; saturated >= 0; --saturated)
+    {
+        printf("%s\n", saturated ? "saturated (64 in flight per producer)" : "light (1 message/ms per producer)");
+        printf("  %8s %9s %12s %10s %10s %10s\n", "maxBatch", "window", "msgs/s", "avgBatch", "p50", "p99");
+        for (size_t maxBatch : batches)
+        {
+            for (int windowUs : windowsUs)
+            {
+                // 不合并时窗口没有意义，只跑一次
+                if (maxBatch == 1 && windowUs != windowsUs[0])
+                {
+                    continue;
+                }
+                Result r = run(maxBatch, chrono::microseconds(windowUs), saturated, producers,
+                               saturated ? perProducer : min(perProducer, 1000));
+                printf("  %8zu %7dus %12.0f %10.1f %8ldus %8ldus%s\n", maxBatch, windowUs,
+                       r.messages / r.seconds, r.calls ? static_cast<double>(r.messages) / r.calls : 0.0,
+                       r.p50Us, r.p99Us, r.ok ? "" : "  FAILED");
+                allOk = allOk && r.ok;
+            }
+        }
+    }
+    printf("%s\n", allOk ? "all runs consistent" : "inconsistent results: lost, duplicated or oversized batches");
+    return allOk ? 0 : 1;
+}
@@ -0,0 +1,278 @@
+/*
+ServiceWatcher / ConsulClient 阻塞查询测试
+进程内起一个最小的 Consul 替身，只实现 GET /v1/health/service/<name>?index=N&wait=Ns：
+1. index 与当前 index 相同时挂起到数据变化或 wait 超时，否则立即返回，响应头带 X-Consul-Index
+2. 记录每次请求带的 index，用来确认客户端确实在做阻塞查询以及 index 回退后从 0 重新开始
+检查三件事：
+1. 服务列表变化后，正在等待的长轮询立即返回，新端点远早于 wait 超时生效
+2. index 回退（Consul 重建、快照恢复）时从 index=0 重新查询，新端点照常生效
+3. stop() 能打断正在进行的长轮询，不必等到 wait 超时
+*/
+#include "ServiceWatcher.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// 最小的 Consul 健康查询替身，每个连接一个线程，响应后关闭连接
+class FakeConsul
+{
+public:
+    FakeConsul()
+    {
+        _listenFd = ::socket(AF_INET, SOCK_STREAM, 0);
+        int on = 1;
+        ::setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        if (::bind(_listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+            ::listen(_listenFd, 64) != 0)
+        {
+            cerr << "fake consul: bind/listen failed" << endl;
+            exit(2);
+        }
+        socklen_t len = sizeof(addr);
+        ::getsockname(_listenFd, reinterpret_cast<sockaddr *>(&addr), &len);
+        _port = ntohs(addr.sin_port);
+        _acceptThread = thread([this]() { acceptLoop(); });
+    }
+
+    ~FakeConsul()
+    {
+        {
+            lock_guard<mutex> lock(_mutex);
+            _running = false;
+        }
+        _cv.notify_all();
+        ::shutdown(_listenFd, SHUT_RDWR);
+        ::close(_listenFd);
+        _acceptThread.join();
+        for (thread &t : _workers)
+        {
+            t.join();
+        }
+    }
+
+    int port() const { return _port; }
+
+    // 修改服务列表和 index，唤醒所有挂起的查询
+    void set(uint64_t index, vector<pair<string, int>> endpoints)
+    {
+        {
+            lock_guard<mutex> lock(_mutex);
+            _index = index;
+            _endpoints = std::move(endpoints);
+        }
+        _cv.notify_all();
+    }
+
+    // 到目前为止收到的请求所带的 index，按到达顺序
+    vector<uint64_t> requestedIndexes()
+    {
+        lock_guard<mutex> lock(_mutex);
+        return _requested;
+    }
+
+    // 当前挂起中的查询数
+    int waiting()
+    {
+        lock_guard<mutex> lock(_mutex);
+        return _waiting;
+    }
+
+private:
+    void acceptLoop()
+    {
+        for (;;)
+        {
+            int fd = ::accept(_listenFd, nullptr, nullptr);
+            if (fd < 0)
+            {
+                return;
+            }
+            lock_guard<mutex> lock(_mutex);
+            if (!_running)
+            {
+                ::close(fd);
+                return;
+            }
+            _workers.emplace_back([this, fd]() { serve(fd); });
+        }
+    }
+
+    static uint64_t queryValue(const string &path, const string &key, uint64_t def)
+    {
+        size_t pos = path.find(key + "=");
+        if (pos == string::npos)
+        {
+            return def;
+        }
+        return strtoull(path.c_str() + pos + key.size() + 1, nullptr, 10);
+    }
+
+    void serve(int fd)
+    {
+        string request;
+        char buf[4096];
+        while (request.find("\r\n\r\n") == string::npos)
+        {
+            ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0)
+            {
+                ::close(fd);
+                return;
+            }
+            request.append(buf, n);
+        }
+        string path = request.substr(0, request.find("\r\n"));
+        uint64_t index = queryValue(path, "index", 0);
+        uint64_t wait = queryValue(path, "wait", 1);
+
+        string body;
+        uint64_t current;
+        {
+            unique_lock<mutex> lock(_mutex);
+            _requested.push_back(index);
+            // 和 Consul 一样：index 为 0 或已经过时的查询立即返回，否则等到数据变化或超时
+            auto deadline = chrono::steady_clock::now() + chrono::seconds(wait);
+            ++_waiting;
+            while (_running && index != 0 && _index == index &&
+                   _cv.wait_until(lock, deadline) != cv_status::timeout)
+            {
+            }
+            --_waiting;
+            current = _index;
+            body = "[";
+            for (size_t i = 0; i < _endpoints.size(); ++i)
+            {
+                if (i > 0)
+                {
+                    body += ",";
+                }
+                const auto &ep = _endpoints[i];
+                body += "{\"Service\":{\"ID\":\"" + ep.first + ":" + to_string(ep.second) +
+                        "\",\"Name\":\"svc\",\"Address\":\"" + ep.first +
+                        "\",\"Port\":" + to_string(ep.second) + ",\"Tags\":[]}}";
+            }
+            body += "]";
+        }
+
+        string response = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nX-Consul-Index: " +
+                          to_string(current) + "\r\nContent-Length: " + to_string(body.size()) +
+                          "\r\nConnection: close\r\n\r\n" + body;
+        ::send(fd, response.data(), response.size(), MSG_NOSIGNAL);
+        ::close(fd);
+    }
+
+    int _listenFd = -1;
+    int _port = 0;
+    thread _acceptThread;
+    vector<thread> _workers;
+
+    mutex _mutex;
+    condition_variable _cv;
+    bool _running = true;
+    uint64_t _index = 5;
+    vector<pair<string, int>> _endpoints{{"10.0.0.1", 1}};
+    vector<uint64_t> _requested;
+    int _waiting = 0;
+};
+
+static int g_failures = 0;
+
+static void check(bool ok, const string &what)
+{
+    cout << (ok ? "[PASS] " : "[FAIL] ") << what << endl;
+    if (!ok)
+    {
+        ++g_failures;
+    }
+}
+
+// 等到 pred 成立或超时，返回等待的毫秒数，超时返回 -1
+template <typename Pred>
+static long waitFor(Pred pred, chrono::milliseconds timeout)
+{
+    auto start = chrono::steady_clock::now();
+    while (!pred())
+    {
+        if (chrono::steady_clock::now() - start > timeout)
+        {
+            return -1;
+        }
+        this_thread::sleep_for(chrono::milliseconds(5));
+    }
+    return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+}
+
+static bool hasSequence(const vector<uint64_t> &seq, const vector<uint64_t> &expected, size_t from)
+{
+    size_t k = 0;
+    for (size_t i = from; i < seq.size() && k < expected.size(); ++i)
+    {
+        if (seq[i] == expected[k])
+        {
+            ++k;
+        }
+    }
+    return k == expected.size();
+}
+
+int main()
+{
+    const int kWaitSeconds = 10;
+    FakeConsul consul;
+    ConsulClient client("http://127.0.0.1:" + to_string(consul.port()));
+    ServiceWatcher watcher(client, kWaitSeconds);
+    watcher.watch("svc", {"fallback:1"}, nullptr);
+
+    auto endpointsAre = [&](const vector<string> &expected) {
+        return *watcher.endpoints("svc") == expected;
+    };
+
+    watcher.start();
+    long initialMs = waitFor([&]() { return endpointsAre({"10.0.0.1:1"}); }, chrono::seconds(5));
+    check(initialMs >= 0, "initial query publishes the Consul endpoints (" + to_string(initialMs) + " ms)");
+
+    // 1. 变化唤醒：watcher 挂在 index=5 上，修改后应立即返回
+    waitFor([&]() { return consul.waiting() > 0; }, chrono::seconds(5));
+    consul.set(9, {{"10.0.0.1", 1}, {"10.0.0.2", 2}});
+    long wakeMs = waitFor([&]() { return endpointsAre({"10.0.0.1:1", "10.0.0.2:2"}); }, chrono::seconds(5));
+    check(wakeMs >= 0 && wakeMs < 1000,
+          "change wakes the pending long-poll (" + to_string(wakeMs) + " ms, wait=" + to_string(kWaitSeconds) + "s)");
+    check(hasSequence(consul.requestedIndexes(), {0, 5}, 0), "queries block on the last X-Consul-Index");
+
+    // 2. index 回退：从 9 退到 3，客户端应先用 index=0 重新查询，再阻塞在 3 上
+    waitFor([&]() { return consul.waiting() > 0; }, chrono::seconds(5));
+    size_t before = consul.requestedIndexes().size();
+    consul.set(3, {{"10.0.0.3", 3}});
+    long resetMs = waitFor([&]() { return endpointsAre({"10.0.0.3:3"}); }, chrono::seconds(5));
+    check(resetMs >= 0, "endpoints after an index reset are published (" + to_string(resetMs) + " ms)");
+    waitFor([&]() { return consul.waiting() > 0 && consul.requestedIndexes().back() == 3; }, chrono::seconds(5));
+    check(hasSequence(consul.requestedIndexes(), {0, 3}, before), "index reset restarts the blocking query from 0");
+
+    // 3. stop() 打断挂起的长轮询
+    auto stopStart = chrono::steady_clock::now();
+    watcher.stop();
+    long stopMs = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - stopStart).count();
+    check(stopMs < 3000, "stop() interrupts the pending wait (" + to_string(stopMs) + " ms, wait=" +
+                             to_string(kWaitSeconds) + "s)");
+    check(watcher.errors() == 0, "no query errors before stop");
+
+    cout << (g_failures == 0 ? "all checks passed" : to_string(g_failures) + " check(s) failed") << endl;
+    return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,167 @@
+/*
+登录响应序列化基准：JsonWriter直接写Buffer vs 构造json DOM再dump()
+1. 构造和ChatService登录响应相同结构的数据：friends个好友，groups个群，每个群members个成员
+2. 两种方式各重复rounds次，输出每次序列化的平均耗时和输出字节数
+3. JsonWriter的耗时包括写入Buffer；dump()的耗时包括构造DOM、dump()和拷贝到Buffer，
+   即改造前登录路径上的全部序列化开销
+4. 两种输出解析后必须相等
+用法：jsonwriter_bench [好友数] [群数] [每群成员数] [轮数]
+*/
+#include "jsonwriter.hpp"
+#include "json.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+using namespace std;
+using json = nlohmann::json;
+
+using Clock = chrono::steady_clock;
+
+struct Member
+{
+    int id;
+    string name;
+    string state;
+    string role;
+};
+
+struct GroupData
+{
+    int id;
+    string name;
+    string desc;
+    vector<Member> users;
+};
+
+static void writeAck(Buffer *buf, const vector<Member> &friends, const vector<GroupData> &groups)
+{
+    JsonWriter w(buf);
+    w.startObject().field("msgid", 2).field("errno", 0).field("id", 1).field("name", "zhang san");
+    w.key("friends").startArray();
+    for (const Member &f : friends)
+    {
+        w.startObject().field("id", f.id).field("name", f.name).field("state", f.state).endObject();
+    }
+    w.endArray();
+    w.key("groups").startArray();
+    for (const GroupData &g : groups)
+    {
+        w.startObject()
+            .field("id", g.id)
+            .field("groupname", g.name)
+            .field("groupdesc", g.desc)
+            .field("membercount", static_cast<int>(g.users.size()));
+        w.key("users").startArray();
+        for (const Member &m : g.users)
+        {
+            w.startObject().field("id", m.id).field("name", m.name).field("state", m.state).field("role", m.role).endObject();
+        }
+        w.endArray().endObject();
+    }
+    w.endArray().endObject();
+}
+
+// 改造前的做法：构造DOM，好友和群都是嵌套对象
+static void dumpAck(Buffer *buf, const vector<Member> &friends, const vector<GroupData> &groups)
+{
+    json js;
+    js["msgid"] = 2;
+    js["errno"] = 0;
+    js["id"] = 1;
+    js["name"] = "zhang san";
+    json friendArr = json::array();
+    for (const Member &f : friends)
+    {
+        friendArr.push_back({{"id", f.id}, {"name", f.name}, {"state", f.state}});
+    }
+    js["friends"] = move(friendArr);
+    json groupArr = json::array();
+    for (const GroupData &g : groups)
+    {
+        json grp;
+        grp["id"] = g.id;
+        grp["groupname"] = g.name;
+        grp["groupdesc"] = g.desc;
+        grp["membercount"] = static_cast<int>(g.users.size());
+        json users = json::array();
+        for (const Member &m : g.users)
+        {
+            users.push_back({{"id", m.id}, {"name", m.name}, {"state", m.state}, {"role", m.role}});
+        }
+        grp["users"] = move(users);
+        groupArr.push_back(move(grp));
+    }
+    js["groups"] = move(groupArr);
+    string s = js.dump();
+    buf->append(s.data(), s.size());
+}
+
+template <typename Fn>
+static double timeUs(Fn fn, int rounds, size_t *bytes)
+{
+    Buffer buf;
+    auto begin = Clock::now();
+    for (int i = 0; i < rounds; ++i)
+    {
+        buf.retrieveAll();
+        fn(&buf);
+    }
+    double us = chrono::duration<double, micro>(Clock::now() - begin).count() / rounds;
+    *bytes = buf.readableBytes();
+    return us;
+}
+
+int main(int argc, char **argv)
+{
+    int friendCount = argc > 1 ? atoi(argv[1]) : 1000;
+    int groupCount = argc > 2 ? atoi(argv[2]) : 100;
+    int memberCount = argc > 3 ? atoi(argv[3]) : 20;
+    int rounds = argc > 4 ? atoi(argv[4]) : 200;
+
+    // 名字里带中文，走UTF-8校验的路径
+    vector<Member> friends;
+    for (int i = 0; i < friendCount; ++i)
+    {
+        friends.push_back({1000 + i, "用户" + to_string(i), i % 3 ? "offline" : "online", ""});
+    }
+    vector<GroupData> groups;
+    for (int g = 0; g < groupCount; ++g)
+    {
+        GroupData group{g + 1, "group" + to_string(g), "群描述 \"" + to_string(g) + "\"", {}};
+        for (int m = 0; m < memberCount; ++m)
+        {
+            group.users.push_back({5000 + g * memberCount + m, "成员" + to_string(m), m % 2 ? "online" : "offline",
+                                   m == 0 ? "creator" : "normal"});
+        }
+        groups.push_back(move(group));
+    }
+
+    Buffer a;
+    Buffer b;
+    writeAck(&a, friends, groups);
+    dumpAck(&b, friends, groups);
+    if (json::parse(a.retrieveAllAsString()) != json::parse(b.retrieveAllAsString()))
+    {
+        fprintf(stderr, "JsonWriter output differs from dump()\n");
+        return 1;
+    }
+
+    // 预热
+    size_t writerBytes = 0;
+    size_t dumpBytes = 0;
+    timeUs([&](Buffer *buf) { writeAck(buf, friends, groups); }, rounds / 10 + 1, &writerBytes);
+    timeUs([&](Buffer *buf) { dumpAck(buf, friends, groups); }, rounds / 10 + 1, &dumpBytes);
+
+    double writerUs = timeUs([&](Buffer *buf) { writeAck(buf, friends, groups); }, rounds, &writerBytes);
+    double dumpUs = timeUs([&](Buffer *buf) { dumpAck(buf, friends, groups); }, rounds, &dumpBytes);
+
+    printf("friends=%d groups=%d members/group=%d rounds=%d\n", friendCount, groupCount, memberCount, rounds);
+    printf("%12s %12s %10s\n", "mode", "us/build", "bytes");
+    printf("%12s %12.1f %10zu\n", "JsonWriter", writerUs, writerBytes);
+    printf("%12s %12.1f %10zu\n", "DOM dump()", dumpUs, dumpBytes);
+    printf("JsonWriter is %.1fx faster\n", dumpUs / writerUs);
+    return 0;
+}
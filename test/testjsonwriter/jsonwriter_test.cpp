@@ -0,0 +1,157 @@
+/*
+JsonWriter 转义与结构测试，以nlohmann::json为参照
+1. 嵌套的对象/数组、整数边界值、bool按dump()的格式输出，逗号位置正确
+2. 引号、反斜杠、控制字符的转义与dump()相同，0x7f和'/'不转义
+3. 合法的UTF-8(2/3/4字节)原样输出
+4. 非法的UTF-8(孤立续字节、过长编码、代理区、超过U+10FFFF、截断)替换为U+FFFD，
+   和dump(-1, ' ', false, error_handler_t::replace)逐字节相同；另外用随机字节串做对照
+*/
+#include "jsonwriter.hpp"
+#include "json.hpp"
+
+#include <climits>
+#include <iostream>
+#include <random>
+#include <string>
+using namespace std;
+using json = nlohmann::json;
+
+static int g_failures = 0;
+
+static void check(bool ok, const string &what)
+{
+    cout << (ok ? "[PASS] " : "[FAIL] ") << what << endl;
+    if (!ok)
+    {
+        ++g_failures;
+    }
+}
+
+// JsonWriter写一个字符串值
+static string writeString(const string &s)
+{
+    Buffer buf;
+    JsonWriter w(&buf);
+    w.value(s);
+    return buf.retrieveAllAsString();
+}
+
+// nlohmann::json对同一字符串的输出，非法UTF-8替换为U+FFFD
+static string dumpString(const string &s)
+{
+    return json(s).dump(-1, ' ', false, json::error_handler_t::replace);
+}
+
+static string hex(const string &s)
+{
+    static const char digits[] = "0123456789abcdef";
+    string out;
+    for (unsigned char c : s)
+    {
+        out += digits[c >> 4];
+        out += digits[c & 0xf];
+        out += ' ';
+    }
+    return out;
+}
+
+static void checkString(const string &s, const string &what)
+{
+    string got = writeString(s);
+    string want = dumpString(s);
+    check(got == want, what + (got == want ? "" : ": got " + hex(got) + "want " + hex(want)));
+}
+
+int main()
+{
+    // 1. 结构
+    {
+        Buffer buf;
+        JsonWriter w(&buf);
+        w.startObject()
+            .field("a", 1)
+            .field("min", LLONG_MIN)
+            .field("max", LLONG_MAX)
+            .field("t", true)
+            .field("f", false)
+            .key("empty").startArray().endArray()
+            .key("obj").startObject().endObject()
+            .key("list").startArray();
+        for (int i = 0; i < 3; ++i)
+        {
+            w.startObject().field("id", i).key("tags").startArray().value("x").value(string("y")).endArray().endObject();
+        }
+        w.endArray().endObject();
+
+        json js;
+        js["a"] = 1;
+        js["min"] = LLONG_MIN;
+        js["max"] = LLONG_MAX;
+        js["t"] = true;
+        js["f"] = false;
+        js["empty"] = json::array();
+        js["obj"] = json::object();
+        for (int i = 0; i < 3; ++i)
+        {
+            js["list"].push_back({{"id", i}, {"tags", {"x", "y"}}});
+        }
+        string out = buf.retrieveAllAsString();
+        check(json::parse(out) == js, "nested objects and arrays round-trip: " + out);
+    }
+
+    // 2. 转义
+    checkString("", "empty string");
+    checkString("plain ascii / slash ~\x7f", "printable ascii, '/' and 0x7f pass through");
+    checkString("q\"b\\", "quote and backslash");
+    checkString("\b\f\n\r\t", "short escapes");
+    checkString(string("\x00\x01\x1f", 3), "other control characters as \\u00xx");
+    check(writeString(string("a\0b", 3)) == "\"a\\u0000b\"", "embedded NUL is escaped, not truncated");
+
+    // 3. 合法的UTF-8
+    checkString("\xc2\xa9 \xe4\xbd\xa0\xe5\xa5\xbd \xf0\x9f\x98\x80", "2/3/4-byte UTF-8 passes through");
+    checkString("\xed\x9f\xbf\xee\x80\x80\xf4\x8f\xbf\xbf", "boundaries around surrogates and U+10FFFF");
+
+    // 4. 非法的UTF-8
+    checkString("a\x80z", "stray continuation byte");
+    checkString("\xc0\xaf\xc1\xbf", "overlong 2-byte encodings");
+    checkString("\xe0\x80\xaf", "overlong 3-byte encoding");
+    checkString("\xed\xa0\x80", "UTF-16 surrogate");
+    checkString("\xf4\x90\x80\x80\xf5\xff", "code points beyond U+10FFFF and invalid lead bytes");
+    checkString("\xe4\xbd", "sequence truncated at the end");
+    checkString("\xe4\xbdz\xf0\x9f\x98z", "truncated sequences followed by ascii");
+    checkString("\xe4\xe4\xbd\xa0", "truncated sequence followed by a valid one");
+    check(writeString("\x80") == "\"\xef\xbf\xbd\"", "invalid bytes become U+FFFD");
+
+    // 随机字节串，偏向非ASCII字节
+    mt19937 rng(20240501);
+    const unsigned char pool[] = {'a', '"', '\\', '\n', 0x01, 0x7f, 0x80, 0x8f, 0x90, 0x9f, 0xa0, 0xbf,
+                                  0xc0, 0xc2, 0xdf, 0xe0, 0xe4, 0xed, 0xef, 0xf0, 0xf4, 0xf5, 0xff};
+    int mismatches = 0;
+    int invalidJson = 0;
+    const int kRounds = 20000;
+    for (int r = 0; r < kRounds; ++r)
+    {
+        string s(rng() % 12, '\0');
+        for (char &c : s)
+        {
+            c = static_cast<char>(pool[rng() % sizeof(pool)]);
+        }
+        string got = writeString(s);
+        if (got != dumpString(s))
+        {
+            if (mismatches++ == 0)
+            {
+                cout << "  first mismatch for input " << hex(s) << endl;
+            }
+        }
+        if (!json::accept(got))
+        {
+            ++invalidJson;
+        }
+    }
+    check(mismatches == 0, to_string(kRounds) + " random byte strings match dump(replace) (" + to_string(mismatches) + " mismatches)");
+    check(invalidJson == 0, "output is always valid json (" + to_string(invalidJson) + " rejected)");
+
+    cout << (g_failures == 0 ? "all checks passed" : to_string(g_failures) + " check(s) failed") << endl;
+    return g_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,177 @@
+/*
+OfflineMsgWriter 攒批与flush语义测试，用进程内的OfflineMsgModel替身代替MySQL
+替身记录每次批量insert的内容，可以注入提交耗时和失败次数
+检查：
+1. 大量append按_maxBatch拆批，每批在一次insert中提交，全部消息写入且同一用户的消息保持append顺序
+2. 单条消息在时间窗口内提交，不需要攒满一批
+3. flush()等待调用前append的所有消息提交
+4. flushUser()在该用户没有未提交消息时立即返回，即使其他用户的消息正在慢速提交；
+   有未提交消息时等到它们提交后才返回
+5. 提交失败会重试，重试用尽后整批丢弃并计入getDroppedCount()
+*/
+#include "offlinemsgwriter.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// 替身的状态，测试线程设置注入参数，刷盘线程调用insert
+static mutex g_modelMutex;
+static vector<vector<OfflineMsg>> g_batches;        // 每次成功insert的批次
+static chrono::milliseconds g_insertDelay{0};       // 每次insert的耗时
+static int g_failNext = 0;                          // 接下来失败的insert次数
+static int g_insertCalls = 0;                       // insert调用次数，含失败
+
+// OfflineMsgWriter只使用批量insert
+bool OfflineMsgModel::insert(const vector<OfflineMsg> &msgs)
+{
+    chrono::milliseconds delay;
+    {
+        lock_guard<mutex> lock(g_modelMutex);
+        ++g_insertCalls;
+        delay = g_insertDelay;
+    }
+    this_thread::sleep_for(delay);
+
+    lock_guard<mutex> lock(g_modelMutex);
+    if (g_failNext > 0)
+    {
+        --g_failNext;
+        return false;
+    }
+    g_batches.push_back(msgs);
+    return true;
+}
+
+static void resetModel(chrono::milliseconds delay, int failNext)
+{
+    lock_guard<mutex> lock(g_modelMutex);
+    g_batches.clear();
+    g_insertDelay = delay;
+    g_failNext = failNext;
+    g_insertCalls = 0;
+}
+
+static size_t committedRows()
+{
+    lock_guard<mutex> lock(g_modelMutex);
+    size_t n = 0;
+    for (const auto &batch : g_batches)
+    {
+        n += batch.size();
+    }
+    return n;
+}
+
+static int g_failures = 0;
+
+static void check(bool ok, const string &what)
+{
+    cout << (ok ? "[PASS] " : "[FAIL] ") << what << endl;
+    if (!ok)
+    {
+        ++g_failures;
+    }
+}
+
+static long elapsedMs(chrono::steady_clock::time_point start)
+{
+    return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+}
+
+int main()
+{
+    OfflineMsgWriter *writer = OfflineMsgWriter::instance();
+
+    // 1. 拆批与顺序：10个用户交替各1000条
+    resetModel(chrono::milliseconds(0), 0);
+    const int kUsers = 10;
+    const int kPerUser = 1000;
+    for (int i = 0; i < kPerUser; ++i)
+    {
+        for (int u = 0; u < kUsers; ++u)
+        {
+            writer->append(u, to_string(i));
+        }
+    }
+    check(writer->flush(chrono::seconds(5)), "flush() returns once 10000 appended messages are committed");
+    {
+        lock_guard<mutex> lock(g_modelMutex);
+        size_t rows = 0;
+        size_t maxBatch = 0;
+        map<int, int> next;
+        bool ordered = true;
+        for (const auto &batch : g_batches)
+        {
+            rows += batch.size();
+            maxBatch = max(maxBatch, batch.size());
+            for (const OfflineMsg &msg : batch)
+            {
+                ordered = ordered && *msg.msg == to_string(next[msg.userid]++);
+            }
+        }
+        check(rows == kUsers * kPerUser, "all messages written (" + to_string(rows) + ")");
+        check(maxBatch <= 256 && g_batches.size() < rows / 10,
+              "messages are grouped into batches of at most 256 (" + to_string(g_batches.size()) +
+                  " batches, largest " + to_string(maxBatch) + ")");
+        check(ordered, "per-user order follows append order");
+    }
+
+    // 2. 时间窗口：单条消息不等攒批也会提交
+    resetModel(chrono::milliseconds(0), 0);
+    auto start = chrono::steady_clock::now();
+    writer->append(1, "single");
+    while (committedRows() == 0 && elapsedMs(start) < 2000)
+    {
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    long windowMs = elapsedMs(start);
+    check(committedRows() == 1 && windowMs < 500,
+          "a lone message is committed by the time window (" + to_string(windowMs) + " ms)");
+
+    // 3. 群离线消息：多个接收者共享一份内容，flush后全部可见
+    resetModel(chrono::milliseconds(0), 0);
+    writer->append(vector<int>{100, 101, 102}, "group");
+    check(writer->flush(chrono::seconds(2)) && committedRows() == 3, "group append writes one row per recipient");
+
+    // 4. flushUser：慢提交期间，没有积压的用户不等待，有积压的用户等到提交
+    resetModel(chrono::milliseconds(300), 0);
+    writer->append(7, "slow");
+    this_thread::sleep_for(chrono::milliseconds(50)); // 让刷盘线程取走这一批，开始慢速提交
+    start = chrono::steady_clock::now();
+    bool idle = writer->flushUser(8);
+    long idleMs = elapsedMs(start);
+    check(idle && idleMs < 20, "flushUser() of a user with nothing pending returns at once (" + to_string(idleMs) + " ms)");
+    start = chrono::steady_clock::now();
+    bool pending = writer->flushUser(7);
+    long pendingMs = elapsedMs(start);
+    check(pending && committedRows() == 1,
+          "flushUser() of a user with a pending row waits for its commit (" + to_string(pendingMs) + " ms)");
+    check(writer->flushUser(7) && elapsedMs(start) - pendingMs < 20, "flushUser() no longer waits once the row is committed");
+
+    // 5. 失败重试与丢弃
+    resetModel(chrono::milliseconds(0), 2);
+    long dropped = writer->getDroppedCount();
+    writer->append(9, "retry");
+    writer->flush(chrono::seconds(2));
+    check(committedRows() == 1 && writer->getDroppedCount() == dropped, "a batch that fails twice is retried and committed");
+
+    resetModel(chrono::milliseconds(0), 100);
+    writer->append(9, "lost");
+    writer->flush(chrono::seconds(2));
+    {
+        lock_guard<mutex> lock(g_modelMutex);
+        check(g_batches.empty() && g_insertCalls == 4 && writer->getDroppedCount() == dropped + 1,
+              "a batch that keeps failing is dropped after 3 retries (" + to_string(g_insertCalls) + " attempts)");
+        g_failNext = 0;
+    }
+
+    check(writer->getPendingCount() == 0, "nothing left pending");
+    cout << (g_failures == 0 ? "all checks passed" : to_string(g_failures) + " check(s) failed") << endl;
+    return g_failures == 0 ? 0 : 1;
+}
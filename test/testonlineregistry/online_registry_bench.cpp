@@ -0,0 +1,192 @@
+/*
+在线用户连接表的并发查询基准：单把互斥锁的旧实现 vs 按userid分片读写锁的OnlineRegistry
+1. 读线程不停按随机userid查找连接，模拟多个I/O线程同时转发聊天消息
+2. 另有一个写线程以固定频率登录/注销用户，模拟上下线
+3. 读线程数从1递增，输出每种实现的总查询吞吐，单锁实现的吞吐会随线程数增加而停滞甚至下降
+用法：online_registry_bench [最大读线程数] [每轮毫秒数]
+*/
+#include "onlineregistry.hpp"
+
+#include <muduo/net/EventLoop.h>
+#include <muduo/net/InetAddress.h>
+#include <muduo/net/TcpConnection.h>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// 改造前ChatService中的连接表：一个unordered_map加一把互斥锁
+class SingleMutexRegistry
+{
+public:
+    void add(int userid, const TcpConnectionPtr &conn)
+    {
+        lock_guard<mutex> lock(_connMutex);
+        _userConnMap[userid] = conn;
+    }
+
+    bool remove(int userid)
+    {
+        lock_guard<mutex> lock(_connMutex);
+        return _userConnMap.erase(userid) > 0;
+    }
+
+    TcpConnectionPtr find(int userid) const
+    {
+        lock_guard<mutex> lock(_connMutex);
+        auto it = _userConnMap.find(userid);
+        if (it == _userConnMap.end())
+        {
+            return TcpConnectionPtr();
+        }
+        return it->second;
+    }
+
+private:
+    mutable mutex _connMutex;
+    unordered_map<int, TcpConnectionPtr> _userConnMap;
+};
+
+static const int USER_NUM = 100000;
+static const int CONN_NUM = 256; // 连接多一些，避免多个读线程集中在少数连接的引用计数上，掩盖锁本身的竞争
+
+// 读线程查询、写线程上下线，返回每秒查询次数
+template <typename Registry>
+static double run(Registry &registry, const vector<TcpConnectionPtr> &conns, int readers, int millis)
+{
+    for (int id = 0; id < USER_NUM; ++id)
+    {
+        registry.add(id, conns[id % CONN_NUM]);
+    }
+
+    atomic<bool> running{true};
+    atomic<long> lookups{0};
+    atomic<long> hits{0};
+
+    vector<thread> threads;
+    for (int r = 0; r < readers; ++r)
+    {
+        threads.emplace_back([&, r]() {
+            mt19937 rng(r + 1);
+            uniform_int_distribution<int> pick(0, USER_NUM - 1);
+            long n = 0;
+            long found = 0;
+            while (running.load(memory_order_relaxed))
+            {
+                for (int k = 0; k < 256; ++k)
+                {
+                    if (registry.find(pick(rng)))
+                    {
+                        ++found;
+                    }
+                }
+                n += 256;
+            }
+            lookups += n;
+            hits += found;
+        });
+    }
+
+    // 每毫秒约有10个用户下线再上线
+    thread writer([&]() {
+        mt19937 rng(12345);
+        uniform_int_distribution<int> pick(0, USER_NUM - 1);
+        while (running.load(memory_order_relaxed))
+        {
+            for (int k = 0; k < 10; ++k)
+            {
+                int id = pick(rng);
+                registry.remove(id);
+                registry.add(id, conns[id % CONN_NUM]);
+            }
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+    });
+
+    auto begin = chrono::steady_clock::now();
+    this_thread::sleep_for(chrono::milliseconds(millis));
+    running = false;
+    for (thread &t : threads)
+    {
+        t.join();
+    }
+    writer.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+    for (int id = 0; id < USER_NUM; ++id)
+    {
+        registry.remove(id);
+    }
+    if (hits.load() < lookups.load() * 9 / 10)
+    {
+        fprintf(stderr, "unexpected miss rate: %ld of %ld lookups found\n", hits.load(), lookups.load());
+    }
+    return lookups.load() / seconds;
+}
+
+int main(int argc, char **argv)
+{
+    int maxReaders = argc > 1 ? atoi(argv[1]) : static_cast<int>(thread::hardware_concurrency());
+    int millis = argc > 2 ? atoi(argv[2]) : 1000;
+    if (maxReaders < 1)
+    {
+        maxReaders = 1;
+    }
+
+    // 连接只作为表中的值，用socketpair创建，不需要运行事件循环；多个userid共用同一个连接
+    EventLoop loop;
+    vector<TcpConnectionPtr> conns;
+    vector<int> peers;
+    for (int i = 0; i < CONN_NUM; ++i)
+    {
+        int fds[2];
+        if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+        {
+            perror("socketpair");
+            return 1;
+        }
+        TcpConnectionPtr conn(new TcpConnection(&loop, "bench-" + to_string(i), fds[0], InetAddress(), InetAddress()));
+        conn->connectEstablished();
+        conns.push_back(conn);
+        peers.push_back(fds[1]);
+    }
+
+    printf("users=%d connections=%d %dms per run\n", USER_NUM, CONN_NUM, millis);
+    printf("%8s %18s %18s %8s\n", "readers", "single mutex/s", "OnlineRegistry/s", "speedup");
+    // 读线程数按1、2、4...递增，最后一轮用满maxReaders
+    vector<int> readerCounts;
+    for (int readers = 1; readers < maxReaders; readers *= 2)
+    {
+        readerCounts.push_back(readers);
+    }
+    readerCounts.push_back(maxReaders);
+    for (int readers : readerCounts)
+    {
+        SingleMutexRegistry single;
+        OnlineRegistry sharded;
+        double a = run(single, conns, readers, millis);
+        double b = run(sharded, conns, readers, millis);
+        printf("%8d %18.0f %18.0f %7.1fx\n", readers, a, b, b / a);
+    }
+
+    for (auto &conn : conns)
+    {
+        conn->connectDestroyed();
+    }
+    for (int fd : peers)
+    {
+        ::close(fd);
+    }
+    return 0;
+}
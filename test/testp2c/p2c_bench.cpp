@@ -0,0 +1,171 @@
+/*
+P2C + Peak EWMA 与轮询的对比基准（模拟延迟，不需要真实后端）
+1. 每个假后端有基础服务时间，服务时间随该后端上的并发数增长（共享容量），并带指数分布的抖动
+2. 客户端线程阻塞式发请求，按选择策略挑后端，记录端到端延迟，统计 p50/p99/p999 和各后端承接的请求比例
+3. 场景：同构后端、一台慢节点、一台持续失败的节点（检验离群剔除）
+用法：p2c_bench [客户端线程数] [每线程请求数]
+*/
+#include "discovery/P2CBalancer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// 假后端：sleep 模拟服务时间，failing 为 true 时快速返回失败（如连接被拒）
+struct FakeBackend
+{
+    EndpointLoad load;
+    int baseUs;
+    bool failing;
+    atomic<int> concurrency{0};
+    atomic<long> served{0};
+
+    FakeBackend(const string &key, int baseUs, bool failing = false)
+        : load(key), baseUs(baseUs), failing(failing) {}
+};
+
+struct Scenario
+{
+    string name;
+    vector<int> baseUs;   // 各后端的基础服务时间
+    int failingIndex;     // 持续失败的后端，-1 表示没有
+};
+
+struct Result
+{
+    vector<long> latencyUs;
+    long failures = 0;
+    vector<long> served;
+    double seconds = 0;
+};
+
+static Result run(const Scenario &sc, bool p2c, int clients, int requests)
+{
+    vector<unique_ptr<FakeBackend>> backends;
+    for (size_t i = 0; i < sc.baseUs.size(); ++i)
+    {
+        backends.emplace_back(new FakeBackend("b" + to_string(i), sc.baseUs[i], static_cast<int>(i) == sc.failingIndex));
+    }
+
+    atomic<size_t> rr{0};
+    atomic<long> failures{0};
+    mutex mtx;
+    Result result;
+
+    auto worker = [&](int id) {
+        mt19937 rng(id * 7919 + 1);
+        exponential_distribution<double> jitter(1.0);
+        vector<long> mine;
+        mine.reserve(requests);
+        for (int r = 0; r < requests; ++r)
+        {
+            size_t i = p2c ? p2cSelect(
+                                 backends.size(),
+                                 [&](size_t k) -> const EndpointLoad & { return backends[k]->load; },
+                                 [](size_t) { return true; })
+                           : rr++ % backends.size();
+            FakeBackend &b = *backends[i];
+            b.load.onStart();
+            auto start = chrono::steady_clock::now();
+            bool ok = true;
+            if (b.failing)
+            {
+                this_thread::sleep_for(chrono::microseconds(200));
+                ok = false;
+            }
+            else
+            {
+                int c = ++b.concurrency;
+                int us = static_cast<int>(b.baseUs * (0.5 + 0.5 * jitter(rng)) * (1.0 + c / 8.0));
+                this_thread::sleep_for(chrono::microseconds(us));
+                --b.concurrency;
+            }
+            auto latency = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+            b.load.onComplete(latency, ok);
+            ++b.served;
+            if (ok)
+            {
+                mine.push_back(latency.count());
+            }
+            else
+            {
+                ++failures;
+            }
+        }
+        lock_guard<mutex> lock(mtx);
+        result.latencyUs.insert(result.latencyUs.end(), mine.begin(), mine.end());
+    };
+
+    auto begin = chrono::steady_clock::now();
+    vector<thread> threads;
+    for (int i = 0; i < clients; ++i)
+    {
+        threads.emplace_back(worker, i);
+    }
+    for (thread &t : threads)
+    {
+        t.join();
+    }
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    result.failures = failures;
+    for (auto &b : backends)
+    {
+        result.served.push_back(b->served);
+    }
+    sort(result.latencyUs.begin(), result.latencyUs.end());
+    return result;
+}
+
+static long percentile(const vector<long> &sorted, double p)
+{
+    if (sorted.empty())
+    {
+        return 0;
+    }
+    size_t idx = static_cast<size_t>(p * (sorted.size() - 1));
+    return sorted[idx];
+}
+
+static void report(const char *policy, const Result &r, int total)
+{
+    printf("  %-4s p50=%6ldus p99=%6ldus p999=%6ldus  failed=%5ld  %.0f req/s  share:",
+           policy, percentile(r.latencyUs, 0.5), percentile(r.latencyUs, 0.99),
+           percentile(r.latencyUs, 0.999), r.failures, total / r.seconds);
+    for (long s : r.served)
+    {
+        printf(" %4.1f%%", 100.0 * s / total);
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    int clients = argc > 1 ? atoi(argv[1]) : 32;
+    int requests = argc > 2 ? atoi(argv[2]) : 300;
+
+    vector<Scenario> scenarios = {
+        {"homogeneous (5 x 1ms)", {1000, 1000, 1000, 1000, 1000}, -1},
+        {"one slow backend (8ms + 4 x 1ms)", {8000, 1000, 1000, 1000, 1000}, -1},
+        {"one failing backend (fails fast + 4 x 1ms)", {1000, 1000, 1000, 1000, 1000}, 0},
+    };
+
+    printf("clients=%d requests/client=%d\n", clients, requests);
+    for (const Scenario &sc : scenarios)
+    {
+        printf("%s\n", sc.name.c_str());
+        int total = clients * requests;
+        report("rr", run(sc, false, clients, requests), total);
+        report("p2c", run(sc, true, clients, requests), total);
+    }
+    return 0;
+}
@@ -0,0 +1,250 @@
+/*
+跨节点PUBLISH吞吐基准：改造前的同步redisCommand vs 异步流水线发布器RedisPublisher
+1. 模拟instances个ChatServer节点，每个节点threads个业务线程不停向各节点通道发布消息
+2. sync：每个业务线程独占一个hiredis连接同步redisCommand，每条消息一次往返（改造前的做法，且不再共用一个上下文）
+   pipelined：每个节点一个RedisPublisher，业务线程只入队，发送线程批量流水线发送
+3. 另起一个订阅连接接收所有节点通道，redis需要真正把消息推给订阅者
+4. 输出两种方式每秒成功发布的消息数、订阅端每秒收到的消息数，以及是否达到50k/s的目标
+用法：redis_publish_bench [节点数] [每节点线程数] [秒数] [消息字节数] [ip] [port]
+*/
+#include "redispublisher.hpp"
+
+#include <hiredis/hiredis.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+using Clock = chrono::steady_clock;
+
+static const double TARGET_RATE = 50000;
+
+// 订阅所有节点通道并计数，析构时关闭连接使接收线程退出
+class Drain
+{
+public:
+    Drain(const char *ip, int port, const string &pattern)
+    {
+        _context = redisConnect(ip, port);
+        if (nullptr == _context || _context->err)
+        {
+            return;
+        }
+        redisReply *reply = (redisReply *)redisCommand(_context, "PSUBSCRIBE %s", pattern.c_str());
+        if (nullptr == reply)
+        {
+            return;
+        }
+        freeReplyObject(reply);
+        _ok = true;
+        _thread = thread([this]() {
+            redisReply *msg = nullptr;
+            while (REDIS_OK == redisGetReply(_context, (void **)&msg))
+            {
+                freeReplyObject(msg);
+                ++_received;
+            }
+        });
+    }
+
+    ~Drain()
+    {
+        if (_context != nullptr)
+        {
+            ::shutdown(_context->fd, SHUT_RDWR);
+        }
+        if (_thread.joinable())
+        {
+            _thread.join();
+        }
+        if (_context != nullptr)
+        {
+            redisFree(_context);
+        }
+    }
+
+    bool ok() const { return _ok; }
+    long received() const { return _received; }
+
+private:
+    redisContext *_context = nullptr;
+    thread _thread;
+    bool _ok = false;
+    atomic_long _received{0};
+};
+
+struct Result
+{
+    double published = 0; // 每秒成功发布数
+    double received = 0;  // 订阅端每秒收到数
+};
+
+static string channelOf(const string &prefix, long i, int instances)
+{
+    return prefix + to_string(i % instances);
+}
+
+// 改造前：同步redisCommand，每条消息等待一次响应
+static Result runSync(int instances, int threads, int seconds, size_t size, const char *ip, int port)
+{
+    string prefix = "bench:sync:" + to_string(getpid()) + ":";
+    Drain drain(ip, port, prefix + "*");
+    if (!drain.ok())
+    {
+        return Result();
+    }
+
+    atomic_bool running{true};
+    atomic_long published{0};
+    vector<thread> workers;
+    for (int t = 0; t < instances * threads; ++t)
+    {
+        workers.emplace_back([&, t]() {
+            redisContext *c = redisConnect(ip, port);
+            if (nullptr == c || c->err)
+            {
+                if (c != nullptr)
+                {
+                    redisFree(c);
+                }
+                return;
+            }
+            string payload(size, 'x');
+            long n = 0;
+            for (long i = t; running; ++i)
+            {
+                string channel = channelOf(prefix, i, instances);
+                redisReply *reply = (redisReply *)redisCommand(c, "PUBLISH %b %b", channel.data(), channel.size(),
+                                                               payload.data(), payload.size());
+                if (nullptr == reply)
+                {
+                    break;
+                }
+                freeReplyObject(reply);
+                ++n;
+            }
+            published += n;
+            redisFree(c);
+        });
+    }
+
+    long received0 = drain.received();
+    auto begin = Clock::now();
+    this_thread::sleep_for(chrono::seconds(seconds));
+    running = false;
+    for (thread &w : workers)
+    {
+        w.join();
+    }
+    double elapsed = chrono::duration<double>(Clock::now() - begin).count();
+
+    Result r;
+    r.published = published / elapsed;
+    r.received = (drain.received() - received0) / elapsed;
+    return r;
+}
+
+// 改造后：每个节点一个RedisPublisher，业务线程只入队
+static Result runPipelined(int instances, int threads, int seconds, size_t size, const char *ip, int port)
+{
+    string prefix = "bench:pipe:" + to_string(getpid()) + ":";
+    Drain drain(ip, port, prefix + "*");
+    if (!drain.ok())
+    {
+        return Result();
+    }
+
+    vector<unique_ptr<RedisPublisher>> publishers;
+    for (int i = 0; i < instances; ++i)
+    {
+        publishers.emplace_back(new RedisPublisher());
+        if (!publishers.back()->connect(ip, port))
+        {
+            return Result();
+        }
+    }
+
+    auto publishedNow = [&publishers]() {
+        long n = 0;
+        for (auto &p : publishers)
+        {
+            n += p->getPublishCount();
+        }
+        return n;
+    };
+
+    atomic_bool running{true};
+    auto payload = make_shared<const string>(size, 'x');
+    vector<thread> workers;
+    for (int t = 0; t < instances * threads; ++t)
+    {
+        workers.emplace_back([&, t]() {
+            RedisPublisher &publisher = *publishers[t / threads];
+            for (long i = t; running; ++i)
+            {
+                publisher.publish(channelOf(prefix, i, instances), payload);
+            }
+        });
+    }
+
+    long published0 = publishedNow();
+    long received0 = drain.received();
+    auto begin = Clock::now();
+    this_thread::sleep_for(chrono::seconds(seconds));
+    // 统计截止时已经确认发送的消息，队列中剩余的不计入
+    long published1 = publishedNow();
+    long received1 = drain.received();
+    double elapsed = chrono::duration<double>(Clock::now() - begin).count();
+    running = false;
+    for (thread &w : workers)
+    {
+        w.join();
+    }
+
+    Result r;
+    r.published = (published1 - published0) / elapsed;
+    r.received = (received1 - received0) / elapsed;
+    long maxBatch = 0;
+    for (auto &p : publishers)
+    {
+        maxBatch = max(maxBatch, p->getMaxBatchSize());
+    }
+    printf("  pipelined max batch: %ld messages\n", maxBatch);
+    return r;
+}
+
+int main(int argc, char **argv)
+{
+    int instances = argc > 1 ? atoi(argv[1]) : 4;
+    int threads = argc > 2 ? atoi(argv[2]) : 4;
+    int seconds = argc > 3 ? atoi(argv[3]) : 5;
+    size_t size = argc > 4 ? static_cast<size_t>(atol(argv[4])) : 256;
+    const char *ip = argc > 5 ? argv[5] : "127.0.0.1";
+    int port = argc > 6 ? atoi(argv[6]) : 6379;
+
+    printf("redis %s:%d instances=%d threads/instance=%d %ds per run, %zu byte messages\n",
+           ip, port, instances, threads, seconds, size);
+    Result sync = runSync(instances, threads, seconds, size, ip, port);
+    Result pipe = runPipelined(instances, threads, seconds, size, ip, port);
+    if (sync.published == 0 || pipe.published == 0)
+    {
+        fprintf(stderr, "cannot connect to redis %s:%d\n", ip, port);
+        return 1;
+    }
+
+    printf("%10s %14s %14s\n", "mode", "published/s", "received/s");
+    printf("%10s %14.0f %14.0f\n", "sync", sync.published, sync.received);
+    printf("%10s %14.0f %14.0f\n", "pipelined", pipe.published, pipe.received);
+    printf("pipelined %s the %.0f publishes/s target (%.1fx sync)\n",
+           pipe.published >= TARGET_RATE ? "meets" : "misses", TARGET_RATE, pipe.published / sync.published);
+    return 0;
+}
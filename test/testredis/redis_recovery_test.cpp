@@ -0,0 +1,181 @@
+/*
+redis断线重连测试：配合run_recovery_test.sh在运行过程中kill -9再重启redis-server
+1. 订阅一个通道并启动stream消费者，发送线程每10ms向通道PUBLISH、向stream XADD一条带序号的消息
+2. 先确认两条路径都能收到消息，然后等待订阅连接重连（getReconnectCount变为非0）
+3. 断言重连之后发出的消息在两条路径上都能重新收到，输出：
+   订阅连接的恢复耗时（getLastRecoveryMs）、发布器的恢复耗时、两条路径上最长的投递中断时间
+4. 超时没有恢复则返回1
+用法：redis_recovery_test [ip] [port] [超时秒数]
+*/
+#include "redis.hpp"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+using namespace std;
+
+using Clock = chrono::steady_clock;
+
+static const char *CHANNEL = "test:recovery";
+
+// 一条投递路径上的接收情况，只在订阅线程或stream消费线程上更新
+struct Delivery
+{
+    atomic_long lastSeq{-1};
+    atomic_long count{0};
+    atomic_long maxGapMs{0};
+    Clock::time_point last;
+    bool started = false;
+
+    void onMessage(long seq)
+    {
+        auto now = Clock::now();
+        if (started)
+        {
+            long gap = chrono::duration_cast<chrono::milliseconds>(now - last).count();
+            if (gap > maxGapMs)
+            {
+                maxGapMs = gap;
+            }
+        }
+        started = true;
+        last = now;
+        if (seq > lastSeq)
+        {
+            lastSeq = seq;
+        }
+        ++count;
+    }
+};
+
+// 等待条件成立，超时返回false
+template <typename Pred>
+static bool waitFor(Pred pred, Clock::time_point deadline)
+{
+    while (!pred())
+    {
+        if (Clock::now() > deadline)
+        {
+            return false;
+        }
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    const char *ip = argc > 1 ? argv[1] : "127.0.0.1";
+    int port = argc > 2 ? atoi(argv[2]) : 6379;
+    int timeoutSec = argc > 3 ? atoi(argv[3]) : 30;
+    // 每次运行使用独立的stream，不受之前运行残留的消费组影响
+    string stream = "test:recovery:stream:" + to_string(getpid());
+
+    Delivery pubsub;
+    Delivery streamed;
+    Redis redis;
+    redis.init_notify_handler([&](const RedisMessageBatch &batch) {
+        for (const auto &msg : batch)
+        {
+            long seq = atol(msg.second.c_str());
+            if (msg.first == CHANNEL)
+            {
+                pubsub.onMessage(seq);
+            }
+            else if (msg.first == stream)
+            {
+                streamed.onMessage(seq);
+            }
+        }
+    });
+    if (!redis.connect(ip, port) || !redis.subscribe(CHANNEL) || !redis.startSubscriber()
+        || !redis.startStreamConsumer(stream, "test", "c1"))
+    {
+        fprintf(stderr, "cannot connect to redis %s:%d\n", ip, port);
+        return 1;
+    }
+
+    atomic_long published{0};
+    atomic_bool running{true};
+    thread sender([&]() {
+        while (running)
+        {
+            auto message = make_shared<const string>(to_string(published.load()));
+            redis.publish(CHANNEL, message);
+            redis.appendStream(stream, message);
+            ++published;
+            this_thread::sleep_for(chrono::milliseconds(10));
+        }
+    });
+
+    auto deadline = Clock::now() + chrono::seconds(timeoutSec);
+    bool ok = true;
+    long resumeFrom = 0;
+    long resumeMs = 0;
+    if (!waitFor([&]() { return pubsub.count > 0 && streamed.count > 0; }, Clock::now() + chrono::seconds(5)))
+    {
+        fprintf(stderr, "no delivery before restart: pubsub=%ld stream=%ld\n", pubsub.count.load(), streamed.count.load());
+        ok = false;
+    }
+    else
+    {
+        printf("delivering, waiting for redis-server to be restarted...\n");
+        fflush(stdout);
+        if (!waitFor([&]() { return redis.getReconnectCount() > 0; }, deadline))
+        {
+            fprintf(stderr, "subscriber did not reconnect within %ds\n", timeoutSec);
+            ok = false;
+        }
+        else
+        {
+            // 重连回调之后发出的消息必须能收到，之前的消息可能在断开期间丢失
+            auto reconnectedAt = Clock::now();
+            resumeFrom = published;
+            if (!waitFor([&]() { return pubsub.lastSeq >= resumeFrom && streamed.lastSeq >= resumeFrom; }, deadline))
+            {
+                fprintf(stderr, "delivery did not resume: published=%ld pubsub last=%ld stream last=%ld\n",
+                        published.load(), pubsub.lastSeq.load(), streamed.lastSeq.load());
+                ok = false;
+            }
+            resumeMs = chrono::duration_cast<chrono::milliseconds>(Clock::now() - reconnectedAt).count();
+        }
+    }
+
+    running = false;
+    sender.join();
+
+    if (ok)
+    {
+        const RedisStreamConsumer *consumer = redis.getStreamConsumer();
+        printf("subscriber recovered after %ldms (reconnects=%ld)\n", redis.getLastRecoveryMs(), redis.getReconnectCount());
+        printf("publisher recovered after %ldms (reconnects=%ld)\n",
+               redis.getPublisher().getLastRecoveryMs(), redis.getPublisher().getReconnectCount());
+        printf("messages published after resubscribe delivered on both paths within %ldms\n", resumeMs);
+        printf("longest delivery gap: pubsub %ldms, stream %ldms\n", pubsub.maxGapMs.load(), streamed.maxGapMs.load());
+        printf("published=%ld pubsub received=%ld stream received=%ld (redelivered=%ld)\n",
+               published.load(), pubsub.count.load(), streamed.count.load(),
+               consumer ? consumer->getRedeliverCount() : 0L);
+        printf("PASS\n");
+    }
+
+    redis.stopStreamConsumer();
+    redis.stopSubscriber();
+
+    // 删除本次运行的stream
+    redisContext *context = redisConnect(ip, port);
+    if (context != nullptr && !context->err)
+    {
+        freeReplyObject(redisCommand(context, "DEL %s", stream.c_str()));
+    }
+    if (context != nullptr)
+    {
+        redisFree(context);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,207 @@
+/*
+节点间消息两种投递方式的吞吐对比：PUBLISH/SUBSCRIBE vs stream（XADD + XREADGROUP/XACK）
+1. 两种方式都走Redis封装的真实路径：异步流水线发布器发送，订阅线程或stream消费线程批量上报
+2. 一个发送线程尽快发出N条消息，消息头部带发送时间，接收回调统计端到端延迟
+3. 收齐N条或3秒没有新消息时结束，输出吞吐（从第一条发出到最后一条收到）、p50/p99延迟、
+   丢失条数，stream额外输出平均每批读取条数
+用法：redis_stream_bench [消息数] [消息字节数，不指定时扫描64/512/4096] [ip] [port]
+*/
+#include "redis.hpp"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+using Clock = chrono::steady_clock;
+
+struct Result
+{
+    double seconds = 0;
+    long received = 0;
+    long lost = 0;
+    long p50Us = 0;
+    long p99Us = 0;
+    double avgBatch = 0;
+    bool ok = true;
+};
+
+static long percentile(const vector<long> &sorted, double p)
+{
+    if (sorted.empty())
+    {
+        return 0;
+    }
+    return sorted[static_cast<size_t>(p * (sorted.size() - 1))];
+}
+
+static Result run(bool stream, long total, size_t size, const char *ip, int port)
+{
+    Result r;
+    string name = string(stream ? "bench:stream:" : "bench:pub:") + to_string(getpid());
+
+    mutex mtx;
+    vector<long> latencyUs;
+    latencyUs.reserve(total);
+    atomic_long received{0};
+    atomic_long warmup{0};
+
+    Redis redis;
+    // 长度不足一个时间戳的是预热消息
+    redis.init_notify_handler([&](const RedisMessageBatch &batch) {
+        auto now = Clock::now().time_since_epoch().count();
+        lock_guard<mutex> lock(mtx);
+        for (const auto &msg : batch)
+        {
+            if (msg.first != name)
+            {
+                continue;
+            }
+            if (msg.second.size() < sizeof(long long))
+            {
+                ++warmup;
+                continue;
+            }
+            long long sent;
+            memcpy(&sent, msg.second.data(), sizeof(sent));
+            latencyUs.push_back(chrono::duration_cast<chrono::microseconds>(Clock::duration(now - sent)).count());
+        }
+        received = latencyUs.size();
+    });
+    if (!redis.connect(ip, port))
+    {
+        r.ok = false;
+        return r;
+    }
+    r.ok = stream ? redis.startStreamConsumer(name, "bench", "c1")
+                  : redis.subscribe(name) && redis.startSubscriber();
+    if (!r.ok)
+    {
+        return r;
+    }
+
+    auto send = [&](const shared_ptr<const string> &message) {
+        return stream ? redis.appendStream(name, message) : redis.publish(name, message);
+    };
+
+    // SUBSCRIBE不等待响应，先发预热消息确认接收端已经就绪
+    auto ping = make_shared<const string>("w");
+    auto deadline = Clock::now() + chrono::seconds(3);
+    while (warmup == 0 && Clock::now() < deadline)
+    {
+        send(ping);
+        this_thread::sleep_for(chrono::milliseconds(50));
+    }
+    if (warmup == 0)
+    {
+        fprintf(stderr, "%s: receiver not ready\n", stream ? "stream" : "publish");
+        r.ok = false;
+        return r;
+    }
+
+    string payload(size, 'x');
+    auto begin = Clock::now();
+    for (long i = 0; i < total; ++i)
+    {
+        long long now = Clock::now().time_since_epoch().count();
+        memcpy(&payload[0], &now, sizeof(now));
+        send(make_shared<const string>(payload));
+    }
+
+    // 收齐或3秒没有进展时结束
+    long last = -1;
+    auto lastProgress = Clock::now();
+    while (received < total && Clock::now() - lastProgress < chrono::seconds(3))
+    {
+        if (received != last)
+        {
+            last = received;
+            lastProgress = Clock::now();
+        }
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    auto end = received < total ? lastProgress : Clock::now();
+    r.seconds = chrono::duration<double>(end - begin).count();
+
+    if (stream)
+    {
+        const RedisStreamConsumer *consumer = redis.getStreamConsumer();
+        r.avgBatch = consumer->getBatchCount() ? static_cast<double>(consumer->getReadCount()) / consumer->getBatchCount() : 0;
+        redis.stopStreamConsumer();
+    }
+    else
+    {
+        redis.stopSubscriber();
+    }
+
+    {
+        lock_guard<mutex> lock(mtx);
+        r.received = latencyUs.size();
+        sort(latencyUs.begin(), latencyUs.end());
+        r.p50Us = percentile(latencyUs, 0.5);
+        r.p99Us = percentile(latencyUs, 0.99);
+    }
+    r.lost = total - r.received;
+
+    if (stream)
+    {
+        // 删除本次运行的stream
+        redisContext *context = redisConnect(ip, port);
+        if (context != nullptr && !context->err)
+        {
+            freeReplyObject(redisCommand(context, "DEL %s", name.c_str()));
+        }
+        if (context != nullptr)
+        {
+            redisFree(context);
+        }
+    }
+    return r;
+}
+
+int main(int argc, char **argv)
+{
+    long total = argc > 1 ? atol(argv[1]) : 50000;
+    const char *ip = argc > 3 ? argv[3] : "127.0.0.1";
+    int port = argc > 4 ? atoi(argv[4]) : 6379;
+    vector<size_t> sizes = {64, 512, 4096};
+    if (argc > 2)
+    {
+        sizes = {static_cast<size_t>(atol(argv[2]))};
+    }
+
+    printf("redis %s:%d messages=%ld\n", ip, port, total);
+    printf("%8s %8s %12s %10s %10s %8s %9s\n", "size", "mode", "msgs/s", "p50", "p99", "lost", "avgBatch");
+    for (size_t size : sizes)
+    {
+        // 消息头部放发送时间
+        size = max(size, sizeof(long long));
+        for (int stream = 0; stream <= 1; ++stream)
+        {
+            Result r = run(stream, total, size, ip, port);
+            if (!r.ok)
+            {
+                fprintf(stderr, "cannot connect to redis %s:%d\n", ip, port);
+                return 1;
+            }
+            char batch[16] = "-";
+            if (stream)
+            {
+                snprintf(batch, sizeof(batch), "%.1f", r.avgBatch);
+            }
+            printf("%8zu %8s %12.0f %8ldus %8ldus %8ld %9s\n", size, stream ? "stream" : "publish",
+                   r.seconds > 0 ? r.received / r.seconds : 0.0, r.p50Us, r.p99Us, r.lost, batch);
+        }
+    }
+    return 0;
+}
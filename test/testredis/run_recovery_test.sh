@@ -0,0 +1,46 @@
+#!/bin/bash
+# 启动一个临时的redis-server（不持久化），运行redis_recovery_test，
+# 期间kill -9掉redis-server再在同一端口重启，测试程序的退出码作为脚本的退出码
+# 用法：run_recovery_test.sh <redis_recovery_test路径> [端口]
+
+TEST_BIN=${1:?usage: $0 <redis_recovery_test> [port]}
+PORT=${2:-16379}
+REDIS_PID=
+
+start_redis() {
+    redis-server --port "$PORT" --bind 127.0.0.1 --save "" --appendonly no > /dev/null &
+    REDIS_PID=$!
+    for i in $(seq 50); do
+        if redis-cli -p "$PORT" ping > /dev/null 2>&1; then
+            return 0
+        fi
+        sleep 0.1
+    done
+    echo "redis-server did not start on port $PORT" >&2
+    return 1
+}
+
+cleanup() {
+    if [ -n "$REDIS_PID" ]; then
+        kill "$REDIS_PID" 2> /dev/null
+        wait "$REDIS_PID" 2> /dev/null
+    fi
+}
+trap cleanup EXIT
+
+start_redis || exit 1
+
+"$TEST_BIN" 127.0.0.1 "$PORT" 30 &
+TEST_PID=$!
+
+# 先正常投递一段时间，再模拟redis崩溃，停机1秒后重启
+sleep 2
+echo "killing redis-server"
+kill -9 "$REDIS_PID"
+wait "$REDIS_PID" 2> /dev/null
+REDIS_PID=
+sleep 1
+echo "restarting redis-server"
+start_redis || { kill "$TEST_PID"; exit 1; }
+
+wait "$TEST_PID"